@@ -0,0 +1,199 @@
+#ifdef ORMPP_ENABLE_MYSQL
+#include "mysql.hpp"
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+#include "sqlite.hpp"
+#endif
+
+#ifdef ORMPP_ENABLE_PG
+#include "postgresql.hpp"
+#endif
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include "column_ops.hpp"
+#include "dbng.hpp"
+#include "parallel_scan.hpp"
+
+using namespace ormpp;
+const char *password = "";
+const char *ip = "127.0.0.1";
+const char *db = "test_ormppdb";
+
+struct bench_person {
+  int id;
+  std::string name;
+  int age;
+  double score;
+};
+REFLECTION(bench_person, id, name, age, score)
+
+template <typename Func>
+double elapsed(Func &&func) {
+  using namespace std::chrono;
+  auto begin = steady_clock::now();
+  func();
+  return duration_cast<duration<double>>(steady_clock::now() - begin).count();
+}
+
+std::vector<bench_person> make_rows(size_t count, int version) {
+  std::vector<bench_person> v;
+  v.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    int id = (int)i + 1;
+    v.push_back(bench_person{id, "name" + std::to_string(id + version),
+                             id % 100 + version, id * 0.5 + version});
+  }
+  return v;
+}
+
+// update(v) executes one statement per row, bulk_update(v) one statement per
+// chunk of rows
+template <typename DB>
+void bench_update(dbng<DB> &conn, const char *name, size_t count) {
+  conn.template delete_records<bench_person>();
+  if (conn.insert(make_rows(count, 0)) != (int)count) {
+    std::cout << name << ": insert failed" << std::endl;
+    return;
+  }
+
+  auto v1 = make_rows(count, 1);
+  auto t1 = elapsed([&] {
+    if (conn.update(v1) != (int)count)
+      std::cout << name << ": update failed" << std::endl;
+  });
+
+  auto v2 = make_rows(count, 2);
+  auto t2 = elapsed([&] {
+    if (conn.bulk_update(v2) != (int)count)
+      std::cout << name << ": bulk_update failed" << std::endl;
+  });
+
+  std::cout << name << " update " << count << " rows, row by row: " << t1
+            << "s, bulk: " << t2 << "s" << std::endl;
+}
+
+// the rows left by bench_update read on one connection against the partitions
+// read on the connections of the pool
+template <typename DB, typename... Args>
+void bench_scan(const char *name, Args &&...args) {
+  size_t threads = (std::max)(1u, std::thread::hardware_concurrency());
+  auto &pool = connection_pool<dbng<DB>>::instance();
+  pool.init((int)threads, std::forward<Args>(args)...);
+
+  size_t rows = 0;
+  auto t1 = elapsed([&] {
+    auto conn = pool.get();
+    if (conn == nullptr)
+      return;
+    rows = conn->template query<bench_person>().size();
+    pool.return_back(conn);
+  });
+
+  size_t scanned = 0;
+  auto t2 = elapsed([&] {
+    scanned = parallel_scan<dbng<DB>>(&bench_person::id, threads, "").size();
+  });
+
+  std::cout << name << " scan " << rows << " rows, one connection: " << t1
+            << "s, " << threads << " partitions: " << t2 << "s, " << scanned
+            << " rows" << std::endl;
+}
+
+struct bench_metric {
+  int id;
+  int age;
+  double score;
+};
+REFLECTION(bench_metric, id, age, score)
+
+// a hand written loop over the rows against the kernels over the columns
+void bench_column_ops(size_t row_count) {
+  std::vector<bench_metric> rows;
+  rows.reserve(row_count);
+  for (size_t i = 0; i < row_count; ++i) {
+    int id = (int)i + 1;
+    rows.push_back(bench_metric{id, id % 100, id % 1000 * 0.5});
+  }
+
+  int64_t loop_total = 0;
+  double loop_max = 0;
+  auto t1 = elapsed([&] {
+    for (auto &row : rows) {
+      if (row.age > 50)
+        loop_total += row.age;
+      if (row.score > loop_max)
+        loop_max = row.score;
+    }
+  });
+
+  std::vector<int> ages;
+  std::vector<double> scores;
+  auto t2 = elapsed([&] {
+    ages = get_column(rows, &bench_metric::age);
+    scores = get_column(rows, &bench_metric::score);
+  });
+
+  int64_t total = 0;
+  double highest = 0;
+  size_t matches = 0;
+  auto t3 = elapsed([&] {
+    total = sum(ages, filter(ages, ">", 50));
+    highest = max(scores);
+  });
+  auto t4 = elapsed([&] {
+    matches = count(ages, ">", 50);
+  });
+
+  if (total != loop_total || highest != loop_max)
+    std::cout << "column ops: wrong result" << std::endl;
+
+  std::cout << "column ops " << row_count << " rows, loop: " << t1
+            << "s, copy columns: " << t2 << "s, filter+sum+max: " << t3
+            << "s, count " << matches << ": " << t4 << "s" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+  size_t rows = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10000000;
+  ormpp_key key{"id"};
+
+  bench_column_ops(rows);
+
+#ifdef ORMPP_ENABLE_MYSQL
+  {
+    dbng<mysql> mysql;
+    if (mysql.connect(ip, "root", password, db) &&
+        mysql.create_datatable<bench_person>(key)) {
+      bench_update(mysql, "mysql", count);
+    }
+  }
+  bench_scan<mysql>("mysql", ip, "root", password, db);
+#endif
+
+#ifdef ORMPP_ENABLE_PG
+  {
+    dbng<postgresql> postgres;
+    if (postgres.connect(ip, "root", password, db) &&
+        postgres.create_datatable<bench_person>(key)) {
+      bench_update(postgres, "postgresql", count);
+    }
+  }
+  bench_scan<postgresql>("postgresql", ip, "root", password, db);
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+  {
+    dbng<sqlite> sqlite;
+    if (sqlite.connect(db) && sqlite.create_datatable<bench_person>(key)) {
+      bench_update(sqlite, "sqlite", count);
+    }
+  }
+#endif
+
+  return 0;
+}
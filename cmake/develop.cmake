@@ -56,6 +56,16 @@ if(ENABLE_LOG)
     add_definitions(-DORMPP_ENABLE_LOG)
 endif()
 
+# the avx2 kernels of column_ops.hpp
+option(ENABLE_AVX2 "Build with avx2" OFF)
+if(ENABLE_AVX2)
+    if(MSVC)
+        add_compile_options(/arch:AVX2)
+    else()
+        add_compile_options(-mavx2)
+    endif()
+endif()
+
 option(ENABLE_SQLITE3 "Enable sqlite3" OFF)
 if (ENABLE_SQLITE3)
     message(STATUS "ENABLE_SQLITE3")
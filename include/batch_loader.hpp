@@ -0,0 +1,153 @@
+#ifndef ORMPP_BATCH_LOADER_HPP
+#define ORMPP_BATCH_LOADER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "connection_pool.hpp"
+#include "dbng.hpp"
+
+namespace ormpp {
+// coalesce the point lookups of many threads into one get_by_keys query, the
+// keys are collected for a short window or until max_batch keys are pending,
+// such as:
+// batch_loader<dbng<mysql>, person, int> loader(&person::id);
+// auto row = loader.load(1).get();  // std::optional<person>
+template <typename DB, typename T, typename K>
+class batch_loader {
+ public:
+  batch_loader(K T::*key,
+               std::chrono::microseconds window = std::chrono::milliseconds(1),
+               size_t max_batch = max_batch_params,
+               connection_pool<DB> &pool = connection_pool<DB>::instance())
+      : key_(key), window_(window), max_batch_(max_batch), pool_(pool) {
+    thd_ = std::thread([this] {
+      run();
+    });
+  }
+
+  ~batch_loader() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    condition_.notify_one();
+    thd_.join();
+  }
+
+  batch_loader(const batch_loader &) = delete;
+  batch_loader &operator=(const batch_loader &) = delete;
+
+  // the row is empty if there is no row with the key, the future throws if
+  // the query can't be executed
+  std::future<std::optional<T>> load(const K &key) {
+    std::promise<std::optional<T>> promise;
+    auto future = promise.get_future();
+    bool notify = false;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (pending_.empty())
+        deadline_ = std::chrono::steady_clock::now() + window_;
+      pending_[key].push_back(std::move(promise));
+      notify = pending_.size() == 1 || pending_.size() >= max_batch_;
+    }
+
+    if (notify)
+      condition_.notify_one();
+    return future;
+  }
+
+  // the number of queries sent to the database
+  size_t batch_count() const { return batch_count_; }
+
+ private:
+  using promises_t = std::map<K, std::vector<std::promise<std::optional<T>>>>;
+
+  void run() {
+    while (true) {
+      promises_t batch;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock, [this] {
+          return stop_ || !pending_.empty();
+        });
+        if (pending_.empty())
+          return;
+
+        condition_.wait_until(lock, deadline_, [this] {
+          return stop_ || pending_.size() >= max_batch_;
+        });
+        batch.swap(pending_);
+      }
+
+      dispatch(batch);
+    }
+  }
+
+  void dispatch(promises_t &batch) {
+    std::vector<K> keys;
+    keys.reserve(batch.size());
+    for (auto &item : batch) {
+      keys.push_back(item.first);
+    }
+
+    ++batch_count_;
+    auto conn = pool_.get();
+    if (conn == nullptr) {
+      fail(batch, "no available connection");
+      return;
+    }
+
+    auto rows = conn->get_by_keys(key_, keys);
+    // the connection may be recreated when it is returned
+    bool ok = !conn->has_error();
+    auto error = conn->get_last_error();
+    pool_.return_back(conn);
+    if (!ok) {
+      fail(batch, "get_by_keys failed: " + error);
+      return;
+    }
+
+    size_t i = 0;
+    for (auto &item : batch) {
+      for (auto &promise : item.second) {
+        promise.set_value(rows[i]);
+      }
+      ++i;
+    }
+  }
+
+  void fail(promises_t &batch, const std::string &error) {
+    auto e = std::make_exception_ptr(std::runtime_error(error));
+    for (auto &item : batch) {
+      for (auto &promise : item.second) {
+        promise.set_exception(e);
+      }
+    }
+  }
+
+  K T::*key_;
+  std::chrono::microseconds window_;
+  size_t max_batch_;
+  connection_pool<DB> &pool_;
+
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  promises_t pending_;
+  std::chrono::steady_clock::time_point deadline_;
+  bool stop_ = false;
+  std::atomic<size_t> batch_count_ = 0;
+  std::thread thd_;
+};
+}  // namespace ormpp
+
+#endif  // ORMPP_BATCH_LOADER_HPP
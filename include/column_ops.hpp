@@ -0,0 +1,694 @@
+#ifndef ORMPP_COLUMN_OPS_HPP
+#define ORMPP_COLUMN_OPS_HPP
+
+#include <bitset>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// the kernels use avx2 if it is enabled, such as by -mavx2, otherwise sse2 on
+// x86, and the scalar loops on the other targets or if ORMPP_DISABLE_SIMD is
+// defined
+#if defined(ORMPP_DISABLE_SIMD)
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define ORMPP_SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ORMPP_SIMD_SSE2
+#endif
+
+#include "columns.hpp"
+
+namespace ormpp {
+enum class compare_op { eq, ne, lt, le, gt, ge, none };
+
+// the operators of the FID conditions: =, ==, !=, <>, <, <=, >, >=
+inline compare_op to_compare_op(std::string_view oper) {
+  if (oper == "=" || oper == "==")
+    return compare_op::eq;
+  if (oper == "!=" || oper == "<>")
+    return compare_op::ne;
+  if (oper == "<")
+    return compare_op::lt;
+  if (oper == "<=")
+    return compare_op::le;
+  if (oper == ">")
+    return compare_op::gt;
+  if (oper == ">=")
+    return compare_op::ge;
+  return compare_op::none;
+}
+
+// the signed and unsigned integers are compared by their values, such as
+// -1 < 0u
+template <typename U, typename V>
+inline bool compare_value(compare_op op, const U &lhs, const V &rhs) {
+  if constexpr (std::is_integral_v<U> && std::is_integral_v<V> &&
+                std::is_signed_v<U> != std::is_signed_v<V>) {
+    if constexpr (std::is_signed_v<U>) {
+      if (lhs < 0)
+        return compare_value(op, -1, 0);
+      return compare_value(op, (std::make_unsigned_t<U>)lhs, rhs);
+    }
+    else {
+      if (rhs < 0)
+        return compare_value(op, 0, -1);
+      return compare_value(op, lhs, (std::make_unsigned_t<V>)rhs);
+    }
+  }
+  else {
+    switch (op) {
+      case compare_op::eq:
+        return lhs == rhs;
+      case compare_op::ne:
+        return lhs != rhs;
+      case compare_op::lt:
+        return lhs < rhs;
+      case compare_op::le:
+        return lhs <= rhs;
+      case compare_op::gt:
+        return lhs > rhs;
+      case compare_op::ge:
+        return lhs >= rhs;
+      default:
+        return false;
+    }
+  }
+}
+
+// the sums of the integral fields are int64_t, the ones of the floating point
+// fields are double, the same as dbng::sum
+template <typename U>
+using sum_t = std::conditional_t<std::is_floating_point_v<U>, double, int64_t>;
+
+namespace simd {
+// the registers of U, the kernels fall back to the scalar loops if there is
+// no specialization for U
+template <typename U>
+struct traits {
+  static constexpr bool value = false;
+};
+
+// the comparisons of the integers are built from eq and gt
+template <typename Traits, typename Reg>
+inline unsigned compare_int(compare_op op, Reg a, Reg b) {
+  constexpr unsigned all = (1u << Traits::width) - 1;
+  switch (op) {
+    case compare_op::eq:
+      return Traits::eq(a, b);
+    case compare_op::ne:
+      return ~Traits::eq(a, b) & all;
+    case compare_op::lt:
+      return Traits::gt(b, a);
+    case compare_op::le:
+      return ~Traits::gt(a, b) & all;
+    case compare_op::gt:
+      return Traits::gt(a, b);
+    case compare_op::ge:
+      return ~Traits::gt(b, a) & all;
+    default:
+      return 0;
+  }
+}
+
+#if defined(ORMPP_SIMD_AVX2)
+template <>
+struct traits<int32_t> {
+  static constexpr bool value = true;
+  static constexpr size_t width = 8;
+  using reg = __m256i;
+  // 4 int64_t sums
+  using acc = __m256i;
+
+  static reg load(const int32_t *p) {
+    return _mm256_loadu_si256((const __m256i *)p);
+  }
+  static reg set1(int32_t v) { return _mm256_set1_epi32(v); }
+  static void store(int32_t *p, reg a) {
+    _mm256_storeu_si256((__m256i *)p, a);
+  }
+  static reg min(reg a, reg b) { return _mm256_min_epi32(a, b); }
+  static reg max(reg a, reg b) { return _mm256_max_epi32(a, b); }
+  static unsigned eq(reg a, reg b) { return mask(_mm256_cmpeq_epi32(a, b)); }
+  static unsigned gt(reg a, reg b) { return mask(_mm256_cmpgt_epi32(a, b)); }
+  static unsigned cmp(compare_op op, reg a, reg b) {
+    return compare_int<traits>(op, a, b);
+  }
+  static unsigned mask(reg a) {
+    return (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(a));
+  }
+  static acc zero() { return _mm256_setzero_si256(); }
+  static acc add(acc s, reg a) {
+    auto lo = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(a));
+    auto hi = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(a, 1));
+    return _mm256_add_epi64(s, _mm256_add_epi64(lo, hi));
+  }
+  static int64_t reduce(acc s) {
+    alignas(32) int64_t v[4];
+    _mm256_store_si256((__m256i *)v, s);
+    return v[0] + v[1] + v[2] + v[3];
+  }
+};
+
+template <>
+struct traits<int64_t> {
+  static constexpr bool value = true;
+  static constexpr size_t width = 4;
+  using reg = __m256i;
+  using acc = __m256i;
+
+  static reg load(const int64_t *p) {
+    return _mm256_loadu_si256((const __m256i *)p);
+  }
+  static reg set1(int64_t v) { return _mm256_set1_epi64x(v); }
+  static void store(int64_t *p, reg a) {
+    _mm256_storeu_si256((__m256i *)p, a);
+  }
+  static reg min(reg a, reg b) {
+    return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(a, b));
+  }
+  static reg max(reg a, reg b) {
+    return _mm256_blendv_epi8(b, a, _mm256_cmpgt_epi64(a, b));
+  }
+  static unsigned eq(reg a, reg b) { return mask(_mm256_cmpeq_epi64(a, b)); }
+  static unsigned gt(reg a, reg b) { return mask(_mm256_cmpgt_epi64(a, b)); }
+  static unsigned cmp(compare_op op, reg a, reg b) {
+    return compare_int<traits>(op, a, b);
+  }
+  static unsigned mask(reg a) {
+    return (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(a));
+  }
+  static acc zero() { return _mm256_setzero_si256(); }
+  static acc add(acc s, reg a) { return _mm256_add_epi64(s, a); }
+  static int64_t reduce(acc s) {
+    alignas(32) int64_t v[4];
+    _mm256_store_si256((__m256i *)v, s);
+    return v[0] + v[1] + v[2] + v[3];
+  }
+};
+
+template <>
+struct traits<float> {
+  static constexpr bool value = true;
+  static constexpr size_t width = 8;
+  using reg = __m256;
+  // 4 double sums
+  using acc = __m256d;
+
+  static reg load(const float *p) { return _mm256_loadu_ps(p); }
+  static reg set1(float v) { return _mm256_set1_ps(v); }
+  static void store(float *p, reg a) { _mm256_storeu_ps(p, a); }
+  static reg min(reg a, reg b) { return _mm256_min_ps(a, b); }
+  static reg max(reg a, reg b) { return _mm256_max_ps(a, b); }
+  static unsigned cmp(compare_op op, reg a, reg b) {
+    switch (op) {
+      case compare_op::eq:
+        return mask(_mm256_cmp_ps(a, b, _CMP_EQ_OQ));
+      case compare_op::ne:
+        return mask(_mm256_cmp_ps(a, b, _CMP_NEQ_UQ));
+      case compare_op::lt:
+        return mask(_mm256_cmp_ps(a, b, _CMP_LT_OQ));
+      case compare_op::le:
+        return mask(_mm256_cmp_ps(a, b, _CMP_LE_OQ));
+      case compare_op::gt:
+        return mask(_mm256_cmp_ps(a, b, _CMP_GT_OQ));
+      case compare_op::ge:
+        return mask(_mm256_cmp_ps(a, b, _CMP_GE_OQ));
+      default:
+        return 0;
+    }
+  }
+  static unsigned mask(reg a) { return (unsigned)_mm256_movemask_ps(a); }
+  static acc zero() { return _mm256_setzero_pd(); }
+  static acc add(acc s, reg a) {
+    auto lo = _mm256_cvtps_pd(_mm256_castps256_ps128(a));
+    auto hi = _mm256_cvtps_pd(_mm256_extractf128_ps(a, 1));
+    return _mm256_add_pd(s, _mm256_add_pd(lo, hi));
+  }
+  static double reduce(acc s) {
+    alignas(32) double v[4];
+    _mm256_store_pd(v, s);
+    return v[0] + v[1] + v[2] + v[3];
+  }
+};
+
+template <>
+struct traits<double> {
+  static constexpr bool value = true;
+  static constexpr size_t width = 4;
+  using reg = __m256d;
+  using acc = __m256d;
+
+  static reg load(const double *p) { return _mm256_loadu_pd(p); }
+  static reg set1(double v) { return _mm256_set1_pd(v); }
+  static void store(double *p, reg a) { _mm256_storeu_pd(p, a); }
+  static reg min(reg a, reg b) { return _mm256_min_pd(a, b); }
+  static reg max(reg a, reg b) { return _mm256_max_pd(a, b); }
+  static unsigned cmp(compare_op op, reg a, reg b) {
+    switch (op) {
+      case compare_op::eq:
+        return mask(_mm256_cmp_pd(a, b, _CMP_EQ_OQ));
+      case compare_op::ne:
+        return mask(_mm256_cmp_pd(a, b, _CMP_NEQ_UQ));
+      case compare_op::lt:
+        return mask(_mm256_cmp_pd(a, b, _CMP_LT_OQ));
+      case compare_op::le:
+        return mask(_mm256_cmp_pd(a, b, _CMP_LE_OQ));
+      case compare_op::gt:
+        return mask(_mm256_cmp_pd(a, b, _CMP_GT_OQ));
+      case compare_op::ge:
+        return mask(_mm256_cmp_pd(a, b, _CMP_GE_OQ));
+      default:
+        return 0;
+    }
+  }
+  static unsigned mask(reg a) { return (unsigned)_mm256_movemask_pd(a); }
+  static acc zero() { return _mm256_setzero_pd(); }
+  static acc add(acc s, reg a) { return _mm256_add_pd(s, a); }
+  static double reduce(acc s) {
+    alignas(32) double v[4];
+    _mm256_store_pd(v, s);
+    return v[0] + v[1] + v[2] + v[3];
+  }
+};
+#elif defined(ORMPP_SIMD_SSE2)
+// sse2 has no 64 bit integer comparisons, so int64_t uses the scalar loops
+template <>
+struct traits<int32_t> {
+  static constexpr bool value = true;
+  static constexpr size_t width = 4;
+  using reg = __m128i;
+  // 2 int64_t sums
+  using acc = __m128i;
+
+  static reg load(const int32_t *p) {
+    return _mm_loadu_si128((const __m128i *)p);
+  }
+  static reg set1(int32_t v) { return _mm_set1_epi32(v); }
+  static void store(int32_t *p, reg a) { _mm_storeu_si128((__m128i *)p, a); }
+  static reg min(reg a, reg b) {
+    auto gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, a));
+  }
+  static reg max(reg a, reg b) {
+    auto gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+  }
+  static unsigned eq(reg a, reg b) { return mask(_mm_cmpeq_epi32(a, b)); }
+  static unsigned gt(reg a, reg b) { return mask(_mm_cmpgt_epi32(a, b)); }
+  static unsigned cmp(compare_op op, reg a, reg b) {
+    return compare_int<traits>(op, a, b);
+  }
+  static unsigned mask(reg a) {
+    return (unsigned)_mm_movemask_ps(_mm_castsi128_ps(a));
+  }
+  static acc zero() { return _mm_setzero_si128(); }
+  static acc add(acc s, reg a) {
+    // sign extend to int64_t
+    auto sign = _mm_cmpgt_epi32(_mm_setzero_si128(), a);
+    auto lo = _mm_unpacklo_epi32(a, sign);
+    auto hi = _mm_unpackhi_epi32(a, sign);
+    return _mm_add_epi64(s, _mm_add_epi64(lo, hi));
+  }
+  static int64_t reduce(acc s) {
+    alignas(16) int64_t v[2];
+    _mm_store_si128((__m128i *)v, s);
+    return v[0] + v[1];
+  }
+};
+
+template <>
+struct traits<float> {
+  static constexpr bool value = true;
+  static constexpr size_t width = 4;
+  using reg = __m128;
+  // 2 double sums
+  using acc = __m128d;
+
+  static reg load(const float *p) { return _mm_loadu_ps(p); }
+  static reg set1(float v) { return _mm_set1_ps(v); }
+  static void store(float *p, reg a) { _mm_storeu_ps(p, a); }
+  static reg min(reg a, reg b) { return _mm_min_ps(a, b); }
+  static reg max(reg a, reg b) { return _mm_max_ps(a, b); }
+  static unsigned cmp(compare_op op, reg a, reg b) {
+    switch (op) {
+      case compare_op::eq:
+        return mask(_mm_cmpeq_ps(a, b));
+      case compare_op::ne:
+        return mask(_mm_cmpneq_ps(a, b));
+      case compare_op::lt:
+        return mask(_mm_cmplt_ps(a, b));
+      case compare_op::le:
+        return mask(_mm_cmple_ps(a, b));
+      case compare_op::gt:
+        return mask(_mm_cmpgt_ps(a, b));
+      case compare_op::ge:
+        return mask(_mm_cmpge_ps(a, b));
+      default:
+        return 0;
+    }
+  }
+  static unsigned mask(reg a) { return (unsigned)_mm_movemask_ps(a); }
+  static acc zero() { return _mm_setzero_pd(); }
+  static acc add(acc s, reg a) {
+    auto lo = _mm_cvtps_pd(a);
+    auto hi = _mm_cvtps_pd(_mm_movehl_ps(a, a));
+    return _mm_add_pd(s, _mm_add_pd(lo, hi));
+  }
+  static double reduce(acc s) {
+    alignas(16) double v[2];
+    _mm_store_pd(v, s);
+    return v[0] + v[1];
+  }
+};
+
+template <>
+struct traits<double> {
+  static constexpr bool value = true;
+  static constexpr size_t width = 2;
+  using reg = __m128d;
+  using acc = __m128d;
+
+  static reg load(const double *p) { return _mm_loadu_pd(p); }
+  static reg set1(double v) { return _mm_set1_pd(v); }
+  static void store(double *p, reg a) { _mm_storeu_pd(p, a); }
+  static reg min(reg a, reg b) { return _mm_min_pd(a, b); }
+  static reg max(reg a, reg b) { return _mm_max_pd(a, b); }
+  static unsigned cmp(compare_op op, reg a, reg b) {
+    switch (op) {
+      case compare_op::eq:
+        return mask(_mm_cmpeq_pd(a, b));
+      case compare_op::ne:
+        return mask(_mm_cmpneq_pd(a, b));
+      case compare_op::lt:
+        return mask(_mm_cmplt_pd(a, b));
+      case compare_op::le:
+        return mask(_mm_cmple_pd(a, b));
+      case compare_op::gt:
+        return mask(_mm_cmpgt_pd(a, b));
+      case compare_op::ge:
+        return mask(_mm_cmpge_pd(a, b));
+      default:
+        return 0;
+    }
+  }
+  static unsigned mask(reg a) { return (unsigned)_mm_movemask_pd(a); }
+  static acc zero() { return _mm_setzero_pd(); }
+  static acc add(acc s, reg a) { return _mm_add_pd(s, a); }
+  static double reduce(acc s) {
+    alignas(16) double v[2];
+    _mm_store_pd(v, s);
+    return v[0] + v[1];
+  }
+};
+#endif
+
+// the floating point sums are added in a different order than the scalar
+// loop, so they may differ in the last bits
+template <typename U>
+inline sum_t<U> sum(const U *data, size_t size) {
+  sum_t<U> result = 0;
+  size_t i = 0;
+  if constexpr (traits<U>::value) {
+    using tr = traits<U>;
+    auto acc = tr::zero();
+    for (; i + tr::width <= size; i += tr::width) {
+      acc = tr::add(acc, tr::load(data + i));
+    }
+    result = tr::reduce(acc);
+  }
+  for (; i < size; ++i) {
+    result += data[i];
+  }
+  return result;
+}
+
+// the min if Min, otherwise the max, U{} if size is 0; the result is
+// unspecified if there is a NaN
+template <bool Min, typename U>
+inline U extreme(const U *data, size_t size) {
+  if (size == 0)
+    return U{};
+
+  U result = data[0];
+  auto better = [](const U &lhs, const U &rhs) {
+    return Min ? lhs < rhs : rhs < lhs;
+  };
+  size_t i = 1;
+  if constexpr (traits<U>::value) {
+    using tr = traits<U>;
+    if (size >= tr::width) {
+      auto r = tr::load(data);
+      for (i = tr::width; i + tr::width <= size; i += tr::width) {
+        r = Min ? tr::min(r, tr::load(data + i))
+                : tr::max(r, tr::load(data + i));
+      }
+      U lanes[tr::width];
+      tr::store(lanes, r);
+      for (auto lane : lanes) {
+        if (better(lane, result))
+          result = lane;
+      }
+    }
+  }
+  for (; i < size; ++i) {
+    if (better(data[i], result))
+      result = data[i];
+  }
+  return result;
+}
+
+// call on_match(base, bits) for the blocks of data which have values
+// comparing to value by op, data[base + k] matches if the bit k of bits is set
+template <typename U, typename Func>
+inline void compare(const U *data, size_t size, compare_op op, U value,
+                    Func &&on_match) {
+  size_t i = 0;
+  if constexpr (traits<U>::value) {
+    using tr = traits<U>;
+    auto v = tr::set1(value);
+    for (; i + tr::width <= size; i += tr::width) {
+      auto bits = tr::cmp(op, tr::load(data + i), v);
+      if (bits != 0)
+        on_match(i, bits);
+    }
+  }
+  for (; i < size; ++i) {
+    if (compare_value(op, data[i], value))
+      on_match(i, 1u);
+  }
+}
+}  // namespace simd
+
+// value as the type U of a column for the kernels if the conversion keeps
+// its value, otherwise the values are compared by the scalar loop, such as
+// 20.5 to an int column
+template <typename U, typename V>
+inline std::optional<U> to_column_value(const V &value) {
+  if constexpr (std::is_same_v<U, V>) {
+    return value;
+  }
+  else if constexpr (std::is_integral_v<U> && std::is_integral_v<V> &&
+                     !std::is_same_v<V, bool>) {
+    if (compare_value(compare_op::ge, value, (std::numeric_limits<U>::min)()) &&
+        compare_value(compare_op::le, value, (std::numeric_limits<U>::max)()))
+      return (U)value;
+  }
+  return std::nullopt;
+}
+
+template <typename Column>
+struct is_arithmetic_column : std::false_type {};
+
+// std::vector<bool> has no data()
+template <typename U>
+struct is_arithmetic_column<std::vector<U>>
+    : std::bool_constant<std::is_arithmetic_v<U> && !std::is_same_v<U, bool>> {
+};
+
+// the field of the rows as a contiguous column, copy it once for the
+// repeated scans of a std::vector<T>
+template <typename T, typename U>
+inline std::vector<U> get_column(const std::vector<T> &rows, U T::*field) {
+  std::vector<U> column;
+  column.reserve(rows.size());
+  for (auto &row : rows) {
+    column.push_back(row.*field);
+  }
+  return column;
+}
+
+template <typename T, typename U>
+inline const column_t<U> &get_column(const columns<T> &cols, U T::*field) {
+  return cols.column(field);
+}
+
+// the indexes of the values comparing to value by oper, the operators are the
+// ones of the FID conditions, an unknown one matches no value; the values are
+// compared as they are, the same as the scalar compare_value, such as:
+// auto selection = filter(ages, ">", 20);
+template <typename Column, typename V>
+inline std::vector<size_t> filter(const Column &column, std::string_view oper,
+                                  const V &value) {
+  std::vector<size_t> selection;
+  auto op = to_compare_op(oper);
+  if constexpr (is_arithmetic_column<Column>::value) {
+    using U = typename Column::value_type;
+    if (auto v = to_column_value<U>(value)) {
+      simd::compare(column.data(), column.size(), op, *v,
+                    [&selection](size_t base, unsigned bits) {
+                      for (size_t k = 0; bits != 0; ++k, bits >>= 1) {
+                        if (bits & 1)
+                          selection.push_back(base + k);
+                      }
+                    });
+      return selection;
+    }
+  }
+
+  for (size_t i = 0; i < column.size(); ++i) {
+    if (compare_value(op, column[i], value))
+      selection.push_back(i);
+  }
+  return selection;
+}
+
+// the indexes of selection whose values compare to value by oper, to combine
+// the conditions
+template <typename Column, typename V>
+inline std::vector<size_t> filter(const Column &column, std::string_view oper,
+                                  const V &value,
+                                  const std::vector<size_t> &selection) {
+  std::vector<size_t> result;
+  auto op = to_compare_op(oper);
+  for (auto i : selection) {
+    if (compare_value(op, column[i], value))
+      result.push_back(i);
+  }
+  return result;
+}
+
+// the number of the values comparing to value by oper
+template <typename Column, typename V>
+inline size_t count(const Column &column, std::string_view oper,
+                    const V &value) {
+  size_t result = 0;
+  auto op = to_compare_op(oper);
+  if constexpr (is_arithmetic_column<Column>::value) {
+    using U = typename Column::value_type;
+    if (auto v = to_column_value<U>(value)) {
+      simd::compare(column.data(), column.size(), op, *v,
+                    [&result](size_t, unsigned bits) {
+                      result += std::bitset<32>(bits).count();
+                    });
+      return result;
+    }
+  }
+
+  for (size_t i = 0; i < column.size(); ++i) {
+    if (compare_value(op, column[i], value))
+      ++result;
+  }
+  return result;
+}
+
+// sum, min and max are 0 if there are no values, the same as dbng
+template <typename U>
+inline sum_t<U> sum(const std::vector<U> &column) {
+  static_assert(is_arithmetic_column<std::vector<U>>::value,
+                "sum needs an arithmetic column");
+  return simd::sum(column.data(), column.size());
+}
+
+template <typename U>
+inline U min(const std::vector<U> &column) {
+  static_assert(is_arithmetic_column<std::vector<U>>::value,
+                "min needs an arithmetic column");
+  return simd::extreme<true>(column.data(), column.size());
+}
+
+template <typename U>
+inline U max(const std::vector<U> &column) {
+  static_assert(is_arithmetic_column<std::vector<U>>::value,
+                "max needs an arithmetic column");
+  return simd::extreme<false>(column.data(), column.size());
+}
+
+// the aggregates of the selected values
+template <typename U>
+inline sum_t<U> sum(const std::vector<U> &column,
+                    const std::vector<size_t> &selection) {
+  static_assert(std::is_arithmetic_v<U>, "sum needs an arithmetic column");
+  sum_t<U> result = 0;
+  for (auto i : selection) {
+    result += column[i];
+  }
+  return result;
+}
+
+template <typename U>
+inline U min(const std::vector<U> &column,
+             const std::vector<size_t> &selection) {
+  static_assert(std::is_arithmetic_v<U>, "min needs an arithmetic column");
+  if (selection.empty())
+    return U{};
+  U result = column[selection[0]];
+  for (auto i : selection) {
+    if (column[i] < result)
+      result = column[i];
+  }
+  return result;
+}
+
+template <typename U>
+inline U max(const std::vector<U> &column,
+             const std::vector<size_t> &selection) {
+  static_assert(std::is_arithmetic_v<U>, "max needs an arithmetic column");
+  if (selection.empty())
+    return U{};
+  U result = column[selection[0]];
+  for (auto i : selection) {
+    if (result < column[i])
+      result = column[i];
+  }
+  return result;
+}
+
+// the operations on a field of a std::vector<T> or a columns<T>, the field of
+// a std::vector<T> is copied to a column first, such as:
+// auto selection = filter(rows, &person::age, ">", 20);
+// auto total = sum(rows, &person::age);
+template <typename Rows, typename T, typename U, typename V>
+inline std::vector<size_t> filter(const Rows &rows, U T::*field,
+                                  std::string_view oper, const V &value) {
+  return filter(get_column(rows, field), oper, value);
+}
+
+template <typename Rows, typename T, typename U, typename V>
+inline size_t count(const Rows &rows, U T::*field, std::string_view oper,
+                    const V &value) {
+  return count(get_column(rows, field), oper, value);
+}
+
+template <typename Rows, typename T, typename U>
+inline sum_t<U> sum(const Rows &rows, U T::*field) {
+  return sum(get_column(rows, field));
+}
+
+template <typename Rows, typename T, typename U>
+inline U min(const Rows &rows, U T::*field) {
+  return min(get_column(rows, field));
+}
+
+template <typename Rows, typename T, typename U>
+inline U max(const Rows &rows, U T::*field) {
+  return max(get_column(rows, field));
+}
+}  // namespace ormpp
+
+#endif  // ORMPP_COLUMN_OPS_HPP
@@ -0,0 +1,160 @@
+#ifndef ORMPP_COLUMNS_HPP
+#define ORMPP_COLUMNS_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "utility.hpp"
+
+namespace ormpp {
+// the strings of a column in one buffer, the i-th string is
+// bytes()[offsets()[i], offsets()[i + 1])
+class string_column {
+ public:
+  string_column() : offsets_{0} {}
+
+  size_t size() const { return offsets_.size() - 1; }
+
+  bool empty() const { return size() == 0; }
+
+  std::string_view operator[](size_t i) const {
+    return std::string_view(bytes_.data() + offsets_[i],
+                            offsets_[i + 1] - offsets_[i]);
+  }
+
+  void push_back(std::string_view str) {
+    bytes_.insert(bytes_.end(), str.begin(), str.end());
+    offsets_.push_back(bytes_.size());
+  }
+
+  void reserve(size_t rows, size_t bytes = 0) {
+    offsets_.reserve(rows + 1);
+    bytes_.reserve(bytes);
+  }
+
+  void clear() {
+    offsets_.assign(1, 0);
+    bytes_.clear();
+  }
+
+  const std::vector<uint64_t> &offsets() const { return offsets_; }
+
+  const std::vector<char> &bytes() const { return bytes_; }
+
+ private:
+  std::vector<uint64_t> offsets_;
+  std::vector<char> bytes_;
+};
+
+// the strings and the char arrays are stored in a string_column, the other
+// fields in a vector of their type
+template <typename U>
+struct column_type {
+  using type = std::vector<U>;
+};
+
+template <>
+struct column_type<std::string> {
+  using type = string_column;
+};
+
+#ifdef ORMPP_HAS_PMR
+template <>
+struct column_type<std::pmr::string> {
+  using type = string_column;
+};
+#endif
+
+template <size_t N>
+struct column_type<char[N]> {
+  using type = string_column;
+};
+
+template <typename U>
+using column_t = typename column_type<U>::type;
+
+template <typename Members>
+struct columns_tuple;
+
+template <typename... Members>
+struct columns_tuple<std::tuple<Members...>> {
+  using type =
+      std::tuple<column_t<typename field_attribute<Members>::return_type>...>;
+};
+
+// the rows of T stored by column, one contiguous column per reflected field,
+// such as:
+// auto cols = conn.query_columns<person>("where age > 20");
+// auto &ages = cols.column(&person::age); // std::vector<int>
+// auto &names = cols.column(&person::name); // string_column
+template <typename T>
+class columns {
+ public:
+  using members_type = decltype(get_members<T>());
+  using tuple_type = typename columns_tuple<members_type>::type;
+
+  // the number of rows
+  size_t size() const { return size_; }
+
+  bool empty() const { return size_ == 0; }
+
+  // the column of the I-th reflected field
+  template <size_t I>
+  auto &get() {
+    return std::get<I>(columns_);
+  }
+
+  template <size_t I>
+  const auto &get() const {
+    return std::get<I>(columns_);
+  }
+
+  template <typename U>
+  column_t<U> &column(U T::*member) {
+    column_t<U> *result = nullptr;
+    iguana::for_each(get_members<T>(), [this, member, &result](auto item,
+                                                               auto i) {
+      if constexpr (std::is_same_v<decltype(item), U T::*>) {
+        if (item == member)
+          result = &std::get<decltype(i)::value>(columns_);
+      }
+    });
+    return *result;
+  }
+
+  template <typename U>
+  const column_t<U> &column(U T::*member) const {
+    return const_cast<columns *>(this)->column(member);
+  }
+
+  void reserve(size_t rows) {
+    std::apply(
+        [rows](auto &...column) {
+          (column.reserve(rows), ...);
+        },
+        columns_);
+  }
+
+  void clear() {
+    std::apply(
+        [](auto &...column) {
+          (column.clear(), ...);
+        },
+        columns_);
+    size_ = 0;
+  }
+
+  // called by the backends after the fields of a row are appended
+  void add_row() { ++size_; }
+
+ private:
+  tuple_type columns_;
+  size_t size_ = 0;
+};
+}  // namespace ormpp
+
+#endif  // ORMPP_COLUMNS_HPP
@@ -8,6 +8,7 @@
 #include <chrono>
 #include <condition_variable>
 #include <deque>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -22,6 +23,12 @@ class connection_pool {
     return instance;
   }
 
+  // a pool besides the instance, such as a pool per shard of a database
+  connection_pool() = default;
+  ~connection_pool() = default;
+  connection_pool(const connection_pool &) = delete;
+  connection_pool &operator=(const connection_pool &) = delete;
+
   // call_once
   template <typename... Args>
   void init(int maxsize, Args &&...args) {
@@ -74,11 +81,19 @@ class connection_pool {
  private:
   template <typename... Args>
   void init_impl(int maxsize, Args &&...args) {
-    args_ = std::make_tuple(std::forward<Args>(args)...);
+    // keep copies of the args to reconnect, they are the args of the connect
+    // of any db, such as sqlite which only has a file name
+    connect_ = [stored = std::make_tuple(to_stored(args)...)](DB &conn) {
+      return std::apply(
+          [&conn](const auto &...targs) {
+            return conn.connect(to_arg(targs)...);
+          },
+          stored);
+    };
 
     for (int i = 0; i < maxsize; ++i) {
-      auto conn = std::make_shared<DB>();
-      if (conn->connect(std::forward<Args>(args)...)) {
+      auto conn = create_connection();
+      if (conn) {
         pool_.push_back(conn);
       }
       else {
@@ -87,35 +102,44 @@ class connection_pool {
     }
   }
 
-  auto create_connection() {
+  std::shared_ptr<DB> create_connection() {
     auto conn = std::make_shared<DB>();
-    auto fn = [conn](auto... targs) {
-      return conn->connect(targs...);
-    };
+    return connect_(*conn) ? conn : nullptr;
+  }
 
-    return std::apply(fn, args_) ? conn : nullptr;
+  template <typename T>
+  static auto to_stored(const T &arg) {
+    if constexpr (std::is_convertible_v<const T &, const char *>)
+      return std::string(arg);
+    else
+      return arg;
   }
 
-  connection_pool() = default;
-  ~connection_pool() = default;
-  connection_pool(const connection_pool &) = delete;
-  connection_pool &operator=(const connection_pool &) = delete;
+  template <typename T>
+  static auto to_arg(const T &arg) {
+    if constexpr (std::is_same_v<T, std::string>)
+      return arg.c_str();
+    else
+      return arg;
+  }
 
   std::deque<std::shared_ptr<DB>> pool_;
   std::mutex mutex_;
   std::condition_variable condition_;
   std::once_flag flag_;
-  std::tuple<const char *, const char *, const char *, const char *, int, int>
-      args_;
+  std::function<bool(DB &)> connect_;
 };
 
 template <typename DB>
 struct conn_guard {
-  conn_guard(std::shared_ptr<DB> con) : conn_(con) {}
-  ~conn_guard() { connection_pool<DB>::instance().return_back(conn_.lock()); }
+  conn_guard(std::shared_ptr<DB> con,
+             connection_pool<DB> &pool = connection_pool<DB>::instance())
+      : conn_(con), pool_(pool) {}
+  ~conn_guard() { pool_.return_back(conn_.lock()); }
 
  private:
   std::weak_ptr<DB> conn_;
+  connection_pool<DB> &pool_;
 };
 }  // namespace ormpp
 
@@ -0,0 +1,101 @@
+#ifndef ORMPP_COPY_TABLE_HPP
+#define ORMPP_COPY_TABLE_HPP
+
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "dbng.hpp"
+
+namespace ormpp {
+template <typename K>
+struct copy_stats {
+  size_t rows = 0;
+  size_t batches = 0;
+  double seconds = 0;
+  // the key of the last row written, pass it as resume_after to go on after a
+  // failed copy
+  std::optional<K> last_key;
+  // false if a row can't be read or written
+  bool ok = false;
+
+  double rows_per_second() const { return seconds > 0 ? rows / seconds : 0; }
+};
+
+template <typename T, typename K>
+struct copy_options {
+  size_t batch_size = 1000;
+  // the batches read ahead of the writes
+  size_t max_batches = 4;
+  // copy the rows after the key
+  std::optional<K> resume_after;
+  // write by bulk_insert, otherwise by insert
+  bool bulk = true;
+  // called on each batch before it is written
+  std::function<void(std::vector<T> &)> transform;
+  // called after each batch is written
+  std::function<void(const copy_stats<K> &)> on_progress;
+};
+
+// copy the rows of T from src to dst in the order of the key, the rows are
+// read by a thread of query_stream while the calling thread writes the
+// previous batches, so only max_batches batches are in memory, such as:
+// auto stats = copy_table(sqlite, postgres, &person::id);
+// if (!stats.ok)
+//   copy_table(sqlite, postgres, &person::id, {1000, 4, stats.last_key});
+// src and dst must not be used by others until it returns
+template <typename Src, typename Dst, typename T, typename K>
+inline copy_stats<K> copy_table(dbng<Src> &src, dbng<Dst> &dst, K T::*key,
+                                const copy_options<T, K> &options = {}) {
+  static_assert(std::is_integral_v<K>, "the key should be an integer");
+  auto start = std::chrono::steady_clock::now();
+  auto elapsed = [&start] {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+  };
+
+  std::string field(get_member_name(key));
+  std::string condition = "1=1";
+  if (options.resume_after)
+    condition = field + " > " + std::to_string(*options.resume_after);
+  condition += " order by " + field;
+
+  copy_stats<K> stats;
+  stats.last_key = options.resume_after;
+  auto stream = src.template query_stream<T>(options.batch_size,
+                                             options.max_batches, condition);
+  std::vector<T> batch;
+  while (stream.next(batch)) {
+    // the key of the source row, the transform may change the row
+    K last = batch.back().*key;
+    if (options.transform)
+      options.transform(batch);
+
+    // the transform may drop all the rows of the batch
+    if (!batch.empty()) {
+      int r = options.bulk ? dst.bulk_insert(batch) : dst.insert(batch);
+      if (r < 0) {
+        stats.seconds = elapsed();
+        return stats;
+      }
+    }
+
+    stats.rows += batch.size();
+    ++stats.batches;
+    stats.last_key = last;
+    stats.seconds = elapsed();
+    if (options.on_progress)
+      options.on_progress(stats);
+  }
+
+  stats.ok = stream.ok();
+  stats.seconds = elapsed();
+  return stats;
+}
+}  // namespace ormpp
+
+#endif  // ORMPP_COPY_TABLE_HPP
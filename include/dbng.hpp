@@ -5,15 +5,47 @@
 #ifndef ORM_DBNG_HPP
 #define ORM_DBNG_HPP
 
+#include <algorithm>
+#include <cctype>
 #include <chrono>
+#include <climits>
 #include <functional>
+#include <map>
+#include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <typeinfo>
+#include <utility>
 #include <vector>
 
+#include "columns.hpp"
+#include "entity_cache.hpp"
+#include "query_cache.hpp"
+#include "row_stream.hpp"
+#include "row_view.hpp"
+#include "singleflight.hpp"
 #include "utility.hpp"
 
 namespace ormpp {
+template <typename T, typename K>
+struct page_result {
+  std::vector<T> rows;
+  // the key of the last row, pass it as the after_key of the next page, it is
+  // empty if there are no more rows
+  std::optional<K> next_key;
+};
+
+// the rows of a chunk of keys, see dbng::table_checksum
+struct checksum_chunk {
+  // the keys of the chunk are in [begin, end]
+  int64_t begin;
+  int64_t end;
+  uint64_t rows;
+  // the sum of the hashes of the rows, it doesn't depend on their order
+  uint64_t hash;
+};
+
 template <typename DB>
 class dbng {
  public:
@@ -23,6 +55,7 @@ class dbng {
 
   template <typename... Args>
   bool connect(Args &&...args) {
+    database_ = get_database_id(DB::db_type, args...);
     return db_.connect(std::forward<Args>(args)...);
   }
 
@@ -35,28 +68,177 @@ class dbng {
 
   template <typename T, typename... Args>
   int insert(const T &t, Args &&...args) {
-    return db_.insert(t, std::forward<Args>(args)...);
+    auto r = db_.insert(t, std::forward<Args>(args)...);
+    invalidate(t);
+    return r;
   }
 
   template <typename T, typename... Args>
   int insert(const std::vector<T> &t, Args &&...args) {
-    return db_.insert(t, std::forward<Args>(args)...);
+    auto r = db_.insert(t, std::forward<Args>(args)...);
+    invalidate(t);
+    return r;
+  }
+
+  // insert and return the generated auto increment key, 0 if failed
+  template <typename T>
+  uint64_t get_insert_id_after_insert(const T &t) {
+    return db_.get_insert_id_after_insert(t);
+  }
+
+  // the generated keys of the rows in order, empty if failed
+  template <typename T>
+  std::vector<uint64_t> get_insert_id_after_insert(const std::vector<T> &v) {
+    return db_.get_insert_id_after_insert(v);
+  }
+
+  // insert t and write the generated key back to its auto key field, it
+  // returns false without inserting if T has no auto key
+  template <typename T>
+  bool insert_and_set_key(T &t) {
+    auto auto_key = db_.template get_auto_key<T>();
+    if (auto_key.empty())
+      return false;
+
+    auto id = db_.get_insert_id_after_insert(t);
+    if (id == 0)
+      return false;
+
+    set_field_value(t, auto_key, id);
+    invalidate(t);
+    return true;
+  }
+
+  template <typename T>
+  bool insert_and_set_keys(std::vector<T> &v) {
+    auto auto_key = db_.template get_auto_key<T>();
+    if (auto_key.empty())
+      return false;
+
+    auto ids = db_.get_insert_id_after_insert(v);
+    if (ids.size() != v.size())
+      return false;
+
+    for (size_t i = 0; i < v.size(); ++i) {
+      set_field_value(v[i], auto_key, ids[i]);
+    }
+    invalidate(v);
+    return true;
+  }
+
+  // insert the rows with multi-row statements, all the fields are inserted,
+  // including the auto key
+  template <typename T>
+  int bulk_insert(const std::vector<T> &v) {
+    auto r = db_.bulk_insert(v);
+    invalidate(v);
+    return r;
+  }
+
+  // assign the keys of the rows from a key_allocator locally, then insert
+  // them with bulk_insert
+  template <typename T, typename Allocator>
+  int insert_with_keys(std::vector<T> &v, Allocator &allocator) {
+    if (!allocator.assign(v))
+      return INT_MIN;
+
+    return bulk_insert(v);
+  }
+
+  // reserve count keys of the auto key field, the keys are the ranges
+  // [first, last) in ascending order, empty if failed; postgresql takes them
+  // from the serial sequence, mysql and sqlite bump the hi-lo row of the
+  // table in ormpp_key_blocks, so all the keys of the table should be
+  // allocated by this
+  template <typename T, typename K>
+  std::vector<std::pair<uint64_t, uint64_t>> reserve_keys(K T::*key,
+                                                          size_t count) {
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    if (count == 0)
+      return ranges;
+
+    std::string name(iguana::get_name<T>());
+    std::string field(get_member_name(key));
+    if constexpr (DB::db_type == DBType::postgresql) {
+      auto v = db_.template query<std::tuple<int64_t>>(
+          "select nextval(pg_get_serial_sequence('" + name + "', '" + field +
+          "')) from generate_series(1, " + std::to_string(count) + ")");
+      if (v.size() != count)
+        return {};
+
+      // the sequence may be shared with other sessions, merge the
+      // consecutive keys
+      for (auto &[id] : v) {
+        if (!ranges.empty() && ranges.back().second == (uint64_t)id)
+          ++ranges.back().second;
+        else
+          ranges.emplace_back(id, id + 1);
+      }
+      return ranges;
+    }
+    else {
+      auto next_key = reserve_hilo_block(name, get_name<T>(), field, count);
+      if (next_key <= 0)
+        return {};
+
+      ranges.emplace_back(next_key - count, next_key);
+      return ranges;
+    }
   }
 
   template <typename T, typename... Args>
   int update(const T &t, Args &&...args) {
-    return db_.update(t, std::forward<Args>(args)...);
+    auto r = db_.update(t, std::forward<Args>(args)...);
+    invalidate(t);
+    return r;
   }
 
   template <typename T, typename... Args>
   int update(const std::vector<T> &t, Args &&...args) {
-    return db_.update(t, std::forward<Args>(args)...);
+    auto r = db_.update(t, std::forward<Args>(args)...);
+    invalidate(t);
+    return r;
+  }
+
+  // insert or update by the key in one statement, the members limit the
+  // updated fields
+  template <typename T, typename... Members>
+  int upsert(const T &t, Members T::*...members) {
+    auto r = db_.upsert(t, members...);
+    invalidate(t);
+    return r;
+  }
+
+  template <typename T, typename... Members>
+  int upsert(const std::vector<T> &v, Members T::*...members) {
+    auto r = db_.upsert(v, members...);
+    invalidate(v);
+    return r;
+  }
+
+  // update the rows by the key with set-based statements, the members limit
+  // the updated fields
+  template <typename T, typename... Members>
+  int bulk_update(const std::vector<T> &v, Members T::*...members) {
+    auto r = db_.bulk_update(v, members...);
+    invalidate(v);
+    return r;
+  }
+
+  // update the given fields of the row with the same key as t
+  template <typename T, typename... Members>
+  int update_fields(const T &t, Members T::*...members) {
+    auto r = db_.update_fields(t, members...);
+    invalidate(t);
+    return r;
   }
 
   template <typename T, typename... Args>
   bool delete_records(Args &&...where_conditon) {
-    return db_.template delete_records<T>(
+    auto r = db_.template delete_records<T>(
         std::forward<Args>(where_conditon)...);
+    invalidate_all<T>();
+    return r;
   }
 
   // restriction, all the args are string, the first is the where condition,
@@ -66,6 +248,71 @@ class dbng {
     return db_.template query<T>(std::forward<Args>(args)...);
   }
 
+#ifdef ORMPP_HAS_PMR
+  // the rows and their std::pmr::string fields are allocated from mr, so
+  // decoding a large result is a few allocations from an arena, such as:
+  // std::pmr::monotonic_buffer_resource arena;
+  // auto v = query<pmr_person>(&arena, "age > 10");
+  template <typename T, typename Resource, typename... Args>
+  std::enable_if_t<std::is_base_of_v<std::pmr::memory_resource, Resource>,
+                   std::pmr::vector<T>>
+  query(Resource *mr, Args &&...args) {
+    return db_.template query<T>(mr, std::forward<Args>(args)...);
+  }
+#endif
+
+  // as query, but the rows are stored by column, see columns.hpp, such as:
+  // query_columns<person>("age > 10")
+  template <typename T, typename... Args>
+  columns<T> query_columns(Args &&...args) {
+    return db_.template query_columns<T>(std::forward<Args>(args)...);
+  }
+
+  // call func(row) with a zero copy row_view<T> of each row, see row_view.hpp,
+  // such as: for_each_row<person>(func, "age > 10")
+  template <typename T, typename Func, typename... Args>
+  bool for_each_row(Func &&func, Args &&...args) {
+    return db_.template for_each_row<T>(std::forward<Func>(func),
+                                        std::forward<Args>(args)...);
+  }
+
+  // call func(std::vector<T> &&batch) with the rows by batches, mysql and
+  // postgresql read them by a cursor, such as:
+  // for_each_batch<person>(1000, func, "age > 10")
+  template <typename T, typename Func, typename... Args>
+  bool for_each_batch(size_t batch_size, Func &&func, Args &&...args) {
+    return db_.template for_each_batch<T>(batch_size, std::forward<Func>(func),
+                                          std::forward<Args>(args)...);
+  }
+
+  // as for_each_batch, but the batches are fetched by a thread while the
+  // caller processes the previous ones, see row_stream.hpp; the connection
+  // must not be used until the stream is destroyed, such as:
+  // auto stream = query_stream<person>(1000, 2, "age > 10")
+  template <typename T, typename... Args>
+  row_stream<T> query_stream(size_t batch_size, size_t max_batches,
+                             Args &&...args) {
+    static_assert(!is_selection_args<Args...>::value,
+                  "all the fields are fetched by query_stream");
+    return row_stream<T>(
+        max_batches,
+        [this, batch_size,
+         conditions = std::make_tuple(std::string(args)...)](auto push) {
+          return std::apply(
+              [this, batch_size, &push](const auto &...condition) {
+                return db_.template for_each_batch<T>(batch_size, push,
+                                                      condition...);
+              },
+              conditions);
+        });
+  }
+
+  // postgresql only, decode the large results by threads in parallel, such as:
+  // set_parallel_decode(100000)
+  void set_parallel_decode(size_t threshold, size_t threads = 0) {
+    db_.set_parallel_decode(threshold, threads);
+  }
+
   // support member variable, such as: query(FID(simple::id), "<", 5)
   template <typename Pair, typename U>
   auto query(Pair pair, std::string_view oper, U &&val) {
@@ -74,6 +321,185 @@ class dbng {
     return query<T>(sql);
   }
 
+  // aggregates are computed by the database, the where conditions are the same
+  // as query, such as: count<person>("age > 10")
+  template <typename T, typename... Args>
+  size_t count(Args &&...where_condition) {
+    auto v = db_.template query<std::tuple<int64_t>>(generate_select_sql<T>(
+        "count(1)", std::forward<Args>(where_condition)...));
+    return v.empty() ? 0 : (size_t)std::get<0>(v[0]);
+  }
+
+  template <typename T, typename... Args>
+  bool exists(Args &&...where_condition) {
+    auto v = db_.template query<std::tuple<int>>(generate_select_sql<T>(
+        "1", std::forward<Args>(where_condition)..., "limit 1"));
+    return !v.empty();
+  }
+
+  // sum, min, max and avg are 0 if there are no rows
+  template <typename T, typename U, typename... Args>
+  auto sum(U T::*field, Args &&...where_condition) {
+    static_assert(std::is_arithmetic_v<U>, "sum needs an arithmetic field");
+    using R = std::conditional_t<std::is_floating_point_v<U>, double, int64_t>;
+    return aggregate<R, T>("sum", field,
+                           std::forward<Args>(where_condition)...);
+  }
+
+  template <typename T, typename U, typename... Args>
+  U min(U T::*field, Args &&...where_condition) {
+    return aggregate<U, T>("min", field,
+                           std::forward<Args>(where_condition)...);
+  }
+
+  template <typename T, typename U, typename... Args>
+  U max(U T::*field, Args &&...where_condition) {
+    return aggregate<U, T>("max", field,
+                           std::forward<Args>(where_condition)...);
+  }
+
+  template <typename T, typename U, typename... Args>
+  double avg(U T::*field, Args &&...where_condition) {
+    static_assert(std::is_arithmetic_v<U>, "avg needs an arithmetic field");
+    return aggregate<double, T>("avg", field,
+                                std::forward<Args>(where_condition)...);
+  }
+
+  // the key columns followed by the aggregate expressions are decoded into the
+  // fields of R in order, such as:
+  // group_by<age_count>(select(&student::age), "count(1)", "age > 10")
+  template <typename R, typename T, typename... Members, typename... Args>
+  std::vector<R> group_by(const selection<T, Members...> &keys,
+                          const std::string &aggregates,
+                          Args &&...where_condition) {
+    static_assert(iguana::is_reflection_v<R>);
+    auto fields = get_fields(keys);
+    auto sql = generate_select_sql<T>(fields + ", " + aggregates,
+                                      std::forward<Args>(where_condition)...);
+    // the group by goes before the order by or limit of the conditions
+    sql.insert(get_conditions_end(sql), " group by " + fields + " ");
+    auto v = db_.template query<std::tuple<R>>(sql);
+
+    std::vector<R> result;
+    result.reserve(v.size());
+    for (auto &tp : v) {
+      result.push_back(std::move(std::get<0>(tp)));
+    }
+    return result;
+  }
+
+  // keyset pagination, the rows after after_key ordered by the key, such as:
+  // query_page(&person::id, std::nullopt, 100, "age > 10")
+  template <typename T, typename K, typename... Args>
+  page_result<T, K> query_page(K T::*key,
+                               const std::optional<std::decay_t<K>> &after_key,
+                               size_t page_size, Args &&...where_condition) {
+    std::optional<std::tuple<K>> after;
+    if (after_key)
+      after = std::make_tuple(*after_key);
+
+    auto page = query_page_impl<T>(std::make_tuple(key), after, page_size,
+                                   std::forward<Args>(where_condition)...);
+    page_result<T, K> result{std::move(page.rows), {}};
+    if (page.next_key)
+      result.next_key = std::get<0>(*page.next_key);
+    return result;
+  }
+
+  // composite keys are compared as a row value, such as:
+  // query_page(select(&T::a, &T::b), std::make_tuple(1, "x"s), 100)
+  template <typename T, typename... Members, typename... Args>
+  page_result<T, std::tuple<Members...>> query_page(
+      const selection<T, Members...> &keys,
+      const std::optional<std::tuple<std::decay_t<Members>...>> &after_key,
+      size_t page_size, Args &&...where_condition) {
+    return query_page_impl<T>(keys.members, after_key, page_size,
+                              std::forward<Args>(where_condition)...);
+  }
+
+  // the row count and hash of each chunk of chunk_size keys computed by the
+  // database, the chunks without rows are skipped, such as:
+  // table_checksum(&person::id, 10000)
+  // it is empty and has_error() is true if the query fails
+  template <typename T, typename K>
+  std::vector<checksum_chunk> table_checksum(K T::*key, uint64_t chunk_size) {
+    auto chunks = checksum_chunks(key, (std::max)(chunk_size, uint64_t(1)),
+                                  std::nullopt);
+    if (!chunks)
+      return {};
+    return std::move(*chunks);
+  }
+
+  // the keys of the rows which differ from the rows of other, such as another
+  // replica or a copy of the table; the checksums of the mismatching chunks
+  // are narrowed by split_factor until chunks of leaf_size keys, whose row
+  // hashes are compared, so only the hashes of the different parts are read;
+  // the hashes of different backends differ, so both should be DB; it is
+  // empty if a query of this or other fails, see their has_error()
+  template <typename T, typename K>
+  std::optional<std::vector<std::decay_t<K>>> table_diff(
+      K T::*key, dbng &other, uint64_t chunk_size, uint64_t split_factor = 16,
+      uint64_t leaf_size = 64) {
+    static_assert(std::is_integral_v<K>, "the key should be an integer");
+    std::vector<std::decay_t<K>> keys;
+    if (!diff_chunks(key, other, (std::max)(chunk_size, uint64_t(1)),
+                     (std::max)(split_factor, uint64_t(2)),
+                     (std::max)(leaf_size, uint64_t(1)), std::nullopt, keys))
+      return std::nullopt;
+    std::sort(keys.begin(), keys.end());
+    return keys;
+  }
+
+  // the rows with the keys in the order of the keys, the row of a missing key
+  // is empty, such as: get_by_keys(&person::id, {1, 2, 3})
+  template <typename T, typename K>
+  std::vector<std::optional<T>> get_by_keys(
+      K T::*key, const std::vector<std::decay_t<K>> &keys) {
+    std::map<std::decay_t<K>, std::optional<T>> rows;
+    for (auto &k : keys) {
+      rows.emplace(k, std::nullopt);
+    }
+
+    auto fields = std::string(iguana::get_fields<T>());
+    for_each_keys_chunk(key, rows, [&, this](auto &chunk, auto &condition) {
+      auto v = db_.template query<std::tuple<T>>(
+          generate_select_sql<T>(fields, condition), chunk);
+      for (auto &tp : v) {
+        auto &t = std::get<0>(tp);
+        auto it = rows.find(t.*key);
+        if (it != rows.end())
+          it->second = std::move(t);
+      }
+      // has_error tells the caller that the rows aren't complete
+      return !db_.has_error();
+    });
+
+    std::vector<std::optional<T>> result;
+    result.reserve(keys.size());
+    for (auto &k : keys) {
+      result.push_back(rows[k]);
+    }
+    return result;
+  }
+
+  // delete the rows with the keys, one statement per chunk of keys
+  template <typename T, typename K>
+  bool delete_by_keys(K T::*key, const std::vector<std::decay_t<K>> &keys) {
+    std::map<std::decay_t<K>, bool> unique_keys;
+    for (auto &k : keys) {
+      unique_keys.emplace(k, true);
+    }
+
+    auto name = get_name<T>();
+    auto r = for_each_keys_chunk(
+        key, unique_keys, [&, this](auto &chunk, auto &condition) {
+          return db_.execute("delete from " + name + " where " + condition,
+                             chunk);
+        });
+    invalidate_keys(key, unique_keys);
+    return r;
+  }
+
   template <typename Pair, typename U>
   bool delete_records(Pair pair, std::string_view oper, U &&val) {
     auto sql = build_condition(pair, oper, std::forward<U>(val));
@@ -81,14 +507,111 @@ class dbng {
     return delete_records<T>(sql);
   }
 
-  bool execute(const std::string &sql) { return db_.execute(sql); }
+  // the args are bound to the placeholders of sql as statement parameters
+  template <typename... Args>
+  bool execute(const std::string &sql, Args &&...args) {
+    auto r = db_.execute(sql, std::forward<Args>(args)...);
+    for (auto &table : get_sql_tables(sql)) {
+      invalidate_table(table);
+    }
+    return r;
+  }
+
+  // the row of T with the key, it is served from the entity cache of T which
+  // is opted in by ORMPP_ENTITY_CACHE, such as: get<person>(1)
+  template <typename T>
+  std::optional<T> get(const entity_cache_key_t<T> &key) {
+    auto &cache = get_entity_cache<T, DB>(database_);
+    if (auto row = cache.get(key))
+      return row;
+
+    auto version = cache.version(key);
+    auto rows = get_by_keys(get_entity_cache_config<T>().key, {key});
+    if (rows.empty() || !rows[0])
+      return {};
+
+    // the rows read in a transaction may be rolled back
+    if (transaction_depth_ == 0)
+      cache.put(key, *rows[0], version);
+    return rows[0];
+  }
+
+  template <typename T>
+  cache_stats get_cache_stats() {
+    return get_entity_cache<T, DB>(database_).stats();
+  }
+
+  // the rows are cached by the statement and the params until a table the
+  // statement reads is written through ormpp, the args are the same as query,
+  // such as: query_cached<std::tuple<int>>("select count(1) from person")
+  template <typename T, typename... Args>
+  std::shared_ptr<const std::vector<T>> query_cached(Args &&...args) {
+    auto &cache = get_query_cache<DB>();
+    std::vector<std::string> tables;
+    auto key = make_query_key<T>(tables, args...);
+    if (auto rows = cache.template get<T>(key))
+      return rows;
+
+    auto versions = cache.versions(tables);
+    return query_shared_impl<T>(key, [&] {
+      auto rows = std::make_shared<const std::vector<T>>(
+          db_.template query<T>(std::forward<Args>(args)...));
+      // the rows read in a transaction may be rolled back
+      if (transaction_depth_ == 0 && !db_.has_error())
+        cache.put(key, rows, tables, versions);
+      return rows;
+    });
+  }
+
+  // the identical queries of the connections of DB to the same database
+  // running at the same time are executed once and the callers share the
+  // rows, the args are the same as query, such as:
+  // query_shared<person>("age > 10")
+  template <typename T, typename... Args>
+  std::shared_ptr<const std::vector<T>> query_shared(Args &&...args) {
+    std::vector<std::string> tables;
+    auto key = make_query_key<T>(tables, args...);
+    return query_shared_impl<T>(key, [&] {
+      return std::make_shared<const std::vector<T>>(
+          db_.template query<T>(std::forward<Args>(args)...));
+    });
+  }
 
-  // transaction
-  bool begin() { return db_.begin(); }
+  singleflight_stats get_singleflight_stats() {
+    return get_singleflight<DB>().stats();
+  }
+
+  // the query cache is shared by the connections of DB
+  void configure_query_cache(size_t max_bytes,
+                             std::chrono::milliseconds ttl) {
+    get_query_cache<DB>().configure(max_bytes, ttl);
+  }
 
-  bool commit() { return db_.commit(); }
+  query_cache_stats get_query_cache_stats() {
+    return get_query_cache<DB>().stats();
+  }
+
+  // transaction, the entity caches are invalidated again when the outermost
+  // transaction ends, other connections may cache the rows before it commits
+  bool begin() {
+    if (!db_.begin())
+      return false;
+
+    ++transaction_depth_;
+    return true;
+  }
+
+  bool commit() {
+    auto r = db_.commit();
+    end_transaction();
+    return r;
+  }
 
-  bool rollback() { return db_.rollback(); }
+  bool rollback() {
+    auto r = db_.rollback();
+    end_transaction();
+    return r;
+  }
 
   bool ping() { return db_.ping(); }
 
@@ -99,6 +622,424 @@ class dbng {
   int get_last_affect_rows() { return db_.get_last_affect_rows(); }
 
  private:
+  // the key of a query is the database, the result type, the statement and
+  // the params, the tables are the tables of the database the statement reads
+  template <typename T, typename... Args>
+  std::string make_query_key(std::vector<std::string> &tables,
+                             const Args &...args) {
+    std::string key = database_ + typeid(T).name();
+    if constexpr (iguana::is_reflection_v<T>) {
+      // all the args are the conditions
+      (append_query_sql(key, args), ...);
+      tables.push_back(get_table_name<T>());
+      auto add_tables = [&tables](std::string_view condition) {
+        for (auto &table : get_sql_tables(condition)) {
+          if (std::find(tables.begin(), tables.end(), table) == tables.end())
+            tables.push_back(table);
+        }
+      };
+      (add_tables(args), ...);
+    }
+    else {
+      // the statement followed by the params
+      auto add_args = [&key, &tables](const auto &sql, const auto &...params) {
+        append_query_sql(key, sql);
+        (append_query_key(key, params), ...);
+        tables = get_sql_tables(sql);
+      };
+      add_args(args...);
+    }
+    for (auto &table : tables) {
+      table.insert(0, database_);
+    }
+    return key;
+  }
+
+  // a connection in a transaction may read its own writes, so it doesn't
+  // share the rows
+  template <typename T, typename Func>
+  std::shared_ptr<const std::vector<T>> query_shared_impl(
+      const std::string &key, Func &&func) {
+    if (transaction_depth_ > 0)
+      return func();
+
+    return get_singleflight<DB>().template run<std::vector<T>>(
+        key, std::forward<Func>(func));
+  }
+
+  template <typename T>
+  void invalidate(const T &t) {
+    if constexpr (has_entity_cache_v<T>) {
+      invalidate_key<T>(t.*(get_entity_cache_config<T>().key));
+    }
+    invalidate_table(get_table_name<T>());
+  }
+
+  template <typename T, typename K>
+  void invalidate_key(const K &key) {
+    auto &cache = get_entity_cache<T, DB>(database_);
+    cache.erase(key);
+    if (transaction_depth_ > 0) {
+      after_transaction_.push_back([&cache, key] { cache.erase(key); });
+    }
+  }
+
+  template <typename T>
+  void invalidate(const std::vector<T> &v) {
+    if constexpr (has_entity_cache_v<T>) {
+      for (auto &t : v) {
+        invalidate_key<T>(t.*(get_entity_cache_config<T>().key));
+      }
+    }
+    invalidate_table(get_table_name<T>());
+  }
+
+  template <typename T>
+  void invalidate_all() {
+    if constexpr (has_entity_cache_v<T>) {
+      auto &cache = get_entity_cache<T, DB>(database_);
+      cache.clear();
+      if (transaction_depth_ > 0) {
+        after_transaction_.push_back([&cache] { cache.clear(); });
+      }
+    }
+    invalidate_table(get_table_name<T>());
+  }
+
+  // evict the cached queries which read the table of the database
+  void invalidate_table(const std::string &name) {
+    auto table = database_ + name;
+    get_query_cache<DB>().invalidate(table);
+    if (transaction_depth_ > 0) {
+      after_transaction_.push_back([table] {
+        get_query_cache<DB>().invalidate(table);
+      });
+    }
+  }
+
+  // the lower case table name, the same as the names of get_sql_tables
+  template <typename T>
+  static std::string get_table_name() {
+    std::string name(iguana::get_name<T>());
+    for (auto &c : name) {
+      c = (char)std::tolower((unsigned char)c);
+    }
+    return name;
+  }
+
+  // the position of the order by or limit after the where conditions of sql,
+  // it is the size of sql if there is neither
+  static size_t get_conditions_end(const std::string &sql) {
+    std::string lower(sql);
+    for (auto &c : lower) {
+      c = (char)std::tolower((unsigned char)c);
+    }
+    size_t pos = sql.size();
+    for (const char *clause : {" order by ", " limit "}) {
+      pos = (std::min)(pos, lower.find(clause));
+    }
+    return pos;
+  }
+
+  // the keys are erased if key is the key of the entity cache, otherwise the
+  // entity cache is cleared
+  template <typename T, typename K, typename Map>
+  void invalidate_keys(K T::*key, const Map &keys) {
+    if constexpr (has_entity_cache_v<T>) {
+      auto cache_key = get_entity_cache_config<T>().key;
+      if constexpr (std::is_same_v<decltype(cache_key), K T::*>) {
+        if (cache_key == key) {
+          for (auto &item : keys) {
+            invalidate_key<T>(item.first);
+          }
+          invalidate_table(get_table_name<T>());
+          return;
+        }
+      }
+    }
+    invalidate_all<T>();
+  }
+
+  void end_transaction() {
+    if (transaction_depth_ == 0 || --transaction_depth_ > 0)
+      return;
+
+    auto callbacks = std::move(after_transaction_);
+    after_transaction_.clear();
+    for (auto &callback : callbacks) {
+      callback();
+    }
+  }
+
+  // bump the next key of the table by count in a transaction, the row starts
+  // after the max key of the table; returns the new next key, 0 if failed
+  int64_t reserve_hilo_block(const std::string &name, const std::string &table,
+                             const std::string &field, size_t count) {
+    if (!db_.execute(
+            "create table if not exists ormpp_key_blocks(name varchar(128) "
+            "primary key, next_key bigint not null)"))
+      return 0;
+
+    std::string ignore = DB::db_type == DBType::sqlite ? "insert or ignore"
+                                                        : "insert ignore";
+    if (!db_.execute(ignore + " into ormpp_key_blocks(name, next_key) select " +
+                         "?, coalesce(max(" + field + "), 0) + 1 from " + table,
+                     name))
+      return 0;
+
+    if (!db_.begin())
+      return 0;
+
+    if (!db_.execute("update ormpp_key_blocks set next_key = next_key + ? "
+                     "where name = ?",
+                     (int64_t)count, name)) {
+      db_.rollback();
+      return 0;
+    }
+
+    auto v = db_.template query<std::tuple<int64_t>>(
+        "select next_key from ormpp_key_blocks where name = ?", name);
+    if (v.empty() || !db_.commit()) {
+      db_.rollback();
+      return 0;
+    }
+
+    return std::get<0>(v[0]);
+  }
+
+  template <typename T, typename... Members, typename... Args>
+  page_result<T, std::tuple<Members...>> query_page_impl(
+      const std::tuple<Members T::*...> &keys,
+      const std::optional<std::tuple<Members...>> &after_key,
+      size_t page_size, Args &&...where_condition) {
+    std::string key_fields;
+    std::string placeholders;
+    size_t index = 0;
+    auto add_key = [&](std::string_view name) {
+      if (index > 0) {
+        key_fields += ", ";
+        placeholders += ", ";
+      }
+      key_fields += name;
+      placeholders += get_placeholder(DB::db_type, ++index);
+    };
+    std::apply(
+        [&add_key](auto... key) {
+          (add_key(get_member_name(key)), ...);
+        },
+        keys);
+
+    std::string sql = "select ";
+    append(sql, iguana::get_fields<T>().data(), "from", get_name<T>());
+    bool has_where = false;
+    if (after_key) {
+      if constexpr (sizeof...(Members) == 1)
+        append(sql, "where", key_fields, ">", placeholders);
+      else
+        append(sql, "where (", key_fields, ") > (", placeholders, ")");
+      has_where = true;
+    }
+    if constexpr (sizeof...(Args) > 0) {
+      append(sql, has_where ? "and (" : "where (",
+             std::forward<Args>(where_condition)..., ")");
+    }
+    append(sql, "order by", key_fields, "limit",
+           get_placeholder(DB::db_type, ++index));
+
+    std::vector<std::tuple<T>> v;
+    if (after_key) {
+      v = std::apply(
+          [this, &sql, page_size](auto &...key) {
+            return db_.template query<std::tuple<T>>(sql, key...,
+                                                     (int64_t)page_size);
+          },
+          *after_key);
+    }
+    else {
+      v = db_.template query<std::tuple<T>>(sql, (int64_t)page_size);
+    }
+
+    page_result<T, std::tuple<Members...>> result;
+    result.rows.reserve(v.size());
+    for (auto &tp : v) {
+      result.rows.push_back(std::move(std::get<0>(tp)));
+    }
+
+    if (page_size > 0 && result.rows.size() == page_size) {
+      auto &last = result.rows.back();
+      result.next_key = std::apply(
+          [&last](auto... key) {
+            return std::make_tuple(last.*key...);
+          },
+          keys);
+    }
+
+    return result;
+  }
+
+  // the chunks of the keys in range, chunk i has the keys whose key / size is
+  // i, so the chunks of two tables are aligned; it is empty if the query fails
+  template <typename T, typename K>
+  std::optional<std::vector<checksum_chunk>> checksum_chunks(
+      K T::*key, uint64_t size,
+      const std::optional<std::pair<int64_t, int64_t>> &range) {
+    static_assert(std::is_integral_v<K>, "the key should be an integer");
+    std::string field(get_member_name(key));
+    std::string chunk = field;
+    chunk.append(DB::db_type == DBType::mysql ? " div " : " / ")
+        .append(std::to_string(size));
+    auto hash_sql = get_rows_hash_sql(DB::db_type, iguana::get_fields<T>());
+    std::string fields = chunk + ", count(1), min(" + field + "), max(" +
+                         field + "), " + hash_sql;
+    std::string condition = "1=1";
+    if (range) {
+      condition = field + " >= " + std::to_string(range->first) + " and " +
+                  field + " <= " + std::to_string(range->second);
+    }
+    auto v = db_.template query<
+        std::tuple<int64_t, int64_t, int64_t, int64_t, int64_t>>(
+        generate_select_sql<T>(fields, condition,
+                               "group by " + chunk + " order by " + chunk));
+    // the chunks of a failed query are empty, they aren't an empty table
+    if (db_.has_error())
+      return std::nullopt;
+
+    std::vector<checksum_chunk> chunks;
+    chunks.reserve(v.size());
+    for (auto &[index, rows, first, last, hash] : v) {
+      // the division truncates, so the chunk 0 also has the negative keys
+      int64_t begin = index > 0 ? index * (int64_t)size
+                                : (index - 1) * (int64_t)size + 1;
+      int64_t end = index < 0 ? index * (int64_t)size
+                              : (index + 1) * (int64_t)size - 1;
+      if (range) {
+        begin = (std::max)(begin, range->first);
+        end = (std::min)(end, range->second);
+      }
+      chunks.push_back(checksum_chunk{begin, end, (uint64_t)rows,
+                                      (uint64_t)hash});
+    }
+    return chunks;
+  }
+
+  // false if a query fails
+  template <typename T, typename K>
+  bool diff_chunks(K T::*key, dbng &other, uint64_t size, uint64_t split_factor,
+                   uint64_t leaf_size,
+                   const std::optional<std::pair<int64_t, int64_t>> &range,
+                   std::vector<std::decay_t<K>> &keys) {
+    auto mine_chunks = checksum_chunks(key, size, range);
+    if (!mine_chunks)
+      return false;
+    auto theirs_chunks = other.checksum_chunks(key, size, range);
+    if (!theirs_chunks)
+      return false;
+    auto &mine = *mine_chunks;
+    auto &theirs = *theirs_chunks;
+
+    // the chunks are ordered by their keys
+    std::vector<std::pair<int64_t, int64_t>> mismatches;
+    size_t i = 0, j = 0;
+    while (i < mine.size() || j < theirs.size()) {
+      if (j == theirs.size() ||
+          (i < mine.size() && mine[i].begin < theirs[j].begin)) {
+        mismatches.emplace_back(mine[i].begin, mine[i].end);
+        ++i;
+      }
+      else if (i == mine.size() || theirs[j].begin < mine[i].begin) {
+        mismatches.emplace_back(theirs[j].begin, theirs[j].end);
+        ++j;
+      }
+      else {
+        if (mine[i].rows != theirs[j].rows || mine[i].hash != theirs[j].hash)
+          mismatches.emplace_back(mine[i].begin, mine[i].end);
+        ++i;
+        ++j;
+      }
+    }
+
+    for (auto &mismatch : mismatches) {
+      bool ok = size > leaf_size
+                    ? diff_chunks(key, other,
+                                  (std::max)(size / split_factor, uint64_t(1)),
+                                  split_factor, leaf_size, mismatch, keys)
+                    : diff_rows(key, other, mismatch, keys);
+      if (!ok)
+        return false;
+    }
+    return true;
+  }
+
+  // compare the row hashes of the keys in range, false if a query fails
+  template <typename T, typename K>
+  bool diff_rows(K T::*key, dbng &other,
+                 const std::pair<int64_t, int64_t> &range,
+                 std::vector<std::decay_t<K>> &keys) {
+    std::string field(get_member_name(key));
+    auto hash_sql = get_row_hash_sql(DB::db_type, iguana::get_fields<T>());
+    std::string fields = field + ", " + hash_sql;
+    std::string condition = field + " >= " + std::to_string(range.first) +
+                            " and " + field + " <= " +
+                            std::to_string(range.second);
+    auto sql = generate_select_sql<T>(fields, condition);
+    auto rows = db_.template query<std::tuple<int64_t, int64_t>>(sql);
+    if (db_.has_error())
+      return false;
+    auto other_rows =
+        other.db_.template query<std::tuple<int64_t, int64_t>>(sql);
+    if (other.db_.has_error())
+      return false;
+
+    std::map<int64_t, int64_t> mine;
+    for (auto &[k, hash] : rows) {
+      mine.emplace(k, hash);
+    }
+
+    for (auto &[k, hash] : other_rows) {
+      auto it = mine.find(k);
+      if (it == mine.end()) {
+        keys.push_back((std::decay_t<K>)k);
+        continue;
+      }
+      if (it->second != hash)
+        keys.push_back((std::decay_t<K>)k);
+      mine.erase(it);
+    }
+    for (auto &item : mine) {
+      keys.push_back((std::decay_t<K>)item.first);
+    }
+    return true;
+  }
+
+  // split the keys of the map into chunks bounded by the max parameters of a
+  // statement, func(chunk, condition) gets the condition "key in (?, ...)"
+  template <typename T, typename K, typename Map, typename Func>
+  bool for_each_keys_chunk(K T::*key, const Map &keys, Func &&func) {
+    auto field = std::string(get_member_name(key));
+    std::vector<std::decay_t<K>> chunk;
+    for (auto it = keys.begin(); it != keys.end();) {
+      chunk.clear();
+      for (; it != keys.end() && chunk.size() < max_batch_params; ++it) {
+        chunk.push_back(it->first);
+      }
+
+      auto condition = field + " in (" +
+                       get_placeholders(DB::db_type, 1, chunk.size()) + ")";
+      if (!func(chunk, condition))
+        return false;
+    }
+    return true;
+  }
+
+  template <typename R, typename T, typename U, typename... Args>
+  R aggregate(std::string_view func, U T::*field, Args &&...where_condition) {
+    std::string expr(func);
+    expr.append("(").append(get_member_name(field)).append(")");
+    auto v = db_.template query<std::tuple<R>>(generate_select_sql<T>(
+        expr, std::forward<Args>(where_condition)...));
+    return v.empty() ? R{} : std::get<0>(v[0]);
+  }
+
   template <typename Pair, typename U>
   auto build_condition(Pair pair, std::string_view oper, U &&val) {
     std::string sql = "";
@@ -204,6 +1145,10 @@ class dbng {
 
  private:
   DB db_;
+  // see get_database_id
+  std::string database_;
+  int transaction_depth_ = 0;
+  std::vector<std::function<void()>> after_transaction_;
   std::chrono::system_clock::time_point latest_tm_ =
       std::chrono::system_clock::now();
 };
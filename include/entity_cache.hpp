@@ -0,0 +1,214 @@
+#ifndef ORMPP_ENTITY_CACHE_HPP
+#define ORMPP_ENTITY_CACHE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ormpp {
+struct cache_stats {
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t size = 0;
+};
+
+// a concurrent LRU cache of T keyed by K, the keys are spread over shards
+// which have their own lock; the entries expire after ttl, 0 means never
+template <typename T, typename K>
+class entity_cache {
+ public:
+  entity_cache(size_t capacity, std::chrono::milliseconds ttl,
+               size_t shard_count = 16)
+      : ttl_(ttl), shards_(shard_count == 0 ? 1 : shard_count) {
+    shard_capacity_ = (capacity + shards_.size() - 1) / shards_.size();
+    if (shard_capacity_ == 0)
+      shard_capacity_ = 1;
+  }
+
+  entity_cache(const entity_cache &) = delete;
+  entity_cache &operator=(const entity_cache &) = delete;
+
+  std::optional<T> get(const K &key) {
+    auto &shard = get_shard(key);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+      ++misses_;
+      return {};
+    }
+
+    auto node = it->second;
+    if (ttl_.count() > 0 && std::chrono::steady_clock::now() > node->expire) {
+      shard.index.erase(it);
+      shard.lru.erase(node);
+      ++misses_;
+      return {};
+    }
+
+    shard.lru.splice(shard.lru.begin(), shard.lru, node);
+    ++hits_;
+    return node->value;
+  }
+
+  // the version changes when a key of the shard is invalidated, a value read
+  // from the database is only put if the version is not changed since the read
+  uint64_t version(const K &key) {
+    auto &shard = get_shard(key);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    return shard.version;
+  }
+
+  void put(const K &key, T value, uint64_t version) {
+    auto &shard = get_shard(key);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    if (shard.version != version)
+      return;
+
+    auto expire = std::chrono::steady_clock::now() + ttl_;
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+      it->second->value = std::move(value);
+      it->second->expire = expire;
+      shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+      return;
+    }
+
+    shard.lru.push_front(node_t{key, std::move(value), expire});
+    shard.index.emplace(key, shard.lru.begin());
+    if (shard.lru.size() > shard_capacity_) {
+      shard.index.erase(shard.lru.back().key);
+      shard.lru.pop_back();
+    }
+  }
+
+  void erase(const K &key) {
+    auto &shard = get_shard(key);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    ++shard.version;
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+      shard.lru.erase(it->second);
+      shard.index.erase(it);
+    }
+  }
+
+  void clear() {
+    for (auto &shard : shards_) {
+      std::unique_lock<std::mutex> lock(shard.mutex);
+      ++shard.version;
+      shard.index.clear();
+      shard.lru.clear();
+    }
+  }
+
+  cache_stats stats() {
+    cache_stats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    for (auto &shard : shards_) {
+      std::unique_lock<std::mutex> lock(shard.mutex);
+      stats.size += shard.lru.size();
+    }
+    return stats;
+  }
+
+ private:
+  struct node_t {
+    K key;
+    T value;
+    std::chrono::steady_clock::time_point expire;
+  };
+
+  struct shard_t {
+    std::mutex mutex;
+    std::list<node_t> lru;
+    std::unordered_map<K, typename std::list<node_t>::iterator> index;
+    uint64_t version = 0;
+  };
+
+  shard_t &get_shard(const K &key) {
+    return shards_[std::hash<K>{}(key) % shards_.size()];
+  }
+
+  std::chrono::milliseconds ttl_;
+  size_t shard_capacity_;
+  std::vector<shard_t> shards_;
+  std::atomic<size_t> hits_ = 0;
+  std::atomic<size_t> misses_ = 0;
+};
+
+template <typename T, typename K>
+struct entity_cache_config {
+  K T::*key;
+  size_t capacity;
+  std::chrono::seconds ttl;
+};
+
+template <typename T, typename = void>
+struct has_entity_cache : std::false_type {};
+
+template <typename T>
+struct has_entity_cache<
+    T, std::void_t<decltype(ormpp_entity_cache_config((const T *)nullptr))>>
+    : std::true_type {};
+
+template <typename T>
+inline constexpr bool has_entity_cache_v = has_entity_cache<T>::value;
+
+template <typename T>
+inline auto get_entity_cache_config() {
+  return ormpp_entity_cache_config((const T *)nullptr);
+}
+
+template <typename T>
+using entity_cache_key_t = std::decay_t<decltype(
+    std::declval<T>().*(get_entity_cache_config<T>().key))>;
+
+// the cache of T shared by the connections of DB to the database, the rows
+// of different databases are cached apart; the database is the id of
+// get_database_id, a cache lives until the process exits
+template <typename T, typename DB = void>
+inline auto &get_entity_cache(const std::string &database) {
+  using cache_t = entity_cache<T, entity_cache_key_t<T>>;
+  static std::shared_mutex mutex;
+  static std::unordered_map<std::string, std::unique_ptr<cache_t>> caches;
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = caches.find(database);
+    if (it != caches.end())
+      return *it->second;
+  }
+
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  auto &cache = caches[database];
+  if (cache == nullptr)
+    cache = std::make_unique<cache_t>(get_entity_cache_config<T>().capacity,
+                                      get_entity_cache_config<T>().ttl);
+  return *cache;
+}
+}  // namespace ormpp
+
+// opt T in the entity cache next to REFLECTION, the rows are cached by the key
+// field, at most capacity rows for ttl_seconds, such as:
+// REFLECTION(person, id, name, age)
+// ORMPP_ENTITY_CACHE(person, id, 10000, 60)
+#define ORMPP_ENTITY_CACHE(STRUCT_NAME, KEY, CAPACITY, TTL_SECONDS)      \
+  [[maybe_unused]] inline auto ormpp_entity_cache_config(                \
+      STRUCT_NAME const *) {                                             \
+    using key_type = decltype(STRUCT_NAME::KEY);                         \
+    return ormpp::entity_cache_config<STRUCT_NAME, key_type>{            \
+        &STRUCT_NAME::KEY, CAPACITY, std::chrono::seconds(TTL_SECONDS)}; \
+  }
+
+#endif  // ORMPP_ENTITY_CACHE_HPP
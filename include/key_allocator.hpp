@@ -0,0 +1,111 @@
+#ifndef ORMPP_KEY_ALLOCATOR_HPP
+#define ORMPP_KEY_ALLOCATOR_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "connection_pool.hpp"
+#include "dbng.hpp"
+
+namespace ormpp {
+// hand out the auto keys of T from blocks reserved by dbng::reserve_keys, so
+// the keys of rows are known before they are inserted, such as:
+// key_allocator<dbng<mysql>, person, int> allocator(&person::id);
+// conn.insert_with_keys(v, allocator);
+// the keys are handed out without a lock, a new block is reserved when the
+// current one is used up
+template <typename DB, typename T, typename K>
+class key_allocator {
+ public:
+  // the blocks are reserved by a connection of the pool
+  key_allocator(K T::*key, size_t block_size = 1000,
+                connection_pool<DB> &pool = connection_pool<DB>::instance())
+      : key_(key), block_size_(block_size) {
+    reserve_ = [&pool, key](size_t count) {
+      auto conn = pool.get();
+      if (conn == nullptr)
+        return std::vector<std::pair<uint64_t, uint64_t>>{};
+
+      auto ranges = conn->reserve_keys(key, count);
+      pool.return_back(conn);
+      return ranges;
+    };
+  }
+
+  // the blocks are reserved by conn, it should not be in a transaction when a
+  // block is reserved, otherwise the block is only reserved after it commits
+  key_allocator(K T::*key, DB &conn, size_t block_size = 1000)
+      : key_(key), block_size_(block_size) {
+    reserve_ = [&conn, key](size_t count) {
+      return conn.reserve_keys(key, count);
+    };
+  }
+
+  key_allocator(const key_allocator &) = delete;
+  key_allocator &operator=(const key_allocator &) = delete;
+
+  // the next key, 0 if no block can be reserved
+  uint64_t next() {
+    while (true) {
+      uint64_t id = next_.load();
+      while (id < end_.load()) {
+        if (next_.compare_exchange_weak(id, id + 1))
+          return id;
+      }
+
+      if (!refill())
+        return 0;
+    }
+  }
+
+  // set the keys of the rows, false if no block can be reserved
+  bool assign(std::vector<T> &v) {
+    for (auto &t : v) {
+      auto id = next();
+      if (id == 0)
+        return false;
+      t.*key_ = (K)id;
+    }
+    return true;
+  }
+
+ private:
+  // switch to the next reserved range, end_ is only changed with the lock
+  bool refill() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (next_.load() < end_.load())
+      return true;
+
+    if (ranges_.empty()) {
+      auto ranges = reserve_((std::max)(block_size_, (size_t)1));
+      if (ranges.empty())
+        return false;
+      ranges_.assign(ranges.begin(), ranges.end());
+    }
+
+    // the keys are ascending, next_ moves first so that no key of the old
+    // range below the new end can be handed out
+    auto [first, last] = ranges_.front();
+    ranges_.pop_front();
+    next_.store(first);
+    end_.store(last);
+    return true;
+  }
+
+  K T::*key_;
+  size_t block_size_;
+  std::function<std::vector<std::pair<uint64_t, uint64_t>>(size_t)> reserve_;
+
+  std::atomic<uint64_t> next_ = 0;
+  std::atomic<uint64_t> end_ = 0;
+  std::mutex mutex_;
+  std::deque<std::pair<uint64_t, uint64_t>> ranges_;
+};
+}  // namespace ormpp
+
+#endif  // ORMPP_KEY_ALLOCATOR_HPP
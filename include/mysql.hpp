@@ -5,12 +5,16 @@
 #ifndef ORM_MYSQL_HPP
 #define ORM_MYSQL_HPP
 #include <climits>
+#include <cstring>
 #include <list>
 #include <map>
 #include <string_view>
 #include <utility>
 
+#include "columns.hpp"
 #include "entity.hpp"
+#include "row_view.hpp"
+#include "table_keys.hpp"
 #include "type_mapping.hpp"
 #include "utility.hpp"
 
@@ -20,10 +24,13 @@ using blob = ormpp_mysql::blob;
 
 class mysql {
  public:
+  static constexpr DBType db_type = DBType::mysql;
+
   ~mysql() { disconnect(); }
 
   template <typename... Args>
   bool connect(Args &&...args) {
+    database_ = get_database_id(db_type, args...);
     if (con_ != nullptr) {
       mysql_close(con_);
     }
@@ -59,6 +66,7 @@ class mysql {
   }
 
   void set_last_error(std::string last_error) {
+    has_error_ = true;
     last_error_ = std::move(last_error);
     std::cout << last_error_ << std::endl;  // todo, write to log file
   }
@@ -96,30 +104,96 @@ class mysql {
   template <typename T, typename... Args>
   int insert(const std::vector<T> &t, Args &&...args) {
     reset_error();
-    auto name = get_name<T>();
-    std::string sql = auto_key_map_[name].empty()
+    std::string sql = get_auto_key<T>().empty()
                           ? generate_insert_sql<T>(false)
-                          : generate_auto_insert_sql<T>(auto_key_map_, false);
+                          : generate_auto_insert_sql<T>(false);
 
     return insert_impl(sql, t, std::forward<Args>(args)...);
   }
 
+  // insert and return the generated auto increment id, 0 if failed
+  template <typename T>
+  uint64_t get_insert_id_after_insert(const T &t) {
+    if (insert(t) == INT_MIN)
+      return 0;
+
+    return mysql_insert_id(con_);
+  }
+
+  // the generated ids of the rows in order, empty if failed; the ids of a
+  // multi-row insert step by auto_increment_increment from the first generated
+  // one, so the auto key of the rows should be 0
+  template <typename T>
+  std::vector<uint64_t> get_insert_id_after_insert(const std::vector<T> &v) {
+    auto increment = query<std::tuple<int64_t>>(
+        "select @@session.auto_increment_increment");
+    if (increment.empty())
+      return {};
+
+    auto auto_key = get_auto_key<T>();
+    if (auto_key.empty()) {
+      set_last_error("there is no auto key of " + get_name<T>());
+      return {};
+    }
+    for (auto &t : v) {
+      if (is_field_set(t, auto_key)) {
+        set_last_error("the auto key of the rows should be 0");
+        return {};
+      }
+    }
+
+    uint64_t step = (std::max)(std::get<0>(increment[0]), int64_t(1));
+    std::vector<uint64_t> ids;
+    ids.reserve(v.size());
+    auto on_chunk = [this, &ids, step](size_t count) {
+      uint64_t first = mysql_stmt_insert_id(stmt_);
+      for (size_t i = 0; i < count; ++i) {
+        ids.push_back(first + i * step);
+      }
+      return first != 0;
+    };
+
+    int r = execute_batches(
+        v,
+        [](size_t count) {
+          return generate_insert_rows_sql<T>(db_type, count);
+        },
+        on_chunk);
+    if (r == INT_MIN || v.empty())
+      return {};
+
+    return ids;
+  }
+
+  // the name of the auto increment key of T, empty if there is none
+  template <typename T>
+  std::string get_auto_key() {
+    return get_table_keys<T>().auto_key;
+  }
+
+  // update by the key, the args are the names of extra condition fields; if
+  // there is no key and no condition field, the row is replaced
   template <typename T, typename... Args>
   int update(const std::vector<T> &t, Args &&...args) {
     reset_error();
-    std::string sql = generate_insert_sql<T>(true);
+    auto conditions = get_conditions<T>(std::forward<Args>(args)...);
+    if (conditions.empty()) {
+      std::string sql = generate_insert_sql<T>(true);
+      return insert_impl(sql, t);
+    }
 
-    return insert_impl(sql, t, std::forward<Args>(args)...);
+    auto fields = get_update_fields(get_member_names(get_members<T>()),
+                                    conditions);
+    return update_impl(t, fields, conditions);
   }
 
   template <typename T, typename... Args>
   int insert(const T &t, Args &&...args) {
     reset_error();
     // insert into person values(?, ?, ?);
-    auto name = get_name<T>();
-    std::string sql = auto_key_map_[name].empty()
+    std::string sql = get_auto_key<T>().empty()
                           ? generate_insert_sql<T>(false)
-                          : generate_auto_insert_sql<T>(auto_key_map_, false);
+                          : generate_auto_insert_sql<T>(false);
 
     return insert_impl(sql, t, std::forward<Args>(args)...);
   }
@@ -127,8 +201,85 @@ class mysql {
   template <typename T, typename... Args>
   int update(const T &t, Args &&...args) {
     reset_error();
-    std::string sql = generate_insert_sql<T>(true);
-    return insert_impl(sql, t, std::forward<Args>(args)...);
+    auto conditions = get_conditions<T>(std::forward<Args>(args)...);
+    if (conditions.empty()) {
+      std::string sql = generate_insert_sql<T>(true);
+      return insert_impl(sql, t);
+    }
+
+    auto fields = get_update_fields(get_member_names(get_members<T>()),
+                                    conditions);
+    return update_impl(t, fields, conditions);
+  }
+
+  // insert t, or update the row with the same key in one statement, the
+  // members limit the updated fields, such as: upsert(p, &person::name)
+  template <typename T, typename... Members>
+  int upsert(const T &t, Members T::*...members) {
+    reset_error();
+    auto keys = get_conditions<T>();
+    auto fields = get_set_fields<T>(keys, members...);
+    auto sql = generate_upsert_sql<T>(db_type, keys, fields, 1);
+    return execute_rows(sql, &t, 1) ? 1 : INT_MIN;
+  }
+
+  // the rows are sent in multi-row statements in one transaction
+  template <typename T, typename... Members>
+  int upsert(const std::vector<T> &v, Members T::*...members) {
+    reset_error();
+    auto keys = get_conditions<T>();
+    auto fields = get_set_fields<T>(keys, members...);
+    return execute_batches(v, [&keys, &fields](size_t count) {
+      return generate_upsert_sql<T>(db_type, keys, fields, count);
+    });
+  }
+
+  // update the rows by the key with one set-based statement per chunk, the
+  // members limit the updated fields, such as: bulk_update(v, &person::name)
+  template <typename T, typename... Members>
+  int bulk_update(const std::vector<T> &v, Members T::*...members) {
+    reset_error();
+    auto keys = get_conditions<T>();
+    if (keys.empty()) {
+      set_last_error("bulk_update needs a key of " + get_name<T>());
+      return INT_MIN;
+    }
+
+    auto fields = get_set_fields<T>(keys, members...);
+    return execute_batches(v, [&keys, &fields](size_t count) {
+      return generate_bulk_update_sql<T>(db_type, keys, fields, count);
+    });
+  }
+
+  // insert the rows with multi-row statements in one transaction, all the
+  // fields are inserted, including the auto key
+  template <typename T>
+  int bulk_insert(const std::vector<T> &v) {
+    reset_error();
+    return execute_batches(v, [](size_t count) {
+      return generate_insert_rows_sql<T>(db_type, count);
+    });
+  }
+
+  // only update the given fields by the key, such as:
+  // update_fields(p, &person::name, &person::age)
+  template <typename T, typename... Members>
+  int update_fields(const T &t, Members T::*...members) {
+    reset_error();
+    auto conditions = get_conditions<T>();
+    if (conditions.empty()) {
+      set_last_error("update_fields needs a key of " + get_name<T>());
+      return INT_MIN;
+    }
+
+    auto fields = get_update_fields(
+        get_member_names(std::make_tuple(members...)), conditions);
+    if (fields.empty()) {
+      set_last_error("update_fields needs a field which isn't a key");
+      return INT_MIN;
+    }
+
+    return update_impl(t, fields, conditions);
   }
 
   template <typename T, typename... Args>
@@ -162,12 +313,11 @@ class mysql {
 #endif
     constexpr auto Args_Size = sizeof...(Args);
     if constexpr (Args_Size != 0) {
-      if (Args_Size != std::count(sql.begin(), sql.end(), '?')) {
+      if (get_params_size(args...) !=
+          (size_t)std::count(sql.begin(), sql.end(), '?')) {
         has_error_ = true;
         return {};
       }
-
-      sql = get_sql(sql, std::forward<Args>(args)...);
     }
 
     stmt_ = mysql_stmt_init(con_);
@@ -184,6 +334,16 @@ class mysql {
       return {};
     }
 
+    if constexpr (Args_Size != 0) {
+      std::vector<MYSQL_BIND> binds;
+      (set_param_bind(binds, std::forward<Args>(args)), ...);
+      if (mysql_stmt_bind_param(stmt_, &binds[0])) {
+        set_last_error(mysql_stmt_error(stmt_));
+        has_error_ = true;
+        return {};
+      }
+    }
+
     std::array<MYSQL_BIND, result_size<T>::value> param_binds = {};
     std::list<std::vector<char>> mp;
 
@@ -347,33 +507,339 @@ class mysql {
   template <typename T, typename... Args>
   std::enable_if_t<iguana::is_reflection_v<T>, std::vector<T>> query(
       Args &&...args) {
+    std::vector<T> v;
+    query_rows<T>(v, std::forward<Args>(args)...);
+    return v;
+  }
+
+#ifdef ORMPP_HAS_PMR
+  // as query, but the rows and their std::pmr::string fields are allocated
+  // from mr, such as a std::pmr::monotonic_buffer_resource which releases
+  // them together
+  template <typename T, typename Resource, typename... Args>
+  std::enable_if_t<iguana::is_reflection_v<T> &&
+                       std::is_base_of_v<std::pmr::memory_resource, Resource>,
+                   std::pmr::vector<T>>
+  query(Resource *mr, Args &&...args) {
+    std::pmr::vector<T> v(mr);
+    query_rows<T>(v, std::forward<Args>(args)...);
+    return v;
+  }
+#endif
+
+  // call func(row) with a row_view<T> of each row, its strings and blobs
+  // point into the driver's buffers and are only valid until func returns;
+  // func returns false to stop, and it must not use this connection; the args
+  // are the conditions
+  template <typename T, typename Func, typename... Args>
+  bool for_each_row(Func &&func, Args &&...args) {
+    static_assert(!is_selection_args<Args...>::value,
+                  "all the fields are viewed by for_each_row");
+    reset_error();
+    std::string sql = generate_query_sql<T>(args...);
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
+    auto members = get_members<T>();
+
+    row_view<T> row;
+    auto on_row = [&func, &row, &members, this](T &t, auto &mp) {
+      // the views point into the bound buffers
+      iguana::for_each(members, [&row, &mp, &t, this](auto item, auto I) {
+        constexpr auto Idx = decltype(I)::value;
+        using U = typename field_attribute<decltype(item)>::return_type;
+        auto &field = std::get<Idx>(row.fields());
+        if constexpr (std::is_same_v<blob, U>) {
+          auto &vec = mp[Idx];
+          field = std::string_view(vec.data(), get_blob_len((int)Idx));
+        }
+        else if constexpr (std::is_same_v<view_t<U>, std::string_view>) {
+          auto &vec = mp[Idx];
+          auto size = strnlen(vec.data(), vec.size());
+          field = std::string_view(vec.data(), size);
+        }
+        else {
+          field = t.*item;
+        }
+      });
+      return call_row_func(func, row);
+    };
+    return fetch_rows<T>(sql, members, T{}, on_row);
+  }
+
+  // call func(std::vector<T> &&batch) with the rows by batches of
+  // batch_size, they are read by a cursor which prefetches a batch at a time,
+  // so only a batch is in memory; the last batch may be smaller, func returns
+  // false to stop, and it must not use this connection; the args are the
+  // conditions
+  template <typename T, typename Func, typename... Args>
+  bool for_each_batch(size_t batch_size, Func &&func, Args &&...args) {
+    reset_error();
+    std::string sql = generate_query_sql<T>(args...);
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
+    auto members = get_members<T>(args...);
+    size_t count = (std::max)(batch_size, size_t(1));
+
+    std::vector<T> batch;
+    batch.reserve(count);
+    bool stopped = false;
+    auto on_row = [&](T &t, auto &mp) {
+      assign_fields(t, members, mp);
+      batch.push_back(std::move(t));
+      if (batch.size() < count)
+        return true;
+
+      stopped = !call_row_func(func, std::move(batch));
+      batch = {};
+      batch.reserve(count);
+      return !stopped;
+    };
+    if (!fetch_rows<T>(sql, members, T{}, on_row, (unsigned long)count))
+      return false;
+
+    if (!stopped && !batch.empty())
+      call_row_func(func, std::move(batch));
+    return true;
+  }
+
+  // as query, but the rows are decoded by column, the args are the conditions
+  template <typename T, typename... Args>
+  columns<T> query_columns(Args &&...args) {
+    static_assert(!is_selection_args<Args...>::value,
+                  "all the fields are decoded by query_columns");
     reset_error();
     std::string sql = generate_query_sql<T>(args...);
 #if ORMPP_ENABLE_LOG
     std::cout << sql << std::endl;
 #endif
-    constexpr auto SIZE = iguana::get_value<T>();
+    auto members = get_members<T>();
+
+    columns<T> cols;
+    auto on_row = [&cols, &members, this](T &t, auto &mp) {
+      // append the bound buffers to the columns, the strings are not
+      // materialized
+      iguana::for_each(members, [&cols, &mp, &t, this](auto item, auto I) {
+        constexpr auto Idx = decltype(I)::value;
+        using U = typename field_attribute<decltype(item)>::return_type;
+        auto &column = cols.template get<Idx>();
+        if constexpr (std::is_same_v<column_t<U>, string_column>) {
+          auto &vec = mp[Idx];
+          column.push_back(
+              std::string_view(vec.data(), strnlen(vec.data(), vec.size())));
+        }
+        else if constexpr (std::is_same_v<blob, U>) {
+          auto &vec = mp[Idx];
+          column.push_back(
+              blob(vec.data(), vec.data() + get_blob_len((int)Idx)));
+        }
+        else {
+          column.push_back(t.*item);
+        }
+      });
+      cols.add_row();
+    };
+    fetch_rows<T>(sql, members, T{}, on_row);
+
+    return cols;
+  }
 
+  int get_blob_len(int column) {
+    unsigned long data_len = 0;
+
+    MYSQL_BIND param;
+    memset(&param, 0, sizeof(MYSQL_BIND));
+    param.length = &data_len;
+    param.buffer_type = MYSQL_TYPE_BLOB;
+
+    auto retcode = mysql_stmt_fetch_column(stmt_, &param, column, 0);
+    if (retcode != 0) {
+      set_last_error(mysql_stmt_error(stmt_));
+      return 0;
+    }
+
+    return static_cast<int>(data_len);
+  }
+
+  bool has_error() { return has_error_; }
+  void reset_error() {
+    has_error_ = false;
+    last_error_ = {};
+  }
+
+  // just support execute string sql without placeholders
+  bool execute(const std::string &sql) {
+    if (mysql_query(con_, sql.data()) != 0) {
+      fprintf(stderr, "%s\n", mysql_error(con_));
+      return false;
+    }
+
+    return true;
+  }
+
+  // execute sql with placeholders, the args are bound as statement parameters
+  template <typename Arg, typename... Args>
+  bool execute(const std::string &sql, Arg &&arg, Args &&...args) {
+    reset_error();
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
     stmt_ = mysql_stmt_init(con_);
     if (!stmt_) {
       has_error_ = true;
-      return {};
+      return false;
     }
 
     auto guard = guard_statment(stmt_);
 
     if (mysql_stmt_prepare(stmt_, sql.c_str(), (unsigned long)sql.size())) {
+      set_last_error(mysql_stmt_error(stmt_));
       has_error_ = true;
-      return {};
+      return false;
+    }
+
+    std::vector<MYSQL_BIND> binds;
+    set_param_bind(binds, std::forward<Arg>(arg));
+    (set_param_bind(binds, std::forward<Args>(args)), ...);
+    if (mysql_stmt_bind_param(stmt_, &binds[0])) {
+      set_last_error(mysql_stmt_error(stmt_));
+      has_error_ = true;
+      return false;
+    }
+
+    if (mysql_stmt_execute(stmt_)) {
+      set_last_error(mysql_stmt_error(stmt_));
+      has_error_ = true;
+      return false;
+    }
+
+    return true;
+  }
+
+  // transaction
+  // the transactions can be nested, only the outermost one is sent to the
+  // database, a rollback of an inner one makes the outermost one roll back
+  bool begin() {
+    if (transaction_depth_ > 0) {
+      ++transaction_depth_;
+      return true;
+    }
+
+    if (mysql_query(con_, "BEGIN")) {
+      //                fprintf(stderr, "%s\n", mysql_error(con_));
+      return false;
+    }
+
+    transaction_depth_ = 1;
+    return true;
+  }
+
+  bool commit() {
+    if (transaction_depth_ > 1) {
+      --transaction_depth_;
+      return true;
+    }
+
+    transaction_depth_ = 0;
+    if (rollback_only_) {
+      rollback_only_ = false;
+      mysql_query(con_, "ROLLBACK");
+      set_last_error("rolled back by an inner transaction");
+      return false;
+    }
+
+    if (mysql_query(con_, "COMMIT")) {
+      //                fprintf(stderr, "%s\n", mysql_error(con_));
+      return false;
+    }
+
+    return true;
+  }
+
+  bool rollback() {
+    if (transaction_depth_ > 1) {
+      --transaction_depth_;
+      rollback_only_ = true;
+      return true;
+    }
+
+    transaction_depth_ = 0;
+    rollback_only_ = false;
+    if (mysql_query(con_, "ROLLBACK")) {
+      //                fprintf(stderr, "%s\n", mysql_error(con_));
+      return false;
+    }
+
+    return true;
+  }
+
+ private:
+  template <typename T, typename Rows, typename... Args>
+  void query_rows(Rows &v, Args &&...args) {
+    reset_error();
+    std::string sql = generate_query_sql<T>(args...);
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
+    auto members = get_members<T>(args...);
+
+    auto on_row = [&v, &members, this](T &t, auto &mp) {
+      assign_fields(t, members, mp);
+      v.push_back(std::move(t));
+    };
+    fetch_rows<T>(sql, members, make_row<T>(v), on_row);
+  }
+
+  // copy the strings, char arrays and blobs of a fetched row from mp to t
+  template <typename T, typename Members, typename Map>
+  void assign_fields(T &t, const Members &members, Map &mp) {
+    auto column = 0;
+    iguana::for_each(members, [&mp, &t, &column, this](auto item, auto i) {
+      using U = std::remove_reference_t<decltype(std::declval<T>().*item)>;
+      if constexpr (is_string_v<U>) {
+        auto &vec = mp[decltype(i)::value];
+        (t.*item).assign(vec.data(), strlen(vec.data()));
+      }
+      else if constexpr (is_char_array_v<U>) {
+        auto &vec = mp[decltype(i)::value];
+        memcpy(t.*item, vec.data(), vec.size());
+      }
+      else if constexpr (std::is_same_v<blob, U>) {
+        auto &vec = mp[decltype(i)::value];
+        t.*item = blob(vec.data(), vec.data() + get_blob_len(column));
+      }
+      ++column;
+    });
+  }
+
+  // bind the result buffers of members to the row t and call on_row(t, mp)
+  // after each fetch, the strings, char arrays and blobs are in mp by the index
+  // of the member; the rows are read by a cursor prefetch_rows at a time if it
+  // isn't 0, otherwise they are all sent at once
+  template <typename T, typename Members, typename Func>
+  bool fetch_rows(const std::string &sql, const Members &members, T t,
+                  Func on_row, unsigned long prefetch_rows = 0) {
+    constexpr auto SIZE = std::tuple_size_v<Members>;
+
+    stmt_ = mysql_stmt_init(con_);
+    if (!stmt_) {
+      has_error_ = true;
+      return false;
+    }
+
+    auto guard = guard_statment(stmt_);
+
+    if (mysql_stmt_prepare(stmt_, sql.c_str(), (unsigned long)sql.size())) {
+      has_error_ = true;
+      return false;
     }
 
     std::array<MYSQL_BIND, SIZE> param_binds = {};
     std::map<size_t, std::vector<char>> mp;
 
-    std::vector<T> v;
-    T t{};
     int index = 0;
-    iguana::for_each(t, [&](auto item, auto i) {
+    iguana::for_each(members, [&](auto item, auto i) {
       constexpr auto Idx = decltype(i)::value;
       using U = std::remove_reference_t<decltype(std::declval<T>().*item)>;
       if constexpr (std::is_arithmetic_v<U>) {
@@ -382,7 +848,7 @@ class mysql {
         param_binds[Idx].buffer = &(t.*item);
         index++;
       }
-      else if constexpr (std::is_same_v<std::string, U>) {
+      else if constexpr (is_string_v<U>) {
         param_binds[Idx].buffer_type = MYSQL_TYPE_STRING;
         std::vector<char> tmp(65536, 0);
         mp.emplace(decltype(i)::value, tmp);
@@ -409,46 +875,46 @@ class mysql {
     });
 
     if (index == 0) {
-      return {};
+      return false;
     }
 
     if (mysql_stmt_bind_result(stmt_, &param_binds[0])) {
       //                fprintf(stderr, "%s\n", mysql_error(con_));
       has_error_ = true;
-      return {};
+      return false;
+    }
+
+    if (prefetch_rows != 0) {
+      unsigned long cursor_type = CURSOR_TYPE_READ_ONLY;
+      if (mysql_stmt_attr_set(stmt_, STMT_ATTR_CURSOR_TYPE, &cursor_type) ||
+          mysql_stmt_attr_set(stmt_, STMT_ATTR_PREFETCH_ROWS,
+                              &prefetch_rows)) {
+        has_error_ = true;
+        return false;
+      }
     }
 
     if (mysql_stmt_execute(stmt_)) {
       //                fprintf(stderr, "%s\n", mysql_error(con_));
       has_error_ = true;
-      return {};
+      return false;
     }
 
     while (mysql_stmt_fetch(stmt_) == 0) {
-      auto column = 0;
-      iguana::for_each(t, [&mp, &t, &column, this](auto item, auto i) {
-        using U = std::remove_reference_t<decltype(std::declval<T>().*item)>;
-        if constexpr (std::is_same_v<std::string, U>) {
-          auto &vec = mp[decltype(i)::value];
-          t.*item = std::string(&vec[0], strlen(vec.data()));
-        }
-        else if constexpr (is_char_array_v<U>) {
-          auto &vec = mp[decltype(i)::value];
-          memcpy(t.*item, vec.data(), vec.size());
-        }
-        else if constexpr (std::is_same_v<blob, U>) {
-          auto &vec = mp[decltype(i)::value];
-          t.*item = blob(vec.data(), vec.data() + get_blob_len(column));
-        }
-        ++column;
-      });
+      // on_row may return false to stop
+      if constexpr (std::is_same_v<decltype(on_row(t, mp)), bool>) {
+        if (!on_row(t, mp))
+          break;
+      }
+      else {
+        on_row(t, mp);
+      }
 
       for (auto &p : mp) {
         p.second.assign(p.second.size(), 0);
       }
 
-      v.push_back(std::move(t));
-      iguana::for_each(t, [&mp, &t](auto item, auto /*i*/) {
+      iguana::for_each(members, [&t](auto item, auto /*i*/) {
         using U = std::remove_reference_t<decltype(std::declval<T>().*item)>;
         if constexpr (std::is_arithmetic_v<U>) {
           memset(&(t.*item), 0, sizeof(U));
@@ -456,71 +922,9 @@ class mysql {
       });
     }
 
-    return v;
-  }
-
-  int get_blob_len(int column) {
-    unsigned long data_len = 0;
-
-    MYSQL_BIND param;
-    memset(&param, 0, sizeof(MYSQL_BIND));
-    param.length = &data_len;
-    param.buffer_type = MYSQL_TYPE_BLOB;
-
-    auto retcode = mysql_stmt_fetch_column(stmt_, &param, column, 0);
-    if (retcode != 0) {
-      set_last_error(mysql_stmt_error(stmt_));
-      return 0;
-    }
-
-    return static_cast<int>(data_len);
-  }
-
-  bool has_error() { return has_error_; }
-  void reset_error() {
-    has_error_ = false;
-    last_error_ = {};
-  }
-
-  // just support execute string sql without placeholders
-  bool execute(const std::string &sql) {
-    if (mysql_query(con_, sql.data()) != 0) {
-      fprintf(stderr, "%s\n", mysql_error(con_));
-      return false;
-    }
-
     return true;
   }
 
-  // transaction
-  bool begin() {
-    if (mysql_query(con_, "BEGIN")) {
-      //                fprintf(stderr, "%s\n", mysql_error(con_));
-      return false;
-    }
-
-    return true;
-  }
-
-  bool commit() {
-    if (mysql_query(con_, "COMMIT")) {
-      //                fprintf(stderr, "%s\n", mysql_error(con_));
-      return false;
-    }
-
-    return true;
-  }
-
-  bool rollback() {
-    if (mysql_query(con_, "ROLLBACK")) {
-      //                fprintf(stderr, "%s\n", mysql_error(con_));
-      return false;
-    }
-
-    return true;
-  }
-
- private:
   template <typename T, typename... Args>
   std::string generate_createtb_sql(Args &&...args) {
     const auto type_name_arr = get_type_names<T>(DBType::mysql);
@@ -529,7 +933,7 @@ class mysql {
         std::string("CREATE TABLE IF NOT EXISTS ") + name.data() + "(";
     auto arr = iguana::get_array<T>();
     constexpr auto SIZE = sizeof...(Args);
-    auto_key_map_[name.data()] = "";
+    table_keys keys;
 
     // auto_increment_key and key can't exist at the same time
     using U = std::tuple<std::decay_t<Args>...>;
@@ -547,8 +951,8 @@ class mysql {
       bool has_add_field = false;
       for_each0(
           tp,
-          [&sql, &i, &has_add_field, field_name, type_name_arr, name,
-           this](auto item) {
+          [&sql, &i, &has_add_field, &keys, field_name,
+           type_name_arr](auto item) {
             if constexpr (std::is_same_v<decltype(item), ormpp_not_null>) {
               if (item.fields.find(field_name.data()) == item.fields.end())
                 return;
@@ -570,6 +974,7 @@ class mysql {
                 append(sql, field_name.data(), " ", type_name_arr[i]);
               }
               append(sql, " PRIMARY KEY");
+              keys.key = item.fields;
               has_add_field = true;
             }
             else if constexpr (std::is_same_v<decltype(item), ormpp_auto_key>) {
@@ -578,7 +983,8 @@ class mysql {
               }
               append(sql, " AUTO_INCREMENT");
               append(sql, " PRIMARY KEY");
-              auto_key_map_[name.data()] = item.fields;
+              keys.auto_key = item.fields;
+              keys.key = item.fields;
               has_add_field = true;
             }
             else if constexpr (std::is_same_v<decltype(item), ormpp_unique>) {
@@ -604,6 +1010,8 @@ class mysql {
     }
 
     sql += ")";
+    // publish the keys at once, the readers never see a half set table
+    table_keys_registry::instance().set(database_, name, std::move(keys));
 
     return sql;
   }
@@ -613,7 +1021,13 @@ class mysql {
                                 T &&value) {
     MYSQL_BIND param = {};
     using U = std::remove_const_t<std::remove_reference_t<T>>;
-    if constexpr (is_optional_v<U>::value) {
+    if constexpr (is_param_list<U>::value) {
+      for (auto &item : value) {
+        set_param_bind(param_binds, item);
+      }
+      return;
+    }
+    else if constexpr (is_optional_v<U>::value) {
       if (value.has_value()) {
         return set_param_bind(param_binds, std::move(value.value()));
       }
@@ -626,12 +1040,14 @@ class mysql {
           (enum_field_types)ormpp_mysql::type_to_id(identity<U>{});
       param.buffer = const_cast<void *>(static_cast<const void *>(&value));
     }
-    else if constexpr (std::is_same_v<std::string, U>) {
+    else if constexpr (is_string_v<U> ||
+                       std::is_same_v<std::string_view, U>) {
       param.buffer_type = MYSQL_TYPE_STRING;
-      param.buffer = (void *)(value.c_str());
+      param.buffer = (void *)(value.data());
       param.buffer_length = (unsigned long)value.size();
     }
-    else if constexpr (std::is_same_v<const char *, U> || is_char_array_v<U>) {
+    else if constexpr (std::is_same_v<const char *, U> ||
+                       std::is_same_v<char *, U> || is_char_array_v<U>) {
       param.buffer_type = MYSQL_TYPE_STRING;
       param.buffer = (void *)(value);
       param.buffer_length = (unsigned long)strlen(value);
@@ -650,11 +1066,8 @@ class mysql {
   template <typename T>
   int stmt_execute(const T &t) {
     std::vector<MYSQL_BIND> param_binds;
-    auto it = auto_key_map_.find(get_name<T>());
-    std::string auto_key = (it == auto_key_map_.end()) ? "" : it->second;
-
     iguana::for_each(
-        t, [&t, &param_binds, &auto_key, this](const auto &v, auto /*i*/) {
+        t, [&t, &param_binds, this](const auto &v, auto /*i*/) {
           /*if (!auto_key.empty() && auto_key ==
              iguana::get_name<T>(decltype(i)::value).data()) return;*/
 
@@ -746,6 +1159,198 @@ class mysql {
     return b ? (int)t.size() : INT_MIN;
   }
 
+  // the keys of T in the database, see table_keys_registry
+  template <typename T>
+  table_keys get_table_keys() {
+    return table_keys_registry::instance().get(database_, get_name<T>());
+  }
+
+  template <typename T, typename... Args>
+  std::vector<std::string> get_conditions(Args &&...args) {
+    std::vector<std::string> conditions;
+    auto key = get_table_keys<T>().key;
+    if (!key.empty())
+      conditions.push_back(std::move(key));
+
+    if constexpr (sizeof...(Args) > 0) {
+      auto add = [&conditions](std::string field) {
+        if (std::find(conditions.begin(), conditions.end(), field) ==
+            conditions.end())
+          conditions.push_back(std::move(field));
+      };
+      (add(std::forward<Args>(args)), ...);
+    }
+    return conditions;
+  }
+
+  template <typename T, size_t N>
+  bool update_execute(const T &t, const std::array<size_t, N> &positions,
+                      size_t count) {
+    std::vector<MYSQL_BIND> param_binds;
+    std::vector<size_t> indexes;
+    iguana::for_each(t, [&t, &positions, &param_binds, &indexes, this](
+                            auto item, auto i) {
+      constexpr auto Idx = decltype(i)::value;
+      if (positions[Idx] == 0)
+        return;
+
+      set_param_bind(param_binds, t.*item);
+      indexes.push_back(positions[Idx] - 1);
+    });
+
+    // the binds must be in the order of the placeholders
+    std::vector<MYSQL_BIND> binds(count);
+    for (size_t i = 0; i < indexes.size(); ++i) {
+      binds[indexes[i]] = param_binds[i];
+    }
+
+    if (mysql_stmt_bind_param(stmt_, &binds[0]) ||
+        mysql_stmt_execute(stmt_)) {
+      set_last_error(mysql_stmt_error(stmt_));
+      return false;
+    }
+
+    return true;
+  }
+
+  bool prepare_stmt(const std::string &sql) {
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
+    stmt_ = mysql_stmt_init(con_);
+    if (!stmt_) {
+      set_last_error(mysql_error(con_));
+      return false;
+    }
+
+    if (mysql_stmt_prepare(stmt_, sql.c_str(), (int)sql.size())) {
+      set_last_error(mysql_stmt_error(stmt_));
+      mysql_stmt_close(stmt_);
+      return false;
+    }
+
+    return true;
+  }
+
+  template <typename T>
+  int update_impl(const T &t, const std::vector<std::string_view> &fields,
+                  const std::vector<std::string> &conditions) {
+    auto sql = generate_update_sql<T>(db_type, fields, conditions);
+    if (!prepare_stmt(sql))
+      return INT_MIN;
+
+    auto guard = guard_statment(stmt_);
+    auto positions = get_update_positions<T>(fields, conditions);
+    if (!update_execute(t, positions, fields.size() + conditions.size()))
+      return INT_MIN;
+
+    return 1;
+  }
+
+  template <typename T>
+  int update_impl(const std::vector<T> &v,
+                  const std::vector<std::string_view> &fields,
+                  const std::vector<std::string> &conditions) {
+    auto sql = generate_update_sql<T>(db_type, fields, conditions);
+    if (!prepare_stmt(sql))
+      return INT_MIN;
+
+    auto guard = guard_statment(stmt_);
+
+    if (!begin())
+      return INT_MIN;
+
+    auto positions = get_update_positions<T>(fields, conditions);
+    for (auto &t : v) {
+      if (!update_execute(t, positions, fields.size() + conditions.size())) {
+        rollback();
+        return INT_MIN;
+      }
+    }
+
+    return commit() ? (int)v.size() : INT_MIN;
+  }
+
+  // the rows are sent in chunks in one transaction, make_sql(count) generates
+  // the statement of a chunk of count rows
+  template <typename T, typename Func>
+  int execute_batches(const std::vector<T> &v, Func make_sql) {
+    return execute_batches(v, make_sql, [](size_t) {
+      return true;
+    });
+  }
+
+  // on_chunk(count) is called after each chunk is executed, the transaction
+  // is rolled back if it returns false
+  template <typename T, typename Func, typename Callback>
+  int execute_batches(const std::vector<T> &v, Func make_sql,
+                      Callback on_chunk) {
+    if (v.empty())
+      return 0;
+
+    if (!begin())
+      return INT_MIN;
+
+    // the statement of the full chunks is prepared once and reused
+    constexpr size_t batch_rows = get_batch_rows<T>();
+    size_t prepared_rows = 0;
+    bool ok = true;
+    for (size_t i = 0; ok && i < v.size(); i += batch_rows) {
+      size_t count = (std::min)(batch_rows, v.size() - i);
+      if (count != prepared_rows) {
+        if (prepared_rows > 0)
+          mysql_stmt_close(stmt_);
+        prepared_rows = 0;
+
+        if (!prepare_stmt(make_sql(count))) {
+          ok = false;
+          break;
+        }
+        prepared_rows = count;
+      }
+
+      ok = bind_execute(v.data() + i, count) && on_chunk(count);
+    }
+
+    if (prepared_rows > 0)
+      mysql_stmt_close(stmt_);
+    if (!ok) {
+      rollback();
+      return INT_MIN;
+    }
+
+    return commit() ? (int)v.size() : INT_MIN;
+  }
+
+  // execute sql with all the fields of the rows bound in order
+  template <typename T>
+  bool execute_rows(const std::string &sql, const T *rows, size_t count) {
+    if (!prepare_stmt(sql))
+      return false;
+
+    auto guard = guard_statment(stmt_);
+    return bind_execute(rows, count);
+  }
+
+  template <typename T>
+  bool bind_execute(const T *rows, size_t count) {
+    std::vector<MYSQL_BIND> param_binds;
+    for (size_t row = 0; row < count; ++row) {
+      auto &t = rows[row];
+      iguana::for_each(t, [&t, &param_binds, this](auto item, auto) {
+        set_param_bind(param_binds, t.*item);
+      });
+    }
+
+    if (mysql_stmt_bind_param(stmt_, &param_binds[0]) ||
+        mysql_stmt_execute(stmt_)) {
+      set_last_error(mysql_stmt_error(stmt_));
+      return false;
+    }
+
+    return true;
+  }
+
   template <typename... Args>
   auto get_tp(int &timeout, Args &&...args) {
     auto tp = std::make_tuple(con_, std::forward<Args>(args)...);
@@ -769,7 +1374,11 @@ class mysql {
   MYSQL_STMT *stmt_ = nullptr;
   bool has_error_ = false;
   std::string last_error_;
-  inline static std::map<std::string, std::string> auto_key_map_;
+  // see get_database_id
+  std::string database_;
+  // the depth of the nested transactions
+  int transaction_depth_ = 0;
+  bool rollback_only_ = false;
 };
 }  // namespace ormpp
 
@@ -0,0 +1,191 @@
+#ifndef ORMPP_PARALLEL_SCAN_HPP
+#define ORMPP_PARALLEL_SCAN_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "connection_pool.hpp"
+#include "dbng.hpp"
+
+namespace ormpp {
+// the rows of a partition are queried by pages of this size
+inline constexpr size_t scan_page_size = 10000;
+
+struct scan_progress {
+  size_t partition;
+  // the keys of the partition are in [begin, end]
+  int64_t begin;
+  int64_t end;
+  // the rows passed to the sink so far
+  size_t rows;
+  bool done;
+};
+
+// split the keys of the rows matching pred into partitions and scan them
+// concurrently on the connections of the pool, every page of rows is passed
+// to sink(partition, std::vector<T> &&rows) in the order of the key within a
+// partition, such as:
+// parallel_scan<dbng<mysql>>(
+//     &person::id, 8, "age > 10",
+//     [&](size_t partition, std::vector<person> &&rows) {
+//       std::unique_lock<std::mutex> lock(mutex);
+//       write(rows);
+//     });
+// sink and on_progress are called by many threads at the same time, the
+// partitions are shared by at most partitions connections, it returns false
+// if a partition can't be scanned
+template <typename DB, typename T, typename K, typename Sink>
+inline bool parallel_scan(
+    K T::*key, size_t partitions, const std::string &pred, Sink &&sink,
+    const std::function<void(const scan_progress &)> &on_progress = nullptr,
+    connection_pool<DB> &pool = connection_pool<DB>::instance()) {
+  static_assert(std::is_integral_v<K>, "the key should be an integer");
+  std::string field(get_member_name(key));
+
+  int64_t first = 0;
+  int64_t last = 0;
+  {
+    auto conn = pool.get();
+    if (conn == nullptr)
+      return false;
+
+    std::string fields = "count(1), min(" + field + "), max(" + field + ")";
+    auto sql = pred.empty() ? generate_select_sql<T>(fields)
+                            : generate_select_sql<T>(fields, pred);
+    auto v = conn->template query<std::tuple<int64_t, int64_t, int64_t>>(sql);
+    pool.return_back(conn);
+    if (v.empty())
+      return false;
+    if (std::get<0>(v[0]) == 0)
+      return true;
+    first = std::get<1>(v[0]);
+    last = std::get<2>(v[0]);
+  }
+
+  // the keys are split evenly, the first partitions take the remainder
+  uint64_t span = uint64_t(last) - uint64_t(first) + 1;
+  size_t count = (std::max)(size_t(1), partitions);
+  if (span != 0 && span < count)
+    count = size_t(span);
+  uint64_t width = span == 0 ? UINT64_MAX / count : span / count;
+  uint64_t remainder = span == 0 ? 0 : span % count;
+  std::vector<std::pair<int64_t, int64_t>> ranges;
+  uint64_t begin = uint64_t(first);
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t size = width + (i < remainder ? 1 : 0);
+    uint64_t end = i + 1 == count ? uint64_t(last) : begin + size - 1;
+    ranges.emplace_back(int64_t(begin), int64_t(end));
+    begin = end + 1;
+  }
+
+  std::atomic<size_t> next = 0;
+  std::atomic<size_t> scanned = 0;
+  std::atomic<bool> failed = false;
+  auto scan = [&](DB &conn, size_t partition) {
+    auto [range_begin, range_end] = ranges[partition];
+    std::string condition;
+    append(condition, field, ">=", std::to_string(range_begin), "and", field,
+           "<=", std::to_string(range_end));
+    if (!pred.empty())
+      condition.append(" and (").append(pred).append(")");
+
+    scan_progress progress{partition, range_begin, range_end, 0, false};
+    std::optional<std::decay_t<K>> after;
+    do {
+      auto page = conn.query_page(key, after, scan_page_size, condition);
+      // the page of a failed query is empty, it isn't the end of the partition
+      if (conn.has_error())
+        return false;
+      after = page.next_key;
+      progress.rows += page.rows.size();
+      progress.done = !after;
+      if (!page.rows.empty())
+        sink(partition, std::move(page.rows));
+      if (on_progress)
+        on_progress(progress);
+    } while (after);
+    return true;
+  };
+
+  // a worker keeps its connection and takes the partitions one by one, so
+  // there may be more partitions than the connections of the pool
+  auto work = [&] {
+    auto conn = pool.get();
+    if (conn == nullptr)
+      return;
+
+    try {
+      size_t partition;
+      while (!failed && (partition = next++) < ranges.size()) {
+        if (scan(*conn, partition))
+          ++scanned;
+        else
+          failed = true;
+      }
+    } catch (...) {
+      failed = true;
+      pool.return_back(conn);
+      throw;
+    }
+    pool.return_back(conn);
+  };
+
+  std::vector<std::future<void>> workers;
+  for (size_t i = 1; i < ranges.size(); ++i) {
+    workers.push_back(std::async(std::launch::async, work));
+  }
+  work();
+  // rethrow the exception of sink or on_progress
+  for (auto &worker : workers) {
+    worker.get();
+  }
+
+  return scanned == ranges.size();
+}
+
+// the rows of all the partitions merged into one vector ordered by the key,
+// it is empty if a partition can't be scanned
+template <typename DB, typename T, typename K>
+inline std::vector<T> parallel_scan(
+    K T::*key, size_t partitions, const std::string &pred = "",
+    connection_pool<DB> &pool = connection_pool<DB>::instance()) {
+  // a partition is only scanned by one thread
+  std::vector<std::vector<T>> parts((std::max)(size_t(1), partitions));
+  bool ok = parallel_scan<DB>(
+      key, partitions, pred,
+      [&parts](size_t partition, std::vector<T> &&rows) {
+        auto &part = parts[partition];
+        if (part.empty())
+          part = std::move(rows);
+        else
+          part.insert(part.end(), std::make_move_iterator(rows.begin()),
+                      std::make_move_iterator(rows.end()));
+      },
+      nullptr, pool);
+
+  std::vector<T> result;
+  if (!ok)
+    return result;
+
+  size_t size = 0;
+  for (auto &part : parts) {
+    size += part.size();
+  }
+  result.reserve(size);
+  for (auto &part : parts) {
+    result.insert(result.end(), std::make_move_iterator(part.begin()),
+                  std::make_move_iterator(part.end()));
+  }
+  return result;
+}
+}  // namespace ormpp
+
+#endif  // ORMPP_PARALLEL_SCAN_HPP
@@ -5,30 +5,44 @@
 #ifndef ORM_POSTGRESQL_HPP
 #define ORM_POSTGRESQL_HPP
 
+#include <climits>
+#include <cstdlib>
+#include <iostream>
 #include <string>
+#include <thread>
 #include <type_traits>
+#include <vector>
 #ifdef _MSC_VER
 #include <include/libpq-fe.h>
 #else
 #include <postgresql/libpq-fe.h>
 #endif
 
+#include "columns.hpp"
+#include "row_view.hpp"
+#include "table_keys.hpp"
+#include "thread_pool.hpp"
+#include "utility.hpp"
+
 using namespace std::string_literals;
 
 namespace ormpp {
 class postgresql {
  public:
+  static constexpr DBType db_type = DBType::postgresql;
+
   ~postgresql() { disconnect(); }
 
   // ip, user, pwd, db, timeout  the sequence must be fixed like this
   template <typename... Args>
   bool connect(Args &&...args) {
+    database_ = get_database_id(db_type, args...);
     auto sql = ""s;
     sql = generate_conn_sql(std::make_tuple(std::forward<Args>(args)...));
 
     con_ = PQconnectdb(sql.data());
     if (PQstatus(con_) != CONNECTION_OK) {
-      std::cout << PQerrorMessage(con_) << std::endl;
+      set_last_error(PQerrorMessage(con_));
       return false;
     }
 
@@ -47,12 +61,35 @@ class postgresql {
 
   bool ping() { return (PQstatus(con_) == CONNECTION_OK); }
 
-  bool has_error() {
-    return false;  // todo
+  void set_last_error(std::string last_error) {
+    has_error_ = true;
+    last_error_ = std::move(last_error);
+    std::cout << last_error_ << std::endl;  // todo, write to log file
+  }
+
+  std::string get_last_error() const { return last_error_; }
+
+  // true if the last operation failed
+  bool has_error() { return has_error_; }
+  void reset_error() {
+    has_error_ = false;
+    last_error_ = {};
+  }
+
+  // the results of at least threshold rows are decoded by threads in parallel,
+  // the calling thread and the threads - 1 helpers taken from the threads of
+  // thread_pool::instance(), which has a thread per core for all the
+  // connections; 0 threads means std::thread::hardware_concurrency(), a
+  // threshold of 0 turns it off; the std::pmr::vector results are always
+  // decoded by the calling thread
+  void set_parallel_decode(size_t threshold, size_t threads = 0) {
+    parallel_threshold_ = threshold;
+    parallel_threads_ = threads;
   }
 
   template <typename T, typename... Args>
   constexpr auto create_datatable(Args &&...args) {
+    reset_error();
     //            std::string droptb = "DROP TABLE IF EXISTS ";
     //            droptb += iguana::get_name<T>();
     //
@@ -70,7 +107,7 @@ class postgresql {
 #endif
     res_ = PQexec(con_, sql.data());
     if (PQresultStatus(res_) != PGRES_COMMAND_OK) {
-      std::cout << PQerrorMessage(con_) << std::endl;
+      set_last_error(PQerrorMessage(con_));
       PQclear(res_);
       return false;
     }
@@ -81,6 +118,7 @@ class postgresql {
 
   template <typename T, typename... Args>
   constexpr int insert(const T &t, Args &&...args) {
+    reset_error();
     //            std::string sql = generate_pq_insert_sql<T>(false);
     std::string sql = generate_auto_insert_sql<T>(false);
     if (!prepare<T>(sql))
@@ -91,6 +129,7 @@ class postgresql {
 
   template <typename T, typename... Args>
   constexpr int insert(const std::vector<T> &v, Args &&...args) {
+    reset_error();
     //            std::string sql = generate_pq_insert_sql<T>(false);
     std::string sql = generate_auto_insert_sql<T>(false);
 
@@ -114,101 +153,337 @@ class postgresql {
     return (int)v.size();
   }
 
-  // if there is no key in a table, you can set some fields as a condition in
-  // the args...
+  // insert and return the generated serial id, 0 if failed
+  template <typename T>
+  uint64_t get_insert_id_after_insert(const T &t) {
+    reset_error();
+    auto ids = insert_returning_ids(&t, 1);
+    return ids.empty() ? 0 : ids.front();
+  }
+
+  // the generated ids of the rows in order, empty if failed
+  template <typename T>
+  std::vector<uint64_t> get_insert_id_after_insert(const std::vector<T> &v) {
+    reset_error();
+    if (v.empty() || !begin())
+      return {};
+
+    std::vector<uint64_t> ids;
+    ids.reserve(v.size());
+    constexpr size_t batch_rows = get_batch_rows<T>();
+    for (size_t i = 0; i < v.size(); i += batch_rows) {
+      size_t count = (std::min)(batch_rows, v.size() - i);
+      auto chunk = insert_returning_ids(v.data() + i, count);
+      if (chunk.size() != count) {
+        rollback();
+        return {};
+      }
+      ids.insert(ids.end(), chunk.begin(), chunk.end());
+    }
+
+    return commit() ? ids : std::vector<uint64_t>{};
+  }
+
+  // the name of the auto increment key of T, empty if there is none
+  template <typename T>
+  std::string get_auto_key() {
+    return get_table_keys<T>().auto_key;
+  }
+
+  // update by the key, if there is no key in a table, you can set some fields
+  // as a condition in the args...
   template <typename T, typename... Args>
   constexpr int update(const T &t, Args &&...args) {
-    // transaction, firstly delete, secondly insert
-    auto name = iguana::get_name<T>();
-    auto it = key_map_.find(name.data());
-    auto key = it == key_map_.end() ? "" : it->second;
-
-    auto condition = get_condition(t, key, std::forward<Args...>(args)...);
-    if (!begin())
+    reset_error();
+    auto conditions = get_conditions<T>(std::forward<Args>(args)...);
+    if (conditions.empty()) {
+      set_last_error("update needs a key or condition fields");
       return INT_MIN;
+    }
 
-    if (!delete_records<T>(condition)) {
-      rollback();
+    auto fields = get_update_fields(get_member_names(get_members<T>()),
+                                    conditions);
+    return update_impl(t, fields, conditions);
+  }
+
+  template <typename T, typename... Args>
+  constexpr int update(const std::vector<T> &v, Args &&...args) {
+    reset_error();
+    auto conditions = get_conditions<T>(std::forward<Args>(args)...);
+    if (conditions.empty()) {
+      set_last_error("update needs a key or condition fields");
       return INT_MIN;
     }
 
-    if (insert(t) < 0) {
-      rollback();
+    auto fields = get_update_fields(get_member_names(get_members<T>()),
+                                    conditions);
+    return update_impl(v, fields, conditions);
+  }
+
+  // insert t, or update the row with the same key in one statement, the
+  // members limit the updated fields, such as: upsert(p, &person::name)
+  template <typename T, typename... Members>
+  int upsert(const T &t, Members T::*...members) {
+    reset_error();
+    auto keys = get_conditions<T>();
+    if (keys.empty()) {
+      set_last_error("upsert needs a key");
       return INT_MIN;
     }
 
-    if (!commit())
+    auto fields = get_set_fields<T>(keys, members...);
+    auto sql = generate_upsert_sql<T>(db_type, keys, fields, 1);
+    return execute_rows(sql, &t, 1) ? 1 : INT_MIN;
+  }
+
+  // the rows are sent in multi-row statements in one transaction
+  template <typename T, typename... Members>
+  int upsert(const std::vector<T> &v, Members T::*...members) {
+    reset_error();
+    auto keys = get_conditions<T>();
+    if (keys.empty()) {
+      set_last_error("upsert needs a key");
       return INT_MIN;
+    }
 
-    return 1;
+    auto fields = get_set_fields<T>(keys, members...);
+    return execute_batches(v, [&keys, &fields](size_t count) {
+      return generate_upsert_sql<T>(db_type, keys, fields, count);
+    });
   }
 
-  template <typename T, typename... Args>
-  constexpr int update(const std::vector<T> &v, Args &&...args) {
-    // transaction, firstly delete, secondly insert
-    if (!begin())
+  // update the rows by the key with one set-based statement per chunk, the
+  // members limit the updated fields, such as: bulk_update(v, &person::name)
+  template <typename T, typename... Members>
+  int bulk_update(const std::vector<T> &v, Members T::*...members) {
+    reset_error();
+    auto keys = get_conditions<T>();
+    if (keys.empty()) {
+      set_last_error("bulk_update needs a key");
       return INT_MIN;
+    }
 
-    auto name = iguana::get_name<T>();
-    auto it = key_map_.find(name.data());
-    auto key = it == key_map_.end() ? "" : it->second;
-    for (auto &t : v) {
-      auto condition = get_condition(t, key, std::forward<Args...>(args)...);
+    auto fields = get_set_fields<T>(keys, members...);
+    return execute_batches(v, [&keys, &fields](size_t count) {
+      return generate_bulk_update_sql<T>(db_type, keys, fields, count);
+    });
+  }
 
-      if (!delete_records<T>(condition)) {
-        rollback();
-        return INT_MIN;
-      }
+  // insert the rows with multi-row statements in one transaction, all the
+  // fields are inserted, including the auto key
+  template <typename T>
+  int bulk_insert(const std::vector<T> &v) {
+    reset_error();
+    return execute_batches(v, [](size_t count) {
+      return generate_insert_rows_sql<T>(db_type, count);
+    });
+  }
 
-      if (insert(t) < 0) {
-        rollback();
-        return INT_MIN;
-      }
+  // only update the given fields by the key, such as:
+  // update_fields(p, &person::name, &person::age)
+  template <typename T, typename... Members>
+  int update_fields(const T &t, Members T::*...members) {
+    reset_error();
+    auto conditions = get_conditions<T>();
+    if (conditions.empty()) {
+      set_last_error("update_fields needs a key");
+      return INT_MIN;
     }
 
-    if (!commit())
+    auto fields = get_update_fields(
+        get_member_names(std::make_tuple(members...)), conditions);
+    if (fields.empty()) {
+      set_last_error("update_fields needs a field which isn't a key");
       return INT_MIN;
+    }
 
-    return (int)v.size();
+    return update_impl(t, fields, conditions);
   }
 
   template <typename T, typename... Args>
   constexpr std::enable_if_t<iguana::is_reflection_v<T>, std::vector<T>> query(
       Args &&...args) {
-    std::string sql = generate_query_sql<T>(std::forward<Args>(args)...);
+    std::vector<T> v;
+    query_rows<T>(v, std::forward<Args>(args)...);
+    return v;
+  }
+
+#ifdef ORMPP_HAS_PMR
+  // as query, but the rows and their std::pmr::string fields are allocated
+  // from mr, such as a std::pmr::monotonic_buffer_resource which releases
+  // them together
+  template <typename T, typename Resource, typename... Args>
+  std::enable_if_t<iguana::is_reflection_v<T> &&
+                       std::is_base_of_v<std::pmr::memory_resource, Resource>,
+                   std::pmr::vector<T>>
+  query(Resource *mr, Args &&...args) {
+    std::pmr::vector<T> v(mr);
+    query_rows<T>(v, std::forward<Args>(args)...);
+    return v;
+  }
+#endif
+
+  // call func(row) with a row_view<T> of each row, its strings and blobs
+  // point into the driver's buffers and are only valid until func returns;
+  // func returns false to stop, and it must not use this connection; the args
+  // are the conditions
+  template <typename T, typename Func, typename... Args>
+  bool for_each_row(Func &&func, Args &&...args) {
+    reset_error();
+    static_assert(!is_selection_args<Args...>::value,
+                  "all the fields are viewed by for_each_row");
+    std::string sql = generate_query_sql<T>(args...);
 #if ORMPP_ENABLE_LOG
     std::cout << sql << std::endl;
 #endif
-    constexpr auto SIZE = iguana::get_value<T>();
+    if (!prepare<T>(sql))
+      return false;
+
+    res_ = PQexec(con_, sql.data());
+    if (PQresultStatus(res_) != PGRES_TUPLES_OK) {
+      set_last_error(PQresultErrorMessage(res_));
+      PQclear(res_);
+      return false;
+    }
 
+    row_view<T> row;
+    auto ntuples = PQntuples(res_);
+    for (auto i = 0; i < ntuples; i++) {
+      iguana::for_each(get_members<T>(), [this, i, &row](auto item, auto I) {
+        constexpr auto Idx = decltype(I)::value;
+        using U = typename field_attribute<decltype(item)>::return_type;
+        auto &field = std::get<Idx>(row.fields());
+        if constexpr (std::is_same_v<view_t<U>, std::string_view>) {
+          field = std::string_view(PQgetvalue(res_, i, (int)Idx),
+                                   PQgetlength(res_, i, (int)Idx));
+        }
+        else {
+          assign(field, i, (int)Idx);
+        }
+      });
+
+      if (!call_row_func(func, row))
+        break;
+    }
+
+    PQclear(res_);
+    return true;
+  }
+
+  // call func(std::vector<T> &&batch) with the rows by batches of
+  // batch_size, they are fetched from a cursor, so only a batch is in memory;
+  // the last batch may be smaller, func returns false to stop, the args are
+  // the conditions
+  template <typename T, typename Func, typename... Args>
+  bool for_each_batch(size_t batch_size, Func &&func, Args &&...args) {
+    reset_error();
+    std::string sql = generate_query_sql<T>(args...);
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
+    auto members = get_members<T>(args...);
+
+    // a cursor lives in a transaction
+    if (!begin())
+      return false;
+
+    if (!execute("declare ormpp_cursor no scroll cursor for " + sql)) {
+      rollback();
+      return false;
+    }
+
+    size_t count = (std::max)(batch_size, size_t(1));
+    std::string fetch = "fetch " + std::to_string(count) + " from ormpp_cursor";
+    bool ok = true;
+    try {
+      while (true) {
+        res_ = PQexec(con_, fetch.data());
+        if (PQresultStatus(res_) != PGRES_TUPLES_OK) {
+          set_last_error(PQresultErrorMessage(res_));
+          PQclear(res_);
+          ok = false;
+          break;
+        }
+
+        auto ntuples = PQntuples(res_);
+        std::vector<T> batch(ntuples);
+        decode_rows(ntuples, [this, &batch, &members](int i) {
+          iguana::for_each(members, [this, i, &batch](auto item, auto I) {
+            assign(batch[i].*item, i, (int)decltype(I)::value);
+          });
+        });
+        PQclear(res_);
+
+        // a short batch is the last one
+        if (batch.empty() || !call_row_func(func, std::move(batch)) ||
+            (size_t)ntuples < count)
+          break;
+      }
+    } catch (...) {
+      // the rollback of a nested transaction doesn't close the cursor
+      PQclear(PQexec(con_, "close ormpp_cursor"));
+      rollback();
+      throw;
+    }
+
+    if (!ok || !execute("close ormpp_cursor")) {
+      rollback();
+      return false;
+    }
+    return commit();
+  }
+
+  // as query, but the rows are decoded by column, the args are the conditions
+  template <typename T, typename... Args>
+  columns<T> query_columns(Args &&...args) {
+    reset_error();
+    static_assert(!is_selection_args<Args...>::value,
+                  "all the fields are decoded by query_columns");
+    std::string sql = generate_query_sql<T>(args...);
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
     if (!prepare<T>(sql))
       return {};
 
     res_ = PQexec(con_, sql.data());
     if (PQresultStatus(res_) != PGRES_TUPLES_OK) {
+      set_last_error(PQresultErrorMessage(res_));
       PQclear(res_);
       return {};
     }
 
-    std::vector<T> v;
+    columns<T> cols;
     auto ntuples = PQntuples(res_);
-
-    for (auto i = 0; i < ntuples; i++) {
-      T t = {};
-      iguana::for_each(t, [this, i, &t](auto item, auto I) {
-        assign(t.*item, i, (int)decltype(I)::value);
+    cols.reserve(ntuples);
+    for (auto row = 0; row < ntuples; row++) {
+      iguana::for_each(get_members<T>(), [this, row, &cols](auto item,
+                                                            auto I) {
+        constexpr auto Idx = decltype(I)::value;
+        using U = typename field_attribute<decltype(item)>::return_type;
+        auto &column = cols.template get<Idx>();
+        if constexpr (std::is_same_v<column_t<U>, string_column>) {
+          column.push_back(std::string_view(PQgetvalue(res_, row, (int)Idx),
+                                            PQgetlength(res_, row, (int)Idx)));
+        }
+        else {
+          U value{};
+          assign(value, row, (int)Idx);
+          column.push_back(std::move(value));
+        }
       });
-      v.push_back(std::move(t));
+      cols.add_row();
     }
 
     PQclear(res_);
 
-    return v;
+    return cols;
   }
 
   template <typename T, typename Arg, typename... Args>
   constexpr std::enable_if_t<!iguana::is_reflection_v<T>, std::vector<T>> query(
       const Arg &s, Args &&...args) {
+    reset_error();
     static_assert(iguana::is_tuple<T>::value);
     constexpr auto SIZE = std::tuple_size_v<T>;
 
@@ -218,33 +493,34 @@ class postgresql {
 #endif
     constexpr auto Args_Size = sizeof...(Args);
     if (Args_Size != 0) {
-      if (Args_Size != std::count(sql.begin(), sql.end(), '$'))
+      if (get_params_size(args...) !=
+          (size_t)std::count(sql.begin(), sql.end(), '$')) {
+        set_last_error("the args don't match the placeholders");
         return {};
-
-      sql = get_sql(sql, std::forward<Args>(args)...);
+      }
     }
 
-    if (!prepare<T>(sql))
+    std::vector<std::vector<char>> param_values;
+    (set_param_values(param_values, std::forward<Args>(args)), ...);
+    if (!exec_params(sql, param_values))
       return {};
 
-    res_ = PQexec(con_, sql.data());
     if (PQresultStatus(res_) != PGRES_TUPLES_OK) {
+      set_last_error(PQresultErrorMessage(res_));
       PQclear(res_);
       return {};
     }
 
-    std::vector<T> v;
     auto ntuples = PQntuples(res_);
-
-    for (auto i = 0; i < ntuples; i++) {
-      T tp = {};
+    std::vector<T> v(ntuples);
+    decode_rows(ntuples, [this, &v](int i) {
       int index = 0;
       iguana::for_each(
-          tp,
+          v[i],
           [this, i, &index](auto &item, auto I) {
             if constexpr (iguana::is_reflection_v<decltype(item)>) {
               std::remove_reference_t<decltype(item)> t = {};
-              iguana::for_each(t, [this, &index, &t](auto ele, auto i) {
+              iguana::for_each(t, [this, i, &index, &t](auto ele, auto) {
                 assign(t.*ele, (int)i, index++);
               });
               item = std::move(t);
@@ -254,8 +530,7 @@ class postgresql {
             }
           },
           std::make_index_sequence<SIZE>{});
-      v.push_back(std::move(tp));
-    }
+    });
 
     PQclear(res_);
 
@@ -264,12 +539,14 @@ class postgresql {
 
   template <typename T, typename... Args>
   constexpr bool delete_records(Args &&...where_conditon) {
+    reset_error();
     auto sql = generate_delete_sql<T>(std::forward<Args>(where_conditon)...);
 #if ORMPP_ENABLE_LOG
     std::cout << sql << std::endl;
 #endif
     res_ = PQexec(con_, sql.data());
     if (PQresultStatus(res_) != PGRES_COMMAND_OK) {
+      set_last_error(PQresultErrorMessage(res_));
       PQclear(res_);
       return false;
     }
@@ -280,33 +557,79 @@ class postgresql {
 
   // just support execute string sql without placeholders
   auto execute(const std::string &sql) {
+    reset_error();
     res_ = PQexec(con_, sql.data());
     auto guard = guard_result(res_);
     if (PQresultStatus(res_) != PGRES_COMMAND_OK) {
-      //                std::cout<<PQerrorMessage(con_)<<std::endl;
+      set_last_error(PQerrorMessage(con_));
+      return false;
+    }
+
+    return true;
+  }
+
+  // execute sql with placeholders, the args are bound as statement parameters
+  template <typename Arg, typename... Args>
+  bool execute(const std::string &sql, Arg &&arg, Args &&...args) {
+    reset_error();
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
+    std::vector<std::vector<char>> param_values;
+    set_param_values(param_values, std::forward<Arg>(arg));
+    (set_param_values(param_values, std::forward<Args>(args)), ...);
+    if (!exec_params(sql, param_values))
+      return false;
+
+    auto status = PQresultStatus(res_);
+    if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK) {
+      set_last_error(PQresultErrorMessage(res_));
+      PQclear(res_);
       return false;
     }
 
+    PQclear(res_);
     return true;
   }
 
   // transaction
+  // the transactions can be nested, only the outermost one is sent to the
+  // database, a rollback of an inner one makes the outermost one roll back
   bool begin() {
+    if (transaction_depth_ > 0) {
+      ++transaction_depth_;
+      return true;
+    }
+
     res_ = PQexec(con_, "begin;");
     auto guard = guard_result(res_);
     if (PQresultStatus(res_) != PGRES_COMMAND_OK) {
-      //                std::cout<<PQerrorMessage(con_)<<std::endl;
+      set_last_error(PQerrorMessage(con_));
       return false;
     }
 
+    transaction_depth_ = 1;
     return true;
   }
 
   bool commit() {
+    if (transaction_depth_ > 1) {
+      --transaction_depth_;
+      return true;
+    }
+
+    transaction_depth_ = 0;
+    if (rollback_only_) {
+      rollback_only_ = false;
+      PQclear(PQexec(con_, "rollback;"));
+      set_last_error("rolled back by an inner transaction");
+      return false;
+    }
+
     res_ = PQexec(con_, "commit;");
     auto guard = guard_result(res_);
     if (PQresultStatus(res_) != PGRES_COMMAND_OK) {
-      //                std::cout<<PQerrorMessage(con_)<<std::endl;
+      set_last_error(PQerrorMessage(con_));
       return false;
     }
 
@@ -314,10 +637,18 @@ class postgresql {
   }
 
   bool rollback() {
+    if (transaction_depth_ > 1) {
+      --transaction_depth_;
+      rollback_only_ = true;
+      return true;
+    }
+
+    transaction_depth_ = 0;
+    rollback_only_ = false;
     res_ = PQexec(con_, "rollback;");
     auto guard = guard_result(res_);
     if (PQresultStatus(res_) != PGRES_COMMAND_OK) {
-      //                std::cout<<PQerrorMessage(con_)<<std::endl;
+      set_last_error(PQerrorMessage(con_));
       return false;
     }
 
@@ -390,8 +721,7 @@ class postgresql {
         std::string("CREATE TABLE IF NOT EXISTS ") + name.data() + "(";
     auto arr = iguana::get_array<T>();
     constexpr const size_t SIZE = sizeof...(Args);
-    auto_key_map_[name.data()] = "";
-    key_map_[name.data()] = "";
+    table_keys keys;
 
     // auto_increment_key and key can't exist at the same time
     using U = std::tuple<std::decay_t<Args>...>;
@@ -411,7 +741,7 @@ class postgresql {
       bool has_add_field = false;
       iguana::for_each(
           tp,
-          [&sql, &i, &has_add_field, field_name, type_name_arr, name, this](
+          [&sql, &i, &has_add_field, &keys, field_name, type_name_arr](
               auto item, auto I) {
             if constexpr (std::is_same_v<decltype(item), ormpp_not_null>) {
               if (item.fields.find(field_name.data()) == item.fields.end())
@@ -437,7 +767,7 @@ class postgresql {
               }
               append(sql, " PRIMARY KEY ");
 
-              key_map_[name.data()] = item.fields;
+              keys.key = item.fields;
             }
             else if constexpr (std::is_same_v<decltype(item), ormpp_auto_key>) {
               if (!has_add_field) {
@@ -445,8 +775,8 @@ class postgresql {
                 has_add_field = true;
               }
               append(sql, " serial primary key");
-              auto_key_map_[name.data()] = item.fields;
-              key_map_[name.data()] = item.fields;
+              keys.auto_key = item.fields;
+              keys.key = item.fields;
             }
             else if constexpr (std::is_same_v<decltype(item), ormpp_unique>) {
               if (!has_add_field) {
@@ -471,6 +801,8 @@ class postgresql {
     }
 
     sql += ")";
+    // publish the keys at once, the readers never see a half set table
+    table_keys_registry::instance().set(database_, name, std::move(keys));
 
     return sql;
   }
@@ -480,7 +812,7 @@ class postgresql {
     res_ =
         PQprepare(con_, "", sql.data(), (int)iguana::get_value<T>(), nullptr);
     if (PQresultStatus(res_) != PGRES_COMMAND_OK) {
-      std::cout << PQresultErrorMessage(res_) << std::endl;
+      set_last_error(PQresultErrorMessage(res_));
       PQclear(res_);
       return false;
     }
@@ -489,6 +821,27 @@ class postgresql {
     return true;
   }
 
+  // prepare and execute sql in one round trip, the result is left in res_
+  bool exec_params(const std::string &sql,
+                   const std::vector<std::vector<char>> &param_values) {
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
+    std::vector<const char *> param_values_buf;
+    for (auto &item : param_values) {
+      param_values_buf.push_back(item.data());
+    }
+
+    res_ = PQexecParams(con_, sql.data(), (int)param_values_buf.size(), nullptr,
+                        param_values_buf.data(), nullptr, nullptr, 0);
+    if (res_ == nullptr) {
+      set_last_error(PQerrorMessage(con_));
+      return false;
+    }
+
+    return true;
+  }
+
   template <typename T>
   std::string generate_pq_insert_sql(bool replace) {
     std::string sql = replace ? "replace into " : "insert into ";
@@ -516,18 +869,17 @@ class postgresql {
     std::cout << sql << std::endl;
 #endif
     std::vector<std::vector<char>> param_values;
-    auto it = auto_key_map_.find(iguana::get_name<T>().data());
-    std::string auto_key = (it == auto_key_map_.end()) ? "" : it->second;
-
     iguana::for_each(t,
-                     [&t, &param_values, &auto_key, this](auto item, auto i) {
+                     [&t, &param_values, this](auto item, auto i) {
                        /*if(!auto_key.empty()&&auto_key==iguana::get_name<T>(decltype(i)::value).data())
                            return;*/
                        set_param_values(param_values, t.*item);
                      });
 
-    if (param_values.empty())
+    if (param_values.empty()) {
+      set_last_error("there is no field to insert");
       return INT_MIN;
+    }
 
     std::vector<const char *> param_values_buf;
     for (auto &item : param_values) {
@@ -538,7 +890,7 @@ class postgresql {
                           param_values_buf.data(), NULL, NULL, 0);
 
     if (PQresultStatus(res_) != PGRES_COMMAND_OK) {
-      std::cout << PQresultErrorMessage(res_) << std::endl;
+      set_last_error(PQresultErrorMessage(res_));
       PQclear(res_);
       return INT_MIN;
     }
@@ -552,7 +904,12 @@ class postgresql {
   constexpr void set_param_values(std::vector<std::vector<char>> &param_values,
                                   T &&value) {
     using U = std::remove_const_t<std::remove_reference_t<T>>;
-    if constexpr (std::is_integral_v<U> && !iguana::is_int64_v<U>) {
+    if constexpr (is_param_list<U>::value) {
+      for (auto &item : value) {
+        set_param_values(param_values, item);
+      }
+    }
+    else if constexpr (std::is_integral_v<U> && !iguana::is_int64_v<U>) {
       std::vector<char> temp(20, 0);
       itoa_fwd(value, temp.data());
       param_values.push_back(std::move(temp));
@@ -567,13 +924,24 @@ class postgresql {
       sprintf(temp.data(), "%f", value);
       param_values.push_back(std::move(temp));
     }
-    else if constexpr (std::is_same_v<std::string, U>) {
+    else if constexpr (is_string_v<U>) {
       std::vector<char> temp = {};
       std::copy(value.data(), value.data() + value.size() + 1,
                 std::back_inserter(temp));
       //                    std::cout<<value.size()<<std::endl;
       param_values.push_back(std::move(temp));
     }
+    else if constexpr (std::is_same_v<std::string_view, U>) {
+      std::vector<char> temp(value.begin(), value.end());
+      temp.push_back('\0');
+      param_values.push_back(std::move(temp));
+    }
+    else if constexpr (std::is_same_v<const char *, U> ||
+                       std::is_same_v<char *, U>) {
+      std::vector<char> temp = {};
+      std::copy(value, value + strlen(value) + 1, std::back_inserter(temp));
+      param_values.push_back(std::move(temp));
+    }
     else if constexpr (is_char_array_v<U>) {
       std::vector<char> temp = {};
       std::copy(value, value + sizeof(U), std::back_inserter(temp));
@@ -584,6 +952,77 @@ class postgresql {
     }
   }
 
+  template <typename T, typename Rows, typename... Args>
+  void query_rows(Rows &v, Args &&...args) {
+    reset_error();
+    std::string sql = generate_query_sql<T>(args...);
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
+    auto members = get_members<T>(args...);
+
+    if (!prepare<T>(sql))
+      return;
+
+    res_ = PQexec(con_, sql.data());
+    if (PQresultStatus(res_) != PGRES_TUPLES_OK) {
+      set_last_error(PQresultErrorMessage(res_));
+      PQclear(res_);
+      return;
+    }
+
+    auto ntuples = PQntuples(res_);
+    if constexpr (std::is_same_v<Rows, std::vector<T>>) {
+      // the rows are decoded into their slots, maybe in parallel
+      v.resize(ntuples);
+      decode_rows(ntuples, [this, &v, &members](int i) {
+        iguana::for_each(members, [this, i, &v](auto item, auto I) {
+          assign(v[i].*item, i, (int)decltype(I)::value);
+        });
+      });
+    }
+    else {
+      // the memory resource of v may not be thread safe
+      v.reserve(ntuples);
+      for (auto i = 0; i < ntuples; i++) {
+        T t = make_row<T>(v);
+        iguana::for_each(members, [this, i, &t](auto item, auto I) {
+          assign(t.*item, i, (int)decltype(I)::value);
+        });
+        v.push_back(std::move(t));
+      }
+    }
+
+    PQclear(res_);
+  }
+
+  // call decode(row) for the rows of res_, the ranges of rows are decoded by
+  // the threads of the pool if there are at least parallel_threshold_ rows, a
+  // PGresult can be read by many threads
+  template <typename Func>
+  void decode_rows(int count, const Func &decode) {
+    size_t threads = parallel_threads_ != 0
+                         ? parallel_threads_
+                         : (size_t)std::thread::hardware_concurrency();
+    if (parallel_threshold_ == 0 || (size_t)count < parallel_threshold_ ||
+        threads < 2) {
+      for (int i = 0; i < count; i++) {
+        decode(i);
+      }
+      return;
+    }
+
+    size_t chunk = (count + threads - 1) / threads;
+    size_t ranges = (count + chunk - 1) / chunk;
+    thread_pool::instance().parallel_for(
+        ranges, threads - 1, [&decode, chunk, count](size_t range) {
+          int end = (int)(std::min)((range + 1) * chunk, (size_t)count);
+          for (int i = (int)(range * chunk); i < end; i++) {
+            decode(i);
+          }
+        });
+  }
+
   template <typename T>
   constexpr void assign(T &&value, int row, int i) {
     using U = std::remove_const_t<std::remove_reference_t<T>>;
@@ -596,8 +1035,8 @@ class postgresql {
     else if constexpr (std::is_floating_point_v<U>) {
       value = std::atof(PQgetvalue(res_, row, i));
     }
-    else if constexpr (std::is_same_v<std::string, U>) {
-      value = PQgetvalue(res_, row, i);
+    else if constexpr (is_string_v<U>) {
+      value.assign(PQgetvalue(res_, row, i), PQgetlength(res_, row, i));
     }
     else if constexpr (is_char_array_v<U>) {
       auto p = PQgetvalue(res_, row, i);
@@ -608,56 +1047,197 @@ class postgresql {
     }
   }
 
+  // the keys of T in the database, see table_keys_registry
+  template <typename T>
+  table_keys get_table_keys() {
+    return table_keys_registry::instance().get(database_,
+                                               iguana::get_name<T>());
+  }
+
   template <typename T, typename... Args>
-  constexpr std::string get_condition(const T &t, const std::string &key,
-                                      Args &&...args) {
-    std::string result = "";
-    constexpr auto SIZE = iguana::get_value<T>();
-    iguana::for_each(t, [&](auto &item, auto i) {
-      constexpr auto Idx = decltype(i)::value;
-      using U = std::remove_reference_t<decltype(iguana::get<Idx>(
-          std::declval<T>()))>;
-      if (!key.empty() && key == iguana::get_name<T, Idx>().data()) {
-        if constexpr (std::is_arithmetic_v<U>) {
-          append(result, iguana::get_name<T, Idx>().data(), "=",
-                 std::to_string(t.*item));
-        }
-        else if constexpr (std::is_same_v<std::string, U>) {
-          append(result, iguana::get_name<T, Idx>().data(), "=", t.*item);
-        }
+  std::vector<std::string> get_conditions(Args &&...args) {
+    std::vector<std::string> conditions;
+    auto key = get_table_keys<T>().key;
+    if (!key.empty())
+      conditions.push_back(std::move(key));
+
+    if constexpr (sizeof...(Args) > 0) {
+      auto add = [&conditions](std::string field) {
+        if (std::find(conditions.begin(), conditions.end(), field) ==
+            conditions.end())
+          conditions.push_back(std::move(field));
+      };
+      (add(std::forward<Args>(args)), ...);
+    }
+    return conditions;
+  }
+
+  // the rows are sent in chunks in one transaction, make_sql(count) generates
+  // the statement of a chunk of count rows
+  template <typename T, typename Func>
+  int execute_batches(const std::vector<T> &v, Func make_sql) {
+    if (v.empty())
+      return 0;
+
+    if (!begin())
+      return INT_MIN;
+
+    constexpr size_t batch_rows = get_batch_rows<T>();
+    for (size_t i = 0; i < v.size(); i += batch_rows) {
+      size_t count = (std::min)(batch_rows, v.size() - i);
+      if (!execute_rows(make_sql(count), v.data() + i, count)) {
+        rollback();
+        return INT_MIN;
       }
+    }
 
-      // if constexpr (sizeof...(Args)>0){
-      build_condition_by_key<T, Idx>(result, t.*item, args...);
-      //(test(args), ...);
-      //	(build_condition_by_key_impl(result, t.*item, args),...);
-      ////can't pass U in vs2017
-      //}
+    if (!commit())
+      return INT_MIN;
+
+    return (int)v.size();
+  }
+
+  // execute sql with all the fields of the rows bound in order
+  template <typename T>
+  bool execute_rows(const std::string &sql, const T *rows, size_t count) {
+    std::vector<std::vector<char>> param_values;
+    for (size_t row = 0; row < count; ++row) {
+      auto &t = rows[row];
+      iguana::for_each(t, [&t, &param_values, this](auto item, auto) {
+        set_param_values(param_values, t.*item);
+      });
+    }
+
+    if (!exec_params(sql, param_values))
+      return false;
+
+    auto guard = guard_result(res_);
+    if (PQresultStatus(res_) != PGRES_COMMAND_OK) {
+      set_last_error(PQresultErrorMessage(res_));
+      return false;
+    }
+
+    return true;
+  }
+
+  // insert the rows without the auto key and return the generated keys
+  template <typename T>
+  std::vector<uint64_t> insert_returning_ids(const T *rows, size_t count) {
+    auto auto_key = get_auto_key<T>();
+    if (auto_key.empty()) {
+      set_last_error("there is no auto key");
+      return {};
+    }
+
+    std::vector<std::vector<char>> param_values;
+    for (size_t row = 0; row < count; ++row) {
+      auto &t = rows[row];
+      iguana::for_each(t, [&t, &param_values, &auto_key, this](auto item,
+                                                               auto i) {
+        if (iguana::get_name<T>(decltype(i)::value) == auto_key)
+          return;
+        set_param_values(param_values, t.*item);
+      });
+    }
+
+    auto sql = generate_insert_rows_sql<T>(db_type, count, auto_key);
+    sql.append(" returning ").append(auto_key);
+    if (!exec_params(sql, param_values))
+      return {};
+
+    auto guard = guard_result(res_);
+    if (PQresultStatus(res_) != PGRES_TUPLES_OK) {
+      set_last_error(PQresultErrorMessage(res_));
+      return {};
+    }
+
+    std::vector<uint64_t> ids;
+    ids.reserve(count);
+    int ntuples = PQntuples(res_);
+    for (int i = 0; i < ntuples; ++i) {
+      ids.push_back(std::strtoull(PQgetvalue(res_, i, 0), nullptr, 10));
+    }
+
+    return ids;
+  }
+
+  template <typename T, size_t N>
+  bool update_execute(const T &t, const std::array<size_t, N> &positions,
+                      size_t count) {
+    std::vector<std::vector<char>> param_values(count);
+    iguana::for_each(t, [&t, &positions, &param_values, this](auto item,
+                                                             auto i) {
+      constexpr auto Idx = decltype(i)::value;
+      if (positions[Idx] == 0)
+        return;
+
+      std::vector<std::vector<char>> temp;
+      set_param_values(temp, t.*item);
+      if (!temp.empty())
+        param_values[positions[Idx] - 1] = std::move(temp.front());
     });
 
-    return result;
+    std::vector<const char *> param_values_buf;
+    for (auto &item : param_values) {
+      param_values_buf.push_back(item.empty() ? nullptr : item.data());
+    }
+
+    res_ = PQexecPrepared(con_, "", (int)param_values_buf.size(),
+                          param_values_buf.data(), NULL, NULL, 0);
+    auto guard = guard_result(res_);
+    if (PQresultStatus(res_) != PGRES_COMMAND_OK) {
+      set_last_error(PQresultErrorMessage(res_));
+      return false;
+    }
+
+    return true;
   }
 
-  template <typename T, size_t Idx, typename V, typename... Args>
-  void build_condition_by_key(std::string &result, const V &t, Args... args) {
-    (build_condition_by_key<T, Idx>(result, t, args), ...);
+  template <typename T>
+  int update_impl(const T &t, const std::vector<std::string_view> &fields,
+                  const std::vector<std::string> &conditions) {
+    auto sql = generate_update_sql<T>(db_type, fields, conditions);
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
+    if (!prepare<T>(sql))
+      return INT_MIN;
+
+    auto positions = get_update_positions<T>(fields, conditions);
+    if (!update_execute(t, positions, fields.size() + conditions.size()))
+      return INT_MIN;
+
+    return 1;
   }
 
-  template <typename T, size_t Idx, typename V, typename W>
-  void build_condition_by_key_impl(std::string &result, const V &val, W &key) {
-    using U =
-        std::remove_reference_t<decltype(iguana::get<Idx>(std::declval<T>()))>;
-    if (key == iguana::get_name<T, Idx>().data()) {
-      if constexpr (std::is_arithmetic_v<U>) {
-        append(result, " and ");
-        append(result, iguana::get_name<T, Idx>().data(), "=",
-               std::to_string(val));
-      }
-      else if constexpr (std::is_same_v<std::string, U>) {
-        append(result, " and ");
-        append(result, iguana::get_name<T, Idx>().data(), "=", val);
+  template <typename T>
+  int update_impl(const std::vector<T> &v,
+                  const std::vector<std::string_view> &fields,
+                  const std::vector<std::string> &conditions) {
+    auto sql = generate_update_sql<T>(db_type, fields, conditions);
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
+    if (!begin())
+      return INT_MIN;
+
+    if (!prepare<T>(sql)) {
+      rollback();
+      return INT_MIN;
+    }
+
+    auto positions = get_update_positions<T>(fields, conditions);
+    for (auto &t : v) {
+      if (!update_execute(t, positions, fields.size() + conditions.size())) {
+        rollback();
+        return INT_MIN;
       }
     }
+
+    if (!commit())
+      return INT_MIN;
+
+    return (int)v.size();
   }
 
   template <typename T>
@@ -669,8 +1249,6 @@ class postgresql {
 
     std::string fields = "(";
     std::string values = " values(";
-    auto it = auto_key_map_.find(name.data());
-
     int index = 0;
     for (auto i = 0; i < SIZE; ++i) {
       std::string field_name = iguana::get_name<T>(i).data();
@@ -699,8 +1277,16 @@ class postgresql {
 
   PGresult *res_ = nullptr;
   PGconn *con_ = nullptr;
-  std::map<std::string, std::string> auto_key_map_;
-  std::map<std::string, std::string> key_map_;
+  // see get_database_id
+  std::string database_;
+  std::string last_error_;
+  bool has_error_ = false;
+  // the depth of the nested transactions
+  int transaction_depth_ = 0;
+  bool rollback_only_ = false;
+  // see set_parallel_decode
+  size_t parallel_threshold_ = 0;
+  size_t parallel_threads_ = 0;
 };
 }  // namespace ormpp
 #endif  // ORM_POSTGRESQL_HPP
\ No newline at end of file
@@ -0,0 +1,383 @@
+#ifndef ORMPP_QUERY_CACHE_HPP
+#define ORMPP_QUERY_CACHE_HPP
+
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "utility.hpp"
+
+namespace ormpp {
+struct query_cache_stats {
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t evictions = 0;
+  size_t entries = 0;
+  size_t bytes = 0;
+};
+
+// the names of the tables a statement reads or writes, they are the names
+// after from, join, into and update, such as "select * from a, b join c"
+inline std::vector<std::string> get_sql_tables(std::string_view sql) {
+  std::vector<std::string> tokens;
+  for (size_t i = 0; i < sql.size();) {
+    char c = sql[i];
+    if (c == '\'') {
+      // skip the string literal
+      for (++i; i < sql.size() && sql[i] != '\''; ++i) {
+      }
+      ++i;
+    }
+    else if (std::isalnum((unsigned char)c) || c == '_' || c == '`' ||
+             c == '"') {
+      std::string token;
+      for (; i < sql.size(); ++i) {
+        char ch = sql[i];
+        if (ch == '`' || ch == '"')
+          continue;
+        if (!std::isalnum((unsigned char)ch) && ch != '_' && ch != '.')
+          break;
+        token += (char)std::tolower((unsigned char)ch);
+      }
+      tokens.push_back(std::move(token));
+    }
+    else {
+      if (c == ',' || c == '(' || c == ')')
+        tokens.emplace_back(1, c);
+      ++i;
+    }
+  }
+
+  static const std::unordered_set<std::string> keywords = {
+      "where", "join",  "inner", "left",  "right",     "full",
+      "cross", "on",    "group", "order", "limit",     "having",
+      "union", "set",   "using", "as",    "returning", "values",
+      "select"};
+  std::vector<std::string> tables;
+  auto add_table = [&tables](std::string name) {
+    auto pos = name.rfind('.');
+    if (pos != std::string::npos)
+      name = name.substr(pos + 1);
+    for (auto &table : tables) {
+      if (table == name)
+        return;
+    }
+    tables.push_back(std::move(name));
+  };
+  auto is_name = [](const std::string &token) {
+    return !token.empty() && token[0] != ',' && token[0] != '(' &&
+           token[0] != ')' && keywords.count(token) == 0;
+  };
+
+  for (size_t i = 0; i + 1 < tokens.size(); ++i) {
+    auto &token = tokens[i];
+    if (token != "from" && token != "join" && token != "into" &&
+        token != "update")
+      continue;
+
+    if (!is_name(tokens[i + 1]))
+      continue;
+    add_table(tokens[++i]);
+    if (token != "from")
+      continue;
+
+    // from a x, b as y
+    while (i + 1 < tokens.size()) {
+      auto &next = tokens[i + 1];
+      if (next == "," && i + 2 < tokens.size() && is_name(tokens[i + 2])) {
+        add_table(tokens[i + 2]);
+        i += 2;
+      }
+      else if (next == "as" || (is_name(next) && next != "from")) {
+        ++i;
+      }
+      else {
+        break;
+      }
+    }
+  }
+
+  return tables;
+}
+
+// append a statement to the key of a query, the whitespaces out of the string
+// literals are collapsed, the literals are copied as they are
+inline void append_query_sql(std::string &key, std::string_view sql) {
+  key += "\ns:";
+  size_t start = key.size();
+  bool space = false;
+  for (size_t i = 0; i < sql.size(); ++i) {
+    char c = sql[i];
+    if (std::isspace((unsigned char)c)) {
+      space = true;
+      continue;
+    }
+    if (space && key.size() > start)
+      key += ' ';
+    space = false;
+    key += c;
+    if (c != '\'')
+      continue;
+
+    // a backslash may escape a quote in mysql, so it keeps the next char
+    for (++i; i < sql.size(); ++i) {
+      key += sql[i];
+      if (sql[i] == '\\' && i + 1 < sql.size())
+        key += sql[++i];
+      else if (sql[i] == '\'')
+        break;
+    }
+  }
+}
+
+// append a param to the key of a query
+template <typename Arg>
+inline void append_query_key(std::string &key, const Arg &arg) {
+  using U = std::decay_t<Arg>;
+  key += '\n';
+  if constexpr (std::is_floating_point_v<U>) {
+    char buf[32];
+    int n = std::snprintf(buf, sizeof(buf), "%.17g", (double)arg);
+    key.append(buf, n);
+  }
+  else if constexpr (std::is_arithmetic_v<U>) {
+    key += std::to_string(arg);
+  }
+  else if constexpr (std::is_convertible_v<const U &, std::string_view>) {
+    std::string_view str(arg);
+    key += std::to_string(str.size());
+    key += ':';
+    key += str;
+  }
+  else if constexpr (is_param_list<U>::value) {
+    key += std::to_string(arg.size());
+    for (auto &item : arg) {
+      append_query_key(key, item);
+    }
+  }
+  else if constexpr (std::is_same_v<U, std::vector<char>>) {
+    key += std::to_string(arg.size());
+    key += ':';
+    key.append(arg.begin(), arg.end());
+  }
+  else {
+    static_assert(!sizeof(U), "the arg can't be a key of the query cache");
+  }
+}
+
+// the approximate memory of a decoded value
+template <typename U>
+inline size_t get_value_bytes(const U &value) {
+  if constexpr (is_string_v<U>) {
+    return sizeof(U) + value.capacity();
+  }
+  else if constexpr (iguana::is_reflection_v<U>) {
+    size_t bytes = 0;
+    iguana::for_each(value, [&value, &bytes](auto item, auto) {
+      bytes += get_value_bytes(value.*item);
+    });
+    return bytes;
+  }
+  else if constexpr (iguana::is_tuple<U>::value) {
+    return std::apply(
+        [](auto &...item) {
+          return (size_t(0) + ... + get_value_bytes(item));
+        },
+        value);
+  }
+  else if constexpr (is_optional_v<U>::value) {
+    return value ? get_value_bytes(*value) : sizeof(U);
+  }
+  else if constexpr (std::is_same_v<U, std::vector<char>>) {
+    return sizeof(U) + value.capacity();
+  }
+  else {
+    return sizeof(U);
+  }
+}
+
+// the decoded rows of the queries keyed by the statement and the params, the
+// rows are shared and immutable, so a hit doesn't copy them; an entry is
+// evicted when a table it reads is written, it expires or the memory budget
+// is used up
+class query_cache {
+ public:
+  // a ttl of 0 means the entries never expire
+  void configure(size_t max_bytes, std::chrono::milliseconds ttl) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    max_bytes_ = max_bytes;
+    ttl_ = ttl;
+    shrink();
+  }
+
+  template <typename R>
+  std::shared_ptr<const std::vector<R>> get(const std::string &key) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end() || it->second->type != &typeid(R)) {
+      ++misses_;
+      return nullptr;
+    }
+
+    auto node = it->second;
+    if (ttl_.count() > 0 && std::chrono::steady_clock::now() > node->expire) {
+      erase(node);
+      ++misses_;
+      return nullptr;
+    }
+
+    lru_.splice(lru_.begin(), lru_, node);
+    ++hits_;
+    return std::static_pointer_cast<const std::vector<R>>(node->rows);
+  }
+
+  // the versions of the tables before the query, the rows are only put if no
+  // table is written since then
+  std::vector<uint64_t> versions(const std::vector<std::string> &tables) {
+    used_ = true;
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::vector<uint64_t> result;
+    for (auto &table : tables) {
+      result.push_back(table_versions_[table]);
+    }
+    return result;
+  }
+
+  template <typename R>
+  void put(const std::string &key, std::shared_ptr<const std::vector<R>> rows,
+           const std::vector<std::string> &tables,
+           const std::vector<uint64_t> &versions) {
+    size_t bytes = key.size() + sizeof(std::vector<R>);
+    for (auto &row : *rows) {
+      bytes += get_value_bytes(row);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < tables.size(); ++i) {
+      if (table_versions_[tables[i]] != versions[i])
+        return;
+    }
+    if (bytes > max_bytes_)
+      return;
+
+    auto it = index_.find(key);
+    if (it != index_.end())
+      erase(it->second);
+
+    lru_.push_front(entry{key, &typeid(R), rows, tables, bytes,
+                          std::chrono::steady_clock::now() + ttl_});
+    index_.emplace(key, lru_.begin());
+    for (auto &table : tables) {
+      table_entries_[table].insert(key);
+    }
+    bytes_ += bytes;
+    shrink();
+  }
+
+  // evict the entries which read the table
+  void invalidate(const std::string &table) {
+    if (!used_)
+      return;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    ++table_versions_[table];
+    auto it = table_entries_.find(table);
+    if (it == table_entries_.end())
+      return;
+
+    auto keys = std::move(it->second);
+    table_entries_.erase(it);
+    for (auto &key : keys) {
+      auto entry_it = index_.find(key);
+      if (entry_it != index_.end()) {
+        erase(entry_it->second);
+        ++evictions_;
+      }
+    }
+  }
+
+  void clear() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (auto &item : table_versions_) {
+      ++item.second;
+    }
+    lru_.clear();
+    index_.clear();
+    table_entries_.clear();
+    bytes_ = 0;
+  }
+
+  query_cache_stats stats() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return {hits_, misses_, evictions_, index_.size(), bytes_};
+  }
+
+ private:
+  struct entry {
+    std::string key;
+    const std::type_info *type;
+    std::shared_ptr<const void> rows;
+    std::vector<std::string> tables;
+    size_t bytes;
+    std::chrono::steady_clock::time_point expire;
+  };
+
+  void erase(std::list<entry>::iterator node) {
+    for (auto &table : node->tables) {
+      auto it = table_entries_.find(table);
+      if (it != table_entries_.end())
+        it->second.erase(node->key);
+    }
+    bytes_ -= node->bytes;
+    index_.erase(node->key);
+    lru_.erase(node);
+  }
+
+  void shrink() {
+    while (bytes_ > max_bytes_ && !lru_.empty()) {
+      erase(std::prev(lru_.end()));
+      ++evictions_;
+    }
+  }
+
+  // the writes needn't lock before the cache is used
+  std::atomic<bool> used_ = false;
+  std::mutex mutex_;
+  size_t max_bytes_ = 64 * 1024 * 1024;
+  std::chrono::milliseconds ttl_ = std::chrono::seconds(60);
+  std::list<entry> lru_;
+  std::unordered_map<std::string, std::list<entry>::iterator> index_;
+  std::unordered_map<std::string, std::unordered_set<std::string>>
+      table_entries_;
+  std::unordered_map<std::string, uint64_t> table_versions_;
+  size_t bytes_ = 0;
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+  size_t evictions_ = 0;
+};
+
+// the query cache shared by all the connections of DB in the process, the
+// keys and the tables of dbng start with the database of the connection
+template <typename DB>
+inline query_cache &get_query_cache() {
+  static query_cache cache;
+  return cache;
+}
+}  // namespace ormpp
+
+#endif  // ORMPP_QUERY_CACHE_HPP
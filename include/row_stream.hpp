@@ -0,0 +1,124 @@
+#ifndef ORMPP_ROW_STREAM_HPP
+#define ORMPP_ROW_STREAM_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace ormpp {
+// the batches of rows fetched and decoded by a thread while the consumer
+// processes the previous ones, at most max_batches batches wait in the queue,
+// so the memory stays bounded, such as:
+// auto stream = conn.query_stream<person>(1000, 2, "age > 10");
+// std::vector<person> batch;
+// while (stream.next(batch)) {
+//   process(batch);
+// }
+template <typename T>
+class row_stream {
+ public:
+  // fetch(push) runs on the thread, it passes the batches to
+  // push(std::vector<T> &&batch), which returns false after the stream is
+  // closed, and returns false if the rows can't be fetched
+  template <typename Fetch>
+  row_stream(size_t max_batches, Fetch fetch)
+      : max_batches_((std::max)(max_batches, size_t(1))) {
+    thd_ = std::thread([this, fetch = std::move(fetch)]() mutable {
+      bool ok = false;
+      std::exception_ptr error;
+      try {
+        ok = fetch([this](std::vector<T> &&batch) {
+          return push(std::move(batch));
+        });
+      } catch (...) {
+        error = std::current_exception();
+      }
+
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ok_ = ok;
+        error_ = error;
+        done_ = true;
+      }
+      not_empty_.notify_one();
+    });
+  }
+
+  ~row_stream() {
+    close();
+    thd_.join();
+  }
+
+  row_stream(const row_stream &) = delete;
+  row_stream &operator=(const row_stream &) = delete;
+
+  // wait for the next batch, it returns false after the last one and
+  // rethrows the exception of the fetch
+  bool next(std::vector<T> &batch) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] {
+      return !batches_.empty() || done_;
+    });
+    if (batches_.empty()) {
+      if (error_)
+        std::rethrow_exception(std::exchange(error_, nullptr));
+      return false;
+    }
+
+    batch = std::move(batches_.front());
+    batches_.pop_front();
+    lock.unlock();
+    not_full_.notify_one();
+    return true;
+  }
+
+  // stop the fetch after the current batch, the queued batches are dropped
+  void close() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      closed_ = true;
+      batches_.clear();
+    }
+    not_full_.notify_one();
+  }
+
+  // false if the rows can't be fetched, it is known after next returns false
+  bool ok() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return ok_;
+  }
+
+ private:
+  bool push(std::vector<T> &&batch) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this] {
+      return closed_ || batches_.size() < max_batches_;
+    });
+    if (closed_)
+      return false;
+
+    batches_.push_back(std::move(batch));
+    lock.unlock();
+    not_empty_.notify_one();
+    return true;
+  }
+
+  size_t max_batches_;
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  std::deque<std::vector<T>> batches_;
+  bool closed_ = false;
+  bool done_ = false;
+  bool ok_ = false;
+  std::exception_ptr error_;
+  std::thread thd_;
+};
+}  // namespace ormpp
+
+#endif  // ORMPP_ROW_STREAM_HPP
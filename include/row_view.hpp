@@ -0,0 +1,127 @@
+#ifndef ORMPP_ROW_VIEW_HPP
+#define ORMPP_ROW_VIEW_HPP
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "utility.hpp"
+
+namespace ormpp {
+// the strings, char arrays and blobs are viewed as a std::string_view, the
+// other fields as their type
+template <typename U>
+struct view_type {
+  using type = U;
+};
+
+template <>
+struct view_type<std::string> {
+  using type = std::string_view;
+};
+
+#ifdef ORMPP_HAS_PMR
+template <>
+struct view_type<std::pmr::string> {
+  using type = std::string_view;
+};
+#endif
+
+template <size_t N>
+struct view_type<char[N]> {
+  using type = std::string_view;
+};
+
+template <>
+struct view_type<std::vector<char>> {
+  using type = std::string_view;
+};
+
+template <typename U>
+using view_t = typename view_type<U>::type;
+
+template <typename Members>
+struct view_tuple;
+
+template <typename... Members>
+struct view_tuple<std::tuple<Members...>> {
+  using type =
+      std::tuple<view_t<typename field_attribute<Members>::return_type>...>;
+};
+
+// a row of T whose strings and blobs point into the buffers of the driver,
+// they are only valid until the next row is fetched, such as:
+// conn.for_each_row<person>([](const row_view<person> &row) {
+//   out.write(row.get(&person::name)); // std::string_view
+// }, "age > 10");
+template <typename T>
+class row_view {
+ public:
+  using members_type = decltype(get_members<T>());
+  using tuple_type = typename view_tuple<members_type>::type;
+
+  // the I-th reflected field
+  template <size_t I>
+  const auto &get() const {
+    return std::get<I>(fields_);
+  }
+
+  template <typename U>
+  const view_t<U> &get(U T::*member) const {
+    const view_t<U> *result = nullptr;
+    iguana::for_each(get_members<T>(), [this, member, &result](auto item,
+                                                               auto i) {
+      if constexpr (std::is_same_v<decltype(item), U T::*>) {
+        if (item == member)
+          result = &std::get<decltype(i)::value>(fields_);
+      }
+    });
+    return *result;
+  }
+
+  // copy the row out to keep it after the next row is fetched
+  T to_row() const {
+    T t{};
+    iguana::for_each(get_members<T>(), [this, &t](auto item, auto i) {
+      using U = typename field_attribute<decltype(item)>::return_type;
+      auto &field = std::get<decltype(i)::value>(fields_);
+      if constexpr (is_char_array_v<U>) {
+        auto size = (std::min)(field.size(), sizeof(U));
+        std::copy(field.data(), field.data() + size, t.*item);
+      }
+      else if constexpr (std::is_same_v<view_t<U>, std::string_view>) {
+        (t.*item).assign(field.data(), field.data() + field.size());
+      }
+      else {
+        t.*item = field;
+      }
+    });
+    return t;
+  }
+
+  // filled by the backends
+  tuple_type &fields() { return fields_; }
+
+ private:
+  tuple_type fields_;
+};
+
+// call func(row) for a row or a batch of rows, it stops the rows if func
+// returns false
+template <typename Func, typename Row>
+inline bool call_row_func(Func &func, Row &&row) {
+  if constexpr (std::is_same_v<decltype(func(std::forward<Row>(row))),
+                               bool>) {
+    return func(std::forward<Row>(row));
+  }
+  else {
+    func(std::forward<Row>(row));
+    return true;
+  }
+}
+}  // namespace ormpp
+
+#endif  // ORMPP_ROW_VIEW_HPP
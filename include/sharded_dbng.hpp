@@ -0,0 +1,308 @@
+#ifndef ORMPP_SHARDED_DBNG_HPP
+#define ORMPP_SHARDED_DBNG_HPP
+
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "connection_pool.hpp"
+#include "dbng.hpp"
+
+namespace ormpp {
+// the hash of a shard key is the same on all the platforms and builds, so the
+// rows stay in their shards: an integer is its value as uint64_t, a string is
+// its 64 bit fnv-1a hash
+template <typename K>
+inline uint64_t get_shard_hash(const K &key) {
+  if constexpr (std::is_integral_v<K>) {
+    return (uint64_t)key;
+  }
+  else if constexpr (std::is_convertible_v<const K &, std::string_view>) {
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : std::string_view(key)) {
+      hash ^= c;
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+  else {
+    static_assert(!sizeof(K), "the key needs a shard_func");
+  }
+}
+
+// the rows of T split across the databases of the pools by a key, such as the
+// user id; the writes and the reads by the key go to the shard of the key, the
+// other queries go to all the shards in parallel, such as:
+// sharded_dbng<dbng<mysql>, order, int64_t> orders({&pool0, &pool1},
+//                                                  &order::user_id);
+// orders.insert(order{1, 42});              // the shard of 42
+// orders.get(42);                           // the shard of 42
+// orders.query("status = 1");               // all the shards
+// orders.query_ordered(&order::created, true, 100, "status = 1");
+template <typename DB, typename T, typename K>
+class sharded_dbng {
+ public:
+  // the shard of a key in [0, shards), it is get_shard_hash of the key modulo
+  // the shards by default
+  using shard_func = std::function<size_t(const K &key, size_t shards)>;
+
+  sharded_dbng(std::vector<connection_pool<DB> *> pools, K T::*key,
+               shard_func shard = nullptr)
+      : pools_(std::move(pools)), key_(key), shard_(std::move(shard)) {
+    if (pools_.empty())
+      throw std::invalid_argument("no shard");
+    if (!shard_) {
+      shard_ = [](const K &key, size_t shards) {
+        return (size_t)(get_shard_hash(key) % shards);
+      };
+    }
+  }
+
+  sharded_dbng(const sharded_dbng &) = delete;
+  sharded_dbng &operator=(const sharded_dbng &) = delete;
+
+  size_t shard_count() const { return pools_.size(); }
+
+  size_t shard_of(const K &key) const {
+    return shard_(key, pools_.size()) % pools_.size();
+  }
+
+  // call func(conn, shard) for all the shards in parallel and return the
+  // results by shard, such as to create the tables
+  template <typename Func>
+  auto for_each_shard(Func &&func) {
+    return scatter([this, &func](size_t shard) {
+      return with_conn(shard, [&func, shard](DB &conn) {
+        return func(conn, shard);
+      });
+    });
+  }
+
+  template <typename... Args>
+  int insert(const T &t, Args &&...args) {
+    return with_conn(shard_of(t.*key_), [&](DB &conn) {
+      return conn.insert(t, args...);
+    });
+  }
+
+  // the rows are grouped by shard and the groups are inserted in parallel, it
+  // returns INT_MIN if a group fails
+  template <typename... Args>
+  int insert(const std::vector<T> &v, Args &&...args) {
+    return write_groups(v, [&](DB &conn, const std::vector<T> &group) {
+      return conn.insert(group, args...);
+    });
+  }
+
+  template <typename... Args>
+  int update(const T &t, Args &&...args) {
+    return with_conn(shard_of(t.*key_), [&](DB &conn) {
+      return conn.update(t, args...);
+    });
+  }
+
+  template <typename... Args>
+  int update(const std::vector<T> &v, Args &&...args) {
+    return write_groups(v, [&](DB &conn, const std::vector<T> &group) {
+      return conn.update(group, args...);
+    });
+  }
+
+  std::optional<T> get(const K &key) { return get_by_keys({key})[0]; }
+
+  // the rows with the keys in the order of the keys, each shard reads its
+  // keys in parallel
+  std::vector<std::optional<T>> get_by_keys(const std::vector<K> &keys) {
+    std::vector<std::vector<K>> groups(pools_.size());
+    for (auto &key : keys) {
+      groups[shard_of(key)].push_back(key);
+    }
+
+    auto rows = scatter([this, &groups](size_t shard) {
+      if (groups[shard].empty())
+        return std::vector<std::optional<T>>{};
+      return with_conn(shard, [this, &groups, shard](DB &conn) {
+        return conn.get_by_keys(key_, groups[shard]);
+      });
+    });
+
+    // the keys of a shard are in the order of keys
+    std::vector<size_t> next(pools_.size());
+    std::vector<std::optional<T>> result;
+    result.reserve(keys.size());
+    for (auto &key : keys) {
+      auto shard = shard_of(key);
+      result.push_back(std::move(rows[shard][next[shard]++]));
+    }
+    return result;
+  }
+
+  bool delete_by_keys(const std::vector<K> &keys) {
+    std::vector<std::vector<K>> groups(pools_.size());
+    for (auto &key : keys) {
+      groups[shard_of(key)].push_back(key);
+    }
+
+    auto results = scatter([this, &groups](size_t shard) {
+      if (groups[shard].empty())
+        return true;
+      return with_conn(shard, [this, &groups, shard](DB &conn) {
+        return conn.delete_by_keys(key_, groups[shard]);
+      });
+    });
+    for (bool r : results) {
+      if (!r)
+        return false;
+    }
+    return true;
+  }
+
+  // the rows of all the shards, shard by shard
+  template <typename... Args>
+  std::vector<T> query(Args &&...args) {
+    auto parts = scatter([&](size_t shard) {
+      return with_conn(shard, [&](DB &conn) {
+        return conn.template query<T>(args...);
+      });
+    });
+
+    std::vector<T> result;
+    for (auto &part : parts) {
+      result.insert(result.end(), std::make_move_iterator(part.begin()),
+                    std::make_move_iterator(part.end()));
+    }
+    return result;
+  }
+
+  // the rows of all the shards ordered by field, the sorted rows of the shards
+  // are merged, at most limit rows are returned if it isn't 0; the args are
+  // the conditions without order by and limit
+  template <typename U, typename... Args>
+  std::vector<T> query_ordered(U T::*field, bool desc, size_t limit,
+                               Args &&...args) {
+    std::string condition;
+    append(condition, std::forward<Args>(args)...);
+    if (condition.find_first_not_of(' ') == std::string::npos)
+      condition = "1=1 ";
+    append(condition, "order by", get_member_name(field),
+           desc ? "desc" : "asc");
+    // a condition with limit replaces the where clause, so it is the next arg
+    std::string limit_sql;
+    if (limit != 0)
+      limit_sql = "limit " + std::to_string(limit);
+
+    auto parts = scatter([this, &condition, &limit_sql](size_t shard) {
+      return with_conn(shard, [&condition, &limit_sql](DB &conn) {
+        return conn.template query<T>(condition, limit_sql);
+      });
+    });
+
+    auto before = [field, desc](const T &a, const T &b) {
+      if constexpr (is_char_array_v<U>) {
+        std::string_view x(a.*field);
+        std::string_view y(b.*field);
+        return desc ? y < x : x < y;
+      }
+      else {
+        return desc ? b.*field < a.*field : a.*field < b.*field;
+      }
+    };
+
+    // the next row of each shard, the top is the first of them
+    using cursor = std::pair<size_t, size_t>;
+    auto after = [&parts, &before](const cursor &a, const cursor &b) {
+      return before(parts[b.first][b.second], parts[a.first][a.second]);
+    };
+    std::priority_queue<cursor, std::vector<cursor>, decltype(after)> heap(
+        after);
+    for (size_t shard = 0; shard < parts.size(); ++shard) {
+      if (!parts[shard].empty())
+        heap.emplace(shard, 0);
+    }
+
+    std::vector<T> result;
+    while (!heap.empty() && (limit == 0 || result.size() < limit)) {
+      auto [shard, index] = heap.top();
+      heap.pop();
+      result.push_back(std::move(parts[shard][index]));
+      if (index + 1 < parts[shard].size())
+        heap.emplace(shard, index + 1);
+    }
+    return result;
+  }
+
+ private:
+  // call func(conn) with a connection of the shard, it throws if there is no
+  // available connection
+  template <typename Func>
+  auto with_conn(size_t shard, Func &&func) {
+    auto &pool = *pools_[shard];
+    auto conn = pool.get();
+    if (conn == nullptr)
+      throw std::runtime_error("no available connection");
+
+    conn_guard<DB> guard(conn, pool);
+    return func(*conn);
+  }
+
+  // call func(shard) for all the shards in parallel, the calling thread takes
+  // the first shard
+  template <typename Func>
+  auto scatter(Func &&func) {
+    using R = decltype(func(size_t(0)));
+    std::vector<std::future<R>> futures;
+    for (size_t shard = 1; shard < pools_.size(); ++shard) {
+      futures.push_back(std::async(std::launch::async, [&func, shard] {
+        return func(shard);
+      }));
+    }
+
+    std::vector<R> results;
+    results.reserve(pools_.size());
+    results.push_back(func(0));
+    for (auto &future : futures) {
+      results.push_back(future.get());
+    }
+    return results;
+  }
+
+  template <typename Func>
+  int write_groups(const std::vector<T> &v, Func &&func) {
+    std::vector<std::vector<T>> groups(pools_.size());
+    for (auto &t : v) {
+      groups[shard_of(t.*key_)].push_back(t);
+    }
+
+    auto results = scatter([this, &groups, &func](size_t shard) {
+      if (groups[shard].empty())
+        return 0;
+      return with_conn(shard, [&groups, &func, shard](DB &conn) {
+        return func(conn, groups[shard]);
+      });
+    });
+
+    int count = 0;
+    for (int r : results) {
+      if (r == INT_MIN)
+        return INT_MIN;
+      count += r;
+    }
+    return count;
+  }
+
+  std::vector<connection_pool<DB> *> pools_;
+  K T::*key_;
+  shard_func shard_;
+};
+}  // namespace ormpp
+
+#endif  // ORMPP_SHARDED_DBNG_HPP
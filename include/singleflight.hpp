@@ -0,0 +1,81 @@
+#ifndef ORMPP_SINGLEFLIGHT_HPP
+#define ORMPP_SINGLEFLIGHT_HPP
+
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace ormpp {
+struct singleflight_stats {
+  size_t executions = 0;
+  size_t coalesced = 0;
+};
+
+// the first caller of a key executes the call, the callers of the same key
+// arriving before it finishes wait for it and share its result
+class singleflight {
+ public:
+  template <typename R, typename Func>
+  std::shared_ptr<const R> run(const std::string &key, Func &&func) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = calls_.find(key);
+    if (it != calls_.end()) {
+      auto future = it->second;
+      ++coalesced_;
+      lock.unlock();
+      return std::static_pointer_cast<const R>(future.get());
+    }
+
+    std::promise<std::shared_ptr<const void>> promise;
+    calls_.emplace(key, promise.get_future().share());
+    ++executions_;
+    lock.unlock();
+
+    std::shared_ptr<const R> result;
+    try {
+      result = func();
+    } catch (...) {
+      finish(key);
+      promise.set_exception(std::current_exception());
+      throw;
+    }
+
+    // the callers arriving from now on execute a new call
+    finish(key);
+    promise.set_value(result);
+    return result;
+  }
+
+  singleflight_stats stats() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return {executions_, coalesced_};
+  }
+
+ private:
+  void finish(const std::string &key) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    calls_.erase(key);
+  }
+
+  std::mutex mutex_;
+  std::unordered_map<std::string,
+                     std::shared_future<std::shared_ptr<const void>>>
+      calls_;
+  size_t executions_ = 0;
+  size_t coalesced_ = 0;
+};
+
+// shared by all the connections of DB in the process, such as the connections
+// of a connection_pool, the keys of dbng start with the database of the
+// connection
+template <typename DB>
+inline singleflight &get_singleflight() {
+  static singleflight flight;
+  return flight;
+}
+}  // namespace ormpp
+
+#endif  // ORMPP_SINGLEFLIGHT_HPP
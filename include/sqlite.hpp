@@ -3,10 +3,16 @@
 //
 #include <sqlite3.h>
 
+#include <array>
 #include <climits>
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <vector>
 
+#include "columns.hpp"
+#include "row_view.hpp"
+#include "table_keys.hpp"
 #include "utility.hpp"
 
 #ifndef ORM_SQLITE_HPP
@@ -14,19 +20,35 @@
 namespace ormpp {
 class sqlite {
  public:
+  static constexpr DBType db_type = DBType::sqlite;
+
   ~sqlite() { disconnect(); }
 
   void set_last_error(std::string last_error) {
+    has_error_ = true;
     last_error_ = std::move(last_error);
     // std::cout << last_error_ << std::endl;//todo, write to log file
   }
 
   std::string get_last_error() const { return last_error_; }
 
+  bool ping() { return handle_ != nullptr; }
+
+  // true if the last operation failed
+  bool has_error() { return has_error_; }
+  void reset_error() {
+    has_error_ = false;
+    last_error_ = {};
+  }
+
   template <typename... Args>
   bool connect(Args &&...args) {
+    database_ = get_database_id(db_type, args...);
     auto r = sqlite3_open(std::forward<Args>(args)..., &handle_);
     if (r == SQLITE_OK) {
+      sqlite3_create_function(handle_, "ormpp_crc32", -1,
+                              SQLITE_UTF8 | SQLITE_DETERMINISTIC, nullptr,
+                              &crc32_func, nullptr, nullptr);
       return true;
     }
     set_last_error(sqlite3_errmsg(handle_));
@@ -50,6 +72,7 @@ class sqlite {
 
   template <typename T, typename... Args>
   bool create_datatable(Args &&...args) {
+    reset_error();
     //            std::string droptb = "DROP TABLE IF EXISTS ";
     //            droptb += iguana::get_name<T>();
     //            if (sqlite3_exec(handle_, droptb.data(), nullptr, nullptr,
@@ -72,38 +95,169 @@ class sqlite {
 
   template <typename T, typename... Args>
   int insert(const T &t, Args &&...args) {
-    std::string sql = auto_key_map_.empty()
+    reset_error();
+    auto auto_key = get_auto_key<T>();
+    std::string sql = auto_key.empty()
                           ? generate_insert_sql<T>(false)
-                          : generate_auto_insert_sql0<T>(auto_key_map_, false);
+                          : generate_auto_insert_sql0<T>(auto_key, false);
 
     return insert_impl(false, sql, t, std::forward<Args>(args)...);
   }
 
   template <typename T, typename... Args>
   int insert(const std::vector<T> &t, Args &&...args) {
-    std::string sql = auto_key_map_.empty()
+    reset_error();
+    auto auto_key = get_auto_key<T>();
+    std::string sql = auto_key.empty()
                           ? generate_insert_sql<T>(false)
-                          : generate_auto_insert_sql0<T>(auto_key_map_, false);
+                          : generate_auto_insert_sql0<T>(auto_key, false);
 
     return insert_impl(false, sql, t, std::forward<Args>(args)...);
   }
 
+  // insert and return the generated rowid, 0 if failed
+  template <typename T>
+  uint64_t get_insert_id_after_insert(const T &t) {
+    reset_error();
+    auto ids = insert_returning_ids(&t, 1);
+    return ids.empty() ? 0 : ids.front();
+  }
+
+  // the generated rowids of the rows in order, empty if failed
+  template <typename T>
+  std::vector<uint64_t> get_insert_id_after_insert(const std::vector<T> &v) {
+    reset_error();
+    if (v.empty() || !begin())
+      return {};
+
+    auto ids = insert_returning_ids(v.data(), v.size());
+    if (ids.empty()) {
+      rollback();
+      return {};
+    }
+
+    return commit() ? ids : std::vector<uint64_t>{};
+  }
+
+  // the name of the auto increment key of T, empty if there is none
+  template <typename T>
+  std::string get_auto_key() {
+    return get_table_keys<T>().auto_key;
+  }
+
+  // update by the key, the args are the names of extra condition fields; if
+  // there is no key and no condition field, the row is replaced
   template <typename T, typename... Args>
   int update(const T &t, Args &&...args) {
-    std::string sql = generate_insert_sql<T>(true);
+    reset_error();
+    auto conditions = get_conditions<T>(std::forward<Args>(args)...);
+    if (conditions.empty()) {
+      std::string sql = generate_insert_sql<T>(true);
+      return insert_impl(true, sql, t);
+    }
 
-    return insert_impl(true, sql, t, std::forward<Args>(args)...);
+    auto fields = get_update_fields(get_member_names(get_members<T>()),
+                                    conditions);
+    return update_impl(t, fields, conditions);
   }
 
   template <typename T, typename... Args>
   int update(const std::vector<T> &t, Args &&...args) {
-    std::string sql = generate_insert_sql<T>(true);
+    reset_error();
+    auto conditions = get_conditions<T>(std::forward<Args>(args)...);
+    if (conditions.empty()) {
+      std::string sql = generate_insert_sql<T>(true);
+      return insert_impl(true, sql, t);
+    }
+
+    auto fields = get_update_fields(get_member_names(get_members<T>()),
+                                    conditions);
+    return update_impl(t, fields, conditions);
+  }
+
+  // insert t, or update the row with the same key in one statement, the
+  // members limit the updated fields, such as: upsert(p, &person::name)
+  template <typename T, typename... Members>
+  int upsert(const T &t, Members T::*...members) {
+    reset_error();
+    auto keys = get_conditions<T>();
+    if (keys.empty()) {
+      set_last_error("upsert needs a key of " + get_name<T>());
+      return INT_MIN;
+    }
+
+    auto fields = get_set_fields<T>(keys, members...);
+    auto sql = generate_upsert_sql<T>(db_type, keys, fields, 1);
+    return execute_rows(sql, &t, 1) ? 1 : INT_MIN;
+  }
+
+  // the rows are sent in multi-row statements in one transaction
+  template <typename T, typename... Members>
+  int upsert(const std::vector<T> &v, Members T::*...members) {
+    reset_error();
+    auto keys = get_conditions<T>();
+    if (keys.empty()) {
+      set_last_error("upsert needs a key of " + get_name<T>());
+      return INT_MIN;
+    }
+
+    auto fields = get_set_fields<T>(keys, members...);
+    return execute_batches(v, [&keys, &fields](size_t count) {
+      return generate_upsert_sql<T>(db_type, keys, fields, count);
+    });
+  }
+
+  // update the rows by the key with one set-based statement per chunk, the
+  // members limit the updated fields, such as: bulk_update(v, &person::name)
+  template <typename T, typename... Members>
+  int bulk_update(const std::vector<T> &v, Members T::*...members) {
+    reset_error();
+    auto keys = get_conditions<T>();
+    if (keys.empty()) {
+      set_last_error("bulk_update needs a key of " + get_name<T>());
+      return INT_MIN;
+    }
+
+    auto fields = get_set_fields<T>(keys, members...);
+    return execute_batches(v, [&keys, &fields](size_t count) {
+      return generate_bulk_update_sql<T>(db_type, keys, fields, count);
+    });
+  }
+
+  // insert the rows with multi-row statements in one transaction, all the
+  // fields are inserted, including the auto key
+  template <typename T>
+  int bulk_insert(const std::vector<T> &v) {
+    reset_error();
+    return execute_batches(v, [](size_t count) {
+      return generate_insert_rows_sql<T>(db_type, count);
+    });
+  }
+
+  // only update the given fields by the key, such as:
+  // update_fields(p, &person::name, &person::age)
+  template <typename T, typename... Members>
+  int update_fields(const T &t, Members T::*...members) {
+    reset_error();
+    auto conditions = get_conditions<T>();
+    if (conditions.empty()) {
+      set_last_error("update_fields needs a key of " + get_name<T>());
+      return INT_MIN;
+    }
+
+    auto fields = get_update_fields(
+        get_member_names(std::make_tuple(members...)), conditions);
+    if (fields.empty()) {
+      set_last_error("update_fields needs a field which isn't a key");
+      return INT_MIN;
+    }
 
-    return insert_impl(true, sql, t, std::forward<Args>(args)...);
+    return update_impl(t, fields, conditions);
   }
 
   template <typename T, typename... Args>
   bool delete_records(Args &&...where_conditon) {
+    reset_error();
     auto sql = generate_delete_sql<T>(std::forward<Args>(where_conditon)...);
 #if ORMPP_ENABLE_LOG
     std::cout << sql << std::endl;
@@ -122,6 +276,35 @@ class sqlite {
   template <typename T, typename... Args>
   std::enable_if_t<iguana::is_reflection_v<T>, std::vector<T>> query(
       Args &&...args) {
+    std::vector<T> v;
+    query_rows<T>(v, std::forward<Args>(args)...);
+    return v;
+  }
+
+#ifdef ORMPP_HAS_PMR
+  // as query, but the rows and their std::pmr::string fields are allocated
+  // from mr, such as a std::pmr::monotonic_buffer_resource which releases
+  // them together
+  template <typename T, typename Resource, typename... Args>
+  std::enable_if_t<iguana::is_reflection_v<T> &&
+                       std::is_base_of_v<std::pmr::memory_resource, Resource>,
+                   std::pmr::vector<T>>
+  query(Resource *mr, Args &&...args) {
+    std::pmr::vector<T> v(mr);
+    query_rows<T>(v, std::forward<Args>(args)...);
+    return v;
+  }
+#endif
+
+  // call func(row) with a row_view<T> of each row, its strings and blobs
+  // point into the driver's buffers and are only valid until func returns;
+  // func returns false to stop, and it must not use this connection; the args
+  // are the conditions
+  template <typename T, typename Func, typename... Args>
+  bool for_each_row(Func &&func, Args &&...args) {
+    reset_error();
+    static_assert(!is_selection_args<Args...>::value,
+                  "all the fields are viewed by for_each_row");
     std::string sql = generate_query_sql<T>(args...);
 #if ORMPP_ENABLE_LOG
     std::cout << sql << std::endl;
@@ -130,34 +313,144 @@ class sqlite {
                                     &stmt_, nullptr);
     if (result != SQLITE_OK) {
       set_last_error(sqlite3_errmsg(handle_));
-      return {};
+      return false;
     }
 
     auto guard = guard_statment(stmt_);
 
-    std::vector<T> v;
+    row_view<T> row;
     while (true) {
       result = sqlite3_step(stmt_);
       if (result == SQLITE_DONE)
-        break;
+        return true;
+
+      if (result != SQLITE_ROW) {
+        set_last_error(sqlite3_errmsg(handle_));
+        return false;
+      }
+
+      iguana::for_each(get_members<T>(), [this, &row](auto item, auto I) {
+        constexpr auto Idx = decltype(I)::value;
+        using U = typename field_attribute<decltype(item)>::return_type;
+        auto &field = std::get<Idx>(row.fields());
+        if constexpr (std::is_same_v<view_t<U>, std::string_view>) {
+          // the bytes of a text are not converted
+          auto data = (const char *)sqlite3_column_blob(stmt_, (int)Idx);
+          auto size = sqlite3_column_bytes(stmt_, (int)Idx);
+          field = data == nullptr ? std::string_view()
+                                  : std::string_view(data, size);
+        }
+        else {
+          assign(field, (int)Idx);
+        }
+      });
 
-      if (result != SQLITE_ROW)
+      if (!call_row_func(func, row))
+        return true;
+    }
+  }
+
+  // call func(std::vector<T> &&batch) with the rows by batches of
+  // batch_size, the last batch may be smaller; func returns false to stop, the
+  // args are the conditions
+  template <typename T, typename Func, typename... Args>
+  bool for_each_batch(size_t batch_size, Func &&func, Args &&...args) {
+    reset_error();
+    std::string sql = generate_query_sql<T>(args...);
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
+    auto members = get_members<T>(args...);
+    int result = sqlite3_prepare_v2(handle_, sql.data(), (int)sql.size(),
+                                    &stmt_, nullptr);
+    if (result != SQLITE_OK) {
+      set_last_error(sqlite3_errmsg(handle_));
+      return false;
+    }
+
+    auto guard = guard_statment(stmt_);
+
+    std::vector<T> batch;
+    batch.reserve(batch_size);
+    while (true) {
+      result = sqlite3_step(stmt_);
+      if (result == SQLITE_DONE)
         break;
 
-      T t = {};
-      iguana::for_each(t, [this, &t](auto item, auto I) {
+      if (result != SQLITE_ROW) {
+        set_last_error(sqlite3_errmsg(handle_));
+        return false;
+      }
+
+      T t{};
+      iguana::for_each(members, [this, &t](auto item, auto I) {
         assign(t.*item, (int)decltype(I)::value);
       });
+      batch.push_back(std::move(t));
 
-      v.push_back(std::move(t));
+      if (batch.size() >= batch_size) {
+        if (!call_row_func(func, std::move(batch)))
+          return true;
+        batch = {};
+        batch.reserve(batch_size);
+      }
     }
 
-    return v;
+    if (!batch.empty())
+      call_row_func(func, std::move(batch));
+    return true;
+  }
+
+  // as query, but the rows are decoded by column, the args are the conditions
+  template <typename T, typename... Args>
+  columns<T> query_columns(Args &&...args) {
+    reset_error();
+    static_assert(!is_selection_args<Args...>::value,
+                  "all the fields are decoded by query_columns");
+    std::string sql = generate_query_sql<T>(args...);
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
+    int result = sqlite3_prepare_v2(handle_, sql.data(), (int)sql.size(),
+                                    &stmt_, nullptr);
+    if (result != SQLITE_OK) {
+      set_last_error(sqlite3_errmsg(handle_));
+      return {};
+    }
+
+    auto guard = guard_statment(stmt_);
+
+    columns<T> cols;
+    while ((result = sqlite3_step(stmt_)) == SQLITE_ROW) {
+      iguana::for_each(get_members<T>(), [this, &cols](auto item, auto I) {
+        constexpr auto Idx = decltype(I)::value;
+        using U = typename field_attribute<decltype(item)>::return_type;
+        auto &column = cols.template get<Idx>();
+        if constexpr (std::is_same_v<column_t<U>, string_column>) {
+          // the text is read before its size
+          auto text = (const char *)sqlite3_column_text(stmt_, (int)Idx);
+          auto size = sqlite3_column_bytes(stmt_, (int)Idx);
+          column.push_back(text == nullptr ? std::string_view()
+                                           : std::string_view(text, size));
+        }
+        else {
+          U value{};
+          assign(value, (int)Idx);
+          column.push_back(std::move(value));
+        }
+      });
+      cols.add_row();
+    }
+    if (result != SQLITE_DONE)
+      set_last_error(sqlite3_errmsg(handle_));
+
+    return cols;
   }
 
   template <typename T, typename Arg, typename... Args>
   std::enable_if_t<!iguana::is_reflection_v<T>, std::vector<T>> query(
       const Arg &s, Args &&...args) {
+    reset_error();
     static_assert(iguana::is_tuple<T>::value);
     constexpr auto SIZE = std::tuple_size_v<T>;
 
@@ -167,10 +460,11 @@ class sqlite {
 #endif
     constexpr auto Args_Size = sizeof...(Args);
     if constexpr (Args_Size != 0) {
-      if (Args_Size != std::count(sql.begin(), sql.end(), '?'))
+      if (get_params_size(args...) !=
+          (size_t)std::count(sql.begin(), sql.end(), '?')) {
+        set_last_error("the args don't match the placeholders");
         return {};
-
-      sql = get_sql(sql, std::forward<Args>(args)...);
+      }
     }
 
     int result = sqlite3_prepare_v2(handle_, sql.data(), (int)sql.size(),
@@ -182,14 +476,21 @@ class sqlite {
 
     auto guard = guard_statment(stmt_);
 
+    if (!bind_params(std::forward<Args>(args)...)) {
+      set_last_error(sqlite3_errmsg(handle_));
+      return {};
+    }
+
     std::vector<T> v;
     while (true) {
       result = sqlite3_step(stmt_);
       if (result == SQLITE_DONE)
         break;
 
-      if (result != SQLITE_ROW)
+      if (result != SQLITE_ROW) {
+        set_last_error(sqlite3_errmsg(handle_));
         break;
+      }
 
       T tp = {};
       int index = 0;
@@ -218,6 +519,7 @@ class sqlite {
 
   // just support execute string sql without placeholders
   bool execute(const std::string &sql) {
+    reset_error();
     if (sqlite3_exec(handle_, sql.data(), nullptr, nullptr, nullptr) !=
         SQLITE_OK) {
       set_last_error(sqlite3_errmsg(handle_));
@@ -227,20 +529,74 @@ class sqlite {
     return true;
   }
 
+  // execute sql with placeholders, the args are bound as statement parameters
+  template <typename Arg, typename... Args>
+  bool execute(const std::string &sql, Arg &&arg, Args &&...args) {
+    reset_error();
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
+    int result = sqlite3_prepare_v2(handle_, sql.data(), (int)sql.size(),
+                                    &stmt_, nullptr);
+    if (result != SQLITE_OK) {
+      set_last_error(sqlite3_errmsg(handle_));
+      return false;
+    }
+
+    auto guard = guard_statment(stmt_);
+
+    if (!bind_params(std::forward<Arg>(arg), std::forward<Args>(args)...)) {
+      set_last_error(sqlite3_errmsg(handle_));
+      return false;
+    }
+
+    do {
+      result = sqlite3_step(stmt_);
+    } while (result == SQLITE_ROW);
+
+    if (result != SQLITE_DONE) {
+      set_last_error(sqlite3_errmsg(handle_));
+      return false;
+    }
+
+    return true;
+  }
+
   int get_last_affect_rows() { return sqlite3_changes(handle_); }
 
   // transaction
+  // the transactions can be nested, only the outermost one is sent to the
+  // database, a rollback of an inner one makes the outermost one roll back
   bool begin() {
+    if (transaction_depth_ > 0) {
+      ++transaction_depth_;
+      return true;
+    }
+
     if (sqlite3_exec(handle_, "BEGIN", nullptr, nullptr, nullptr) !=
         SQLITE_OK) {
       set_last_error(sqlite3_errmsg(handle_));
       return false;
     }
 
+    transaction_depth_ = 1;
     return true;
   }
 
   bool commit() {
+    if (transaction_depth_ > 1) {
+      --transaction_depth_;
+      return true;
+    }
+
+    transaction_depth_ = 0;
+    if (rollback_only_) {
+      rollback_only_ = false;
+      sqlite3_exec(handle_, "ROLLBACK", nullptr, nullptr, nullptr);
+      set_last_error("rolled back by an inner transaction");
+      return false;
+    }
+
     if (sqlite3_exec(handle_, "COMMIT", nullptr, nullptr, nullptr) !=
         SQLITE_OK) {
       set_last_error(sqlite3_errmsg(handle_));
@@ -251,6 +607,14 @@ class sqlite {
   }
 
   bool rollback() {
+    if (transaction_depth_ > 1) {
+      --transaction_depth_;
+      rollback_only_ = true;
+      return true;
+    }
+
+    transaction_depth_ = 0;
+    rollback_only_ = false;
     if (sqlite3_exec(handle_, "ROLLBACK", nullptr, nullptr, nullptr) !=
         SQLITE_OK) {
       set_last_error(sqlite3_errmsg(handle_));
@@ -261,6 +625,42 @@ class sqlite {
   }
 
  private:
+  // ormpp_crc32(a, b, ...), the crc32 of the length, ':' and the text of each
+  // arg, or '-' for a null, see get_row_hash_sql
+  static void crc32_func(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    static const auto table = [] {
+      std::array<uint32_t, 256> t{};
+      for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) {
+          c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+        }
+        t[i] = c;
+      }
+      return t;
+    }();
+    auto update = [](uint32_t crc, const unsigned char *data, int size) {
+      for (int i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+      }
+      return crc;
+    };
+
+    uint32_t crc = 0xFFFFFFFF;
+    for (int i = 0; i < argc; ++i) {
+      if (sqlite3_value_type(argv[i]) == SQLITE_NULL) {
+        crc = update(crc, (const unsigned char *)"-", 1);
+        continue;
+      }
+      auto text = sqlite3_value_text(argv[i]);
+      int size = sqlite3_value_bytes(argv[i]);
+      auto length = std::to_string(size) + ":";
+      crc = update(crc, (const unsigned char *)length.data(),
+                   (int)length.size());
+      crc = update(crc, text, size);
+    }
+    sqlite3_result_int64(ctx, crc ^ 0xFFFFFFFF);
+  }
   template <typename T, typename... Args>
   std::string generate_createtb_sql(Args &&...args) {
     const auto type_name_arr = get_type_names<T>(DBType::sqlite);
@@ -269,7 +669,7 @@ class sqlite {
         std::string("CREATE TABLE IF NOT EXISTS ") + name.data() + "(";
     auto arr = iguana::get_array<T>();
     constexpr auto SIZE = sizeof...(Args);
-    auto_key_map_[name.data()] = "";
+    table_keys keys;
     // auto_increment_key and key can't exist at the same time
     using U = std::tuple<std::decay_t<Args>...>;
     if constexpr (SIZE > 0) {
@@ -287,8 +687,8 @@ class sqlite {
       bool has_add_field = false;
       for_each0(
           tp,
-          [&sql, &i, &has_add_field, field_name, type_name_arr, name,
-           this](auto item) {
+          [&sql, &i, &has_add_field, &keys, field_name,
+           type_name_arr](auto item) {
             if constexpr (std::is_same_v<decltype(item), ormpp_not_null>) {
               if (item.fields.find(field_name.data()) == item.fields.end())
                 return;
@@ -311,6 +711,7 @@ class sqlite {
               }
 
               append(sql, " PRIMARY KEY ");
+              keys.key = item.fields;
               has_add_field = true;
             }
             else if constexpr (std::is_same_v<decltype(item), ormpp_auto_key>) {
@@ -318,7 +719,8 @@ class sqlite {
                 append(sql, field_name.data(), " ", type_name_arr[i]);
               }
               append(sql, " PRIMARY KEY AUTOINCREMENT");
-              auto_key_map_[name.data()] = item.fields;
+              keys.auto_key = item.fields;
+              keys.key = item.fields;
               has_add_field = true;
             }
             else if constexpr (std::is_same_v<decltype(item), ormpp_unique>) {
@@ -344,6 +746,8 @@ class sqlite {
     }
 
     sql += ")";
+    // publish the keys at once, the readers never see a half set table
+    table_keys_registry::instance().set(database_, name, std::move(keys));
 
     return sql;
   }
@@ -380,10 +784,16 @@ class sqlite {
     else if constexpr (std::is_floating_point_v<U>) {
       return SQLITE_OK == sqlite3_bind_double(stmt_, i, value);
     }
-    else if constexpr (std::is_same_v<std::string, U>) {
+    else if constexpr (is_string_v<U> ||
+                       std::is_same_v<std::string_view, U>) {
       return SQLITE_OK == sqlite3_bind_text(stmt_, i, value.data(),
                                             (int)value.size(), nullptr);
     }
+    else if constexpr (std::is_same_v<const char *, U> ||
+                       std::is_same_v<char *, U>) {
+      return SQLITE_OK ==
+             sqlite3_bind_text(stmt_, i, value, (int)strlen(value), nullptr);
+    }
     else if constexpr (is_char_array_v<U>) {
       return SQLITE_OK ==
              sqlite3_bind_text(stmt_, i, value, sizeof(U), nullptr);
@@ -393,6 +803,72 @@ class sqlite {
     }
   }
 
+  // bind the args to the placeholders of stmt_ in order, string literals are
+  // bound by their length rather than the size of the array
+  template <typename... Args>
+  bool bind_params(Args &&...args) {
+    bool bind_ok = true;
+    if constexpr (sizeof...(Args) > 0) {
+      int index = 0;
+      auto bind = [this, &index, &bind_ok](auto &&arg) {
+        using U = std::remove_const_t<std::remove_reference_t<decltype(arg)>>;
+        if (!bind_ok)
+          return;
+
+        if constexpr (is_char_array_v<U>) {
+          bind_ok = set_param_bind((const char *)arg, ++index);
+        }
+        else if constexpr (is_param_list<U>::value) {
+          for (auto &item : arg) {
+            if (bind_ok)
+              bind_ok = set_param_bind(item, ++index);
+          }
+        }
+        else {
+          bind_ok = set_param_bind(arg, ++index);
+        }
+      };
+      (bind(std::forward<Args>(args)), ...);
+    }
+    return bind_ok;
+  }
+
+  template <typename T, typename Rows, typename... Args>
+  void query_rows(Rows &v, Args &&...args) {
+    reset_error();
+    std::string sql = generate_query_sql<T>(args...);
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
+    auto members = get_members<T>(args...);
+    int result = sqlite3_prepare_v2(handle_, sql.data(), (int)sql.size(),
+                                    &stmt_, nullptr);
+    if (result != SQLITE_OK) {
+      set_last_error(sqlite3_errmsg(handle_));
+      return;
+    }
+
+    auto guard = guard_statment(stmt_);
+
+    while (true) {
+      result = sqlite3_step(stmt_);
+      if (result == SQLITE_DONE)
+        break;
+
+      if (result != SQLITE_ROW) {
+        set_last_error(sqlite3_errmsg(handle_));
+        break;
+      }
+
+      T t = make_row<T>(v);
+      iguana::for_each(members, [this, &t](auto item, auto I) {
+        assign(t.*item, (int)decltype(I)::value);
+      });
+
+      v.push_back(std::move(t));
+    }
+  }
+
   template <typename T>
   void assign(T &&value, int i) {
     using U = std::remove_const_t<std::remove_reference_t<T>>;
@@ -411,7 +887,7 @@ class sqlite {
     else if constexpr (std::is_floating_point_v<U>) {
       value = sqlite3_column_double(stmt_, i);
     }
-    else if constexpr (std::is_same_v<std::string, U>) {
+    else if constexpr (is_string_v<U>) {
       value.reserve(sqlite3_column_bytes(stmt_, i));
       value.assign((const char *)sqlite3_column_text(stmt_, i),
                    (size_t)sqlite3_column_bytes(stmt_, i));
@@ -424,24 +900,9 @@ class sqlite {
     }
   }
 
-  template <typename T, typename... Args>
-  int insert_impl(bool is_update, const std::string &sql, const T &t,
-                  Args &&...args) {
-#if ORMPP_ENABLE_LOG
-    std::cout << sql << std::endl;
-#endif
-    int result = sqlite3_prepare_v2(handle_, sql.data(), (int)sql.size(),
-                                    &stmt_, nullptr);
-    if (result != SQLITE_OK) {
-      set_last_error(sqlite3_errmsg(handle_));
-      return INT_MIN;
-    }
-
-    auto guard = guard_statment(stmt_);
-
-    auto it = auto_key_map_.find(get_name<T>());
-    std::string auto_key =
-        (is_update || it == auto_key_map_.end()) ? "" : it->second;
+  // bind the fields of t except the auto key
+  template <typename T>
+  bool bind_insert(const T &t, const std::string &auto_key) {
     bool bind_ok = true;
     int index = 0;
     iguana::for_each(
@@ -457,8 +918,59 @@ class sqlite {
           bind_ok = set_param_bind(t.*item, index + 1);
           index++;
         });
+    return bind_ok;
+  }
+
+  template <typename T>
+  std::vector<uint64_t> insert_returning_ids(const T *rows, size_t count) {
+    auto auto_key = get_auto_key<T>();
+    std::string sql = auto_key.empty()
+                          ? generate_insert_sql<T>(false)
+                          : generate_auto_insert_sql0<T>(auto_key, false);
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
+    int result = sqlite3_prepare_v2(handle_, sql.data(), (int)sql.size(),
+                                    &stmt_, nullptr);
+    if (result != SQLITE_OK) {
+      set_last_error(sqlite3_errmsg(handle_));
+      return {};
+    }
+
+    auto guard = guard_statment(stmt_);
 
-    if (!bind_ok) {
+    std::vector<uint64_t> ids;
+    ids.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+      if (!bind_insert(rows[i], auto_key) ||
+          sqlite3_step(stmt_) != SQLITE_DONE ||
+          sqlite3_reset(stmt_) != SQLITE_OK) {
+        set_last_error(sqlite3_errmsg(handle_));
+        return {};
+      }
+      ids.push_back((uint64_t)sqlite3_last_insert_rowid(handle_));
+    }
+
+    return ids;
+  }
+
+  template <typename T, typename... Args>
+  int insert_impl(bool is_update, const std::string &sql, const T &t,
+                  Args &&...args) {
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
+    int result = sqlite3_prepare_v2(handle_, sql.data(), (int)sql.size(),
+                                    &stmt_, nullptr);
+    if (result != SQLITE_OK) {
+      set_last_error(sqlite3_errmsg(handle_));
+      return INT_MIN;
+    }
+
+    auto guard = guard_statment(stmt_);
+
+    auto auto_key = is_update ? "" : get_auto_key<T>();
+    if (!bind_insert(t, auto_key)) {
       set_last_error(sqlite3_errmsg(handle_));
       return INT_MIN;
     }
@@ -493,28 +1005,9 @@ class sqlite {
       return INT_MIN;
     }
 
-    auto it = auto_key_map_.find(get_name<T>());
-    std::string auto_key =
-        (is_update || it == auto_key_map_.end()) ? "" : it->second;
-
+    auto auto_key = is_update ? "" : get_auto_key<T>();
     for (auto &t : v) {
-      bool bind_ok = true;
-      int index = 0;
-      iguana::for_each(
-          t, [&t, &bind_ok, &auto_key, &index, this](auto item, auto i) {
-            if (!bind_ok)
-              return;
-
-            if (!auto_key.empty() &&
-                auto_key == iguana::get_name<T>(decltype(i)::value).data()) {
-              return;
-            }
-
-            bind_ok = set_param_bind(t.*item, index + 1);
-            index++;
-          });
-
-      if (!bind_ok) {
+      if (!bind_insert(t, auto_key)) {
         rollback();
         set_last_error(sqlite3_errmsg(handle_));
         return INT_MIN;
@@ -540,9 +1033,194 @@ class sqlite {
     return b ? (int)v.size() : INT_MIN;
   }
 
+  template <typename T, typename... Args>
+  std::vector<std::string> get_conditions(Args &&...args) {
+    std::vector<std::string> conditions;
+    auto key = get_table_keys<T>().key;
+    if (!key.empty())
+      conditions.push_back(std::move(key));
+
+    if constexpr (sizeof...(Args) > 0) {
+      auto add = [&conditions](std::string field) {
+        if (std::find(conditions.begin(), conditions.end(), field) ==
+            conditions.end())
+          conditions.push_back(std::move(field));
+      };
+      (add(std::forward<Args>(args)), ...);
+    }
+    return conditions;
+  }
+
+  template <typename T, size_t N>
+  bool bind_update_params(const T &t, const std::array<size_t, N> &positions) {
+    bool bind_ok = true;
+    iguana::for_each(t, [&t, &positions, &bind_ok, this](auto item, auto i) {
+      constexpr auto Idx = decltype(i)::value;
+      if (bind_ok && positions[Idx] > 0)
+        bind_ok = set_param_bind(t.*item, (int)positions[Idx]);
+    });
+    return bind_ok;
+  }
+
+  template <typename T>
+  int update_impl(const T &t, const std::vector<std::string_view> &fields,
+                  const std::vector<std::string> &conditions) {
+    auto sql = generate_update_sql<T>(db_type, fields, conditions);
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
+    int result = sqlite3_prepare_v2(handle_, sql.data(), (int)sql.size(),
+                                    &stmt_, nullptr);
+    if (result != SQLITE_OK) {
+      set_last_error(sqlite3_errmsg(handle_));
+      return INT_MIN;
+    }
+
+    auto guard = guard_statment(stmt_);
+
+    if (!bind_update_params(t, get_update_positions<T>(fields, conditions))) {
+      set_last_error(sqlite3_errmsg(handle_));
+      return INT_MIN;
+    }
+
+    if (sqlite3_step(stmt_) != SQLITE_DONE) {
+      set_last_error(sqlite3_errmsg(handle_));
+      return INT_MIN;
+    }
+
+    return 1;
+  }
+
+  template <typename T>
+  int update_impl(const std::vector<T> &v,
+                  const std::vector<std::string_view> &fields,
+                  const std::vector<std::string> &conditions) {
+    auto sql = generate_update_sql<T>(db_type, fields, conditions);
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
+    int result = sqlite3_prepare_v2(handle_, sql.data(), (int)sql.size(),
+                                    &stmt_, nullptr);
+    if (result != SQLITE_OK) {
+      set_last_error(sqlite3_errmsg(handle_));
+      return INT_MIN;
+    }
+
+    auto guard = guard_statment(stmt_);
+
+    if (!begin())
+      return INT_MIN;
+
+    auto positions = get_update_positions<T>(fields, conditions);
+    for (auto &t : v) {
+      if (!bind_update_params(t, positions) ||
+          sqlite3_step(stmt_) != SQLITE_DONE ||
+          sqlite3_reset(stmt_) != SQLITE_OK) {
+        set_last_error(sqlite3_errmsg(handle_));
+        rollback();
+        return INT_MIN;
+      }
+    }
+
+    return commit() ? (int)v.size() : INT_MIN;
+  }
+
+  // the rows are sent in chunks in one transaction, make_sql(count) generates
+  // the statement of a chunk of count rows
+  template <typename T, typename Func>
+  int execute_batches(const std::vector<T> &v, Func make_sql) {
+    if (v.empty())
+      return 0;
+
+    if (!begin())
+      return INT_MIN;
+
+    // the statement of the full chunks is prepared once and reused
+    constexpr size_t batch_rows = get_batch_rows<T>();
+    size_t prepared_rows = 0;
+    bool ok = true;
+    for (size_t i = 0; ok && i < v.size(); i += batch_rows) {
+      size_t count = (std::min)(batch_rows, v.size() - i);
+      if (count != prepared_rows) {
+        if (prepared_rows > 0)
+          sqlite3_finalize(stmt_);
+        prepared_rows = 0;
+
+        auto sql = make_sql(count);
+#if ORMPP_ENABLE_LOG
+        std::cout << sql << std::endl;
+#endif
+        if (sqlite3_prepare_v2(handle_, sql.data(), (int)sql.size(), &stmt_,
+                               nullptr) != SQLITE_OK) {
+          ok = false;
+          break;
+        }
+        prepared_rows = count;
+      }
+
+      ok = bind_rows(v.data() + i, count) &&
+           sqlite3_step(stmt_) == SQLITE_DONE &&
+           sqlite3_reset(stmt_) == SQLITE_OK;
+    }
+
+    if (!ok)
+      set_last_error(sqlite3_errmsg(handle_));
+    if (prepared_rows > 0)
+      sqlite3_finalize(stmt_);
+    if (!ok) {
+      rollback();
+      return INT_MIN;
+    }
+
+    return commit() ? (int)v.size() : INT_MIN;
+  }
+
+  // execute sql with all the fields of the rows bound in order
+  template <typename T>
+  bool execute_rows(const std::string &sql, const T *rows, size_t count) {
+#if ORMPP_ENABLE_LOG
+    std::cout << sql << std::endl;
+#endif
+    int result = sqlite3_prepare_v2(handle_, sql.data(), (int)sql.size(),
+                                    &stmt_, nullptr);
+    if (result != SQLITE_OK) {
+      set_last_error(sqlite3_errmsg(handle_));
+      return false;
+    }
+
+    auto guard = guard_statment(stmt_);
+
+    if (!bind_rows(rows, count) || sqlite3_step(stmt_) != SQLITE_DONE) {
+      set_last_error(sqlite3_errmsg(handle_));
+      return false;
+    }
+
+    return true;
+  }
+
+  template <typename T>
+  bool bind_rows(const T *rows, size_t count) {
+    int index = 0;
+    bool bind_ok = true;
+    for (size_t row = 0; row < count && bind_ok; ++row) {
+      auto &t = rows[row];
+      iguana::for_each(t, [&t, &index, &bind_ok, this](auto item, auto) {
+        if (bind_ok)
+          bind_ok = set_param_bind(t.*item, ++index);
+      });
+    }
+    return bind_ok;
+  }
+
+  // the keys of T in the database, see table_keys_registry
+  template <typename T>
+  table_keys get_table_keys() {
+    return table_keys_registry::instance().get(database_, get_name<T>());
+  }
+
   template <typename T>
-  inline std::string generate_auto_insert_sql0(
-      std::map<std::string, std::string> &auto_key_map_, bool replace) {
+  inline std::string generate_auto_insert_sql0(const std::string &auto_key,
+                                               bool replace) {
     std::string sql = replace ? "replace into " : "insert into ";
     constexpr auto SIZE = iguana::get_value<T>();
     auto name = get_name<T>();
@@ -550,10 +1228,9 @@ class sqlite {
 
     std::string fields = "(";
     std::string values = " values(";
-    auto it = auto_key_map_.find(name.data());
     for (auto i = 0; i < SIZE; ++i) {
       std::string field_name = iguana::get_name<T>(i).data();
-      if (it != auto_key_map_.end() && it->second == field_name)
+      if (auto_key == field_name)
         continue;
 
       values += "?";
@@ -573,8 +1250,13 @@ class sqlite {
 
   sqlite3 *handle_ = nullptr;
   sqlite3_stmt *stmt_ = nullptr;
-  std::map<std::string, std::string> auto_key_map_;
+  // see get_database_id
+  std::string database_;
   std::string last_error_;
+  bool has_error_ = false;
+  // the depth of the nested transactions
+  int transaction_depth_ = 0;
+  bool rollback_only_ = false;
   //        std::string auto_key_ = "";
 };
 }  // namespace ormpp
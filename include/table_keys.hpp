@@ -0,0 +1,48 @@
+#ifndef ORMPP_TABLE_KEYS_HPP
+#define ORMPP_TABLE_KEYS_HPP
+
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace ormpp {
+// the key and the auto increment key of a table, empty if there is none
+struct table_keys {
+  std::string key;
+  std::string auto_key;
+};
+
+// the keys of the tables set by create_datatable, shared by the connections to
+// the same database, so a pooled connection which didn't create a table knows
+// its keys; the database is the id of get_database_id
+class table_keys_registry {
+ public:
+  static table_keys_registry &instance() {
+    static table_keys_registry registry;
+    return registry;
+  }
+
+  table_keys get(const std::string &database, std::string_view table) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = keys_.find(database + std::string(table));
+    return it == keys_.end() ? table_keys{} : it->second;
+  }
+
+  // the keys of a table are replaced at once, a reader sees the old or the
+  // new ones
+  void set(const std::string &database, std::string_view table,
+           table_keys keys) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    keys_[database + std::string(table)] = std::move(keys);
+  }
+
+ private:
+  std::shared_mutex mutex_;
+  std::map<std::string, table_keys> keys_;
+};
+}  // namespace ormpp
+
+#endif  // ORMPP_TABLE_KEYS_HPP
@@ -0,0 +1,135 @@
+#ifndef ORMPP_THREAD_POOL_HPP
+#define ORMPP_THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ormpp {
+// a fixed set of threads shared by the connections of the process, such as to
+// decode the large results, so the threads are bounded however many queries
+// run at the same time
+class thread_pool {
+ public:
+  // the pool of the process, it has a thread per core, which are started on
+  // the first use
+  static thread_pool &instance() {
+    static thread_pool pool(
+        (std::max)(std::thread::hardware_concurrency(), 1u));
+    return pool;
+  }
+
+  explicit thread_pool(size_t threads) {
+    for (size_t i = 0; i < (std::max)(threads, size_t(1)); ++i) {
+      threads_.emplace_back([this] {
+        run();
+      });
+    }
+  }
+
+  ~thread_pool() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stopped_ = true;
+    }
+    not_empty_.notify_all();
+    for (auto &thd : threads_) {
+      thd.join();
+    }
+  }
+
+  thread_pool(const thread_pool &) = delete;
+  thread_pool &operator=(const thread_pool &) = delete;
+
+  size_t size() const { return threads_.size(); }
+
+  // call func(i) for each i in [0, count), at most helpers threads of the pool
+  // help the calling thread, which takes the indexes too, so it returns even
+  // if the threads are busy; it rethrows the first exception of func
+  template <typename Func>
+  void parallel_for(size_t count, size_t helpers, const Func &func) {
+    struct state_t {
+      std::atomic<size_t> next = 0;
+      size_t finished = 0;
+      std::exception_ptr error;
+      std::mutex mutex;
+      std::condition_variable done;
+    };
+    auto state = std::make_shared<state_t>();
+
+    // a late task finds no index left, so it never touches func after the
+    // return
+    auto work = [state, count, &func] {
+      size_t i;
+      while ((i = state->next++) < count) {
+        std::exception_ptr error;
+        try {
+          func(i);
+        } catch (...) {
+          error = std::current_exception();
+        }
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        if (error && !state->error)
+          state->error = error;
+        if (++state->finished == count)
+          state->done.notify_one();
+      }
+    };
+
+    helpers = (std::min)({helpers, size(), count == 0 ? 0 : count - 1});
+    if (helpers > 0) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < helpers; ++i) {
+          tasks_.push_back(work);
+        }
+      }
+      not_empty_.notify_all();
+    }
+
+    work();
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [&state, count] {
+      return state->finished == count;
+    });
+    if (state->error)
+      std::rethrow_exception(state->error);
+  }
+
+ private:
+  void run() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] {
+          return stopped_ || !tasks_.empty();
+        });
+        if (tasks_.empty())
+          return;
+
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::deque<std::function<void()>> tasks_;
+  bool stopped_ = false;
+  std::vector<std::thread> threads_;
+};
+}  // namespace ormpp
+
+#endif  // ORMPP_THREAD_POOL_HPP
@@ -13,6 +13,9 @@
 #ifdef ORMPP_ENABLE_SQLITE3
 #include <sqlite3.h>
 #endif
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#endif
 #include <string>
 #include <string_view>
 #include <vector>
@@ -24,6 +27,11 @@ using namespace std::string_view_literals;
 #ifndef EXAMPLE1_TYPE_MAPPING_HPP
 #define EXAMPLE1_TYPE_MAPPING_HPP
 
+// std::pmr::string fields are supported if the standard library has them
+#if defined(__cpp_lib_memory_resource)
+#define ORMPP_HAS_PMR
+#endif
+
 namespace ormpp {
 template <class T>
 struct identity {};
@@ -76,6 +84,11 @@ inline constexpr auto type_to_name(identity<int64_t>) noexcept {
 }
 inline constexpr auto type_to_name(identity<blob>) noexcept { return "BLOB"sv; }
 inline auto type_to_name(identity<std::string>) noexcept { return "TEXT"sv; }
+#ifdef ORMPP_HAS_PMR
+inline auto type_to_name(identity<std::pmr::string>) noexcept {
+  return "TEXT"sv;
+}
+#endif
 template <size_t N>
 inline auto type_to_name(identity<std::array<char, N>>) noexcept {
   std::string s = "varchar(" + std::to_string(N) + ")";
@@ -117,6 +130,11 @@ inline constexpr auto type_to_name(identity<int64_t>) noexcept {
   return "INTEGER"sv;
 }
 inline auto type_to_name(identity<std::string>) noexcept { return "TEXT"sv; }
+#ifdef ORMPP_HAS_PMR
+inline auto type_to_name(identity<std::pmr::string>) noexcept {
+  return "TEXT"sv;
+}
+#endif
 template <size_t N>
 inline auto type_to_name(identity<std::array<char, N>>) noexcept {
   std::string s = "varchar(" + std::to_string(N) + ")";
@@ -161,6 +179,11 @@ inline constexpr auto type_to_name(identity<int64_t>) noexcept {
   return "bigint"sv;
 }
 inline auto type_to_name(identity<std::string>) noexcept { return "text"sv; }
+#ifdef ORMPP_HAS_PMR
+inline auto type_to_name(identity<std::pmr::string>) noexcept {
+  return "text"sv;
+}
+#endif
 template <size_t N>
 inline auto type_to_name(identity<std::array<char, N>>) noexcept {
   std::string s = "varchar(" + std::to_string(N) + ")";
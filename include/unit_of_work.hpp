@@ -0,0 +1,177 @@
+#ifndef ORMPP_UNIT_OF_WORK_HPP
+#define ORMPP_UNIT_OF_WORK_HPP
+
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "dbng.hpp"
+
+namespace ormpp {
+// record the inserts, updates and deletes of many types and flush them in one
+// transaction, the operations of a type are sent as one batched statement per
+// operation, such as:
+// unit_of_work<dbng<mysql>> uow(conn);
+// uow.insert(order{1, ...});
+// uow.insert(order_item{1, 1, ...});
+// uow.remove(&cart::id, 3);
+// uow.flush();
+// the types are flushed in the order they are first used, so use the parent
+// types first; the inserts are flushed before the updates, the deletes are
+// flushed last and in the reverse order
+template <typename DB>
+class unit_of_work {
+ public:
+  explicit unit_of_work(DB &conn) : conn_(conn) {}
+
+  unit_of_work(const unit_of_work &) = delete;
+  unit_of_work &operator=(const unit_of_work &) = delete;
+
+  // all the fields are inserted, set the auto keys first, such as by a
+  // key_allocator
+  template <typename T>
+  void insert(T t) {
+    get_batch<insert_batch<T>, T>(phase::insert, "")
+        .rows.push_back(std::move(t));
+  }
+
+  // update by the key
+  template <typename T>
+  void update(T t) {
+    get_batch<update_batch<T>, T>(phase::update, "")
+        .rows.push_back(std::move(t));
+  }
+
+  // delete the row whose key field is value
+  template <typename T, typename K>
+  void remove(K T::*key, const std::decay_t<K> &value) {
+    auto &batch = get_batch<delete_batch<T, K>, T>(phase::remove,
+                                                   get_member_name(key));
+    batch.key = key;
+    batch.keys.push_back(value);
+  }
+
+  // the number of pending operations
+  size_t size() const {
+    size_t count = 0;
+    for (auto &batch : batches_) {
+      count += batch->size();
+    }
+    return count;
+  }
+
+  void clear() {
+    batches_.clear();
+    index_.clear();
+    order_.clear();
+  }
+
+  // send the pending operations in one transaction, they are cleared if it is
+  // committed, otherwise it is rolled back and they are kept
+  bool flush() {
+    if (batches_.empty())
+      return true;
+
+    std::vector<batch_base *> batches;
+    for (auto &batch : batches_) {
+      batches.push_back(batch.get());
+    }
+    std::stable_sort(batches.begin(), batches.end(),
+                     [](batch_base *lhs, batch_base *rhs) {
+                       return lhs->rank() < rhs->rank();
+                     });
+
+    if (!conn_.begin())
+      return false;
+
+    for (auto batch : batches) {
+      if (!batch->flush(conn_)) {
+        conn_.rollback();
+        return false;
+      }
+    }
+
+    if (!conn_.commit())
+      return false;
+
+    clear();
+    return true;
+  }
+
+ private:
+  enum class phase { insert, update, remove };
+
+  struct batch_base {
+    virtual ~batch_base() = default;
+    virtual size_t size() const = 0;
+    virtual bool flush(DB &conn) = 0;
+
+    std::pair<int, long long> rank() const {
+      // the children are deleted before the parents
+      long long pos = phase_ == phase::remove ? -(long long)order_
+                                              : (long long)order_;
+      return {(int)phase_, pos};
+    }
+
+    phase phase_ = phase::insert;
+    size_t order_ = 0;
+  };
+
+  template <typename T>
+  struct insert_batch : batch_base {
+    size_t size() const override { return rows.size(); }
+    bool flush(DB &conn) override { return conn.bulk_insert(rows) != INT_MIN; }
+
+    std::vector<T> rows;
+  };
+
+  template <typename T>
+  struct update_batch : batch_base {
+    size_t size() const override { return rows.size(); }
+    bool flush(DB &conn) override { return conn.bulk_update(rows) != INT_MIN; }
+
+    std::vector<T> rows;
+  };
+
+  template <typename T, typename K>
+  struct delete_batch : batch_base {
+    size_t size() const override { return keys.size(); }
+    bool flush(DB &conn) override { return conn.delete_by_keys(key, keys); }
+
+    K T::*key = nullptr;
+    std::vector<std::decay_t<K>> keys;
+  };
+
+  // the batch of one operation of T, the deletes are grouped by the key field
+  template <typename Batch, typename T>
+  Batch &get_batch(phase p, std::string_view field) {
+    std::string table(iguana::get_name<T>());
+    auto name = table + "/" + std::to_string((int)p) + "/" + std::string(field);
+    auto it = index_.find(name);
+    if (it != index_.end())
+      return *static_cast<Batch *>(it->second);
+
+    auto order = order_.emplace(table, order_.size()).first->second;
+    auto batch = std::make_unique<Batch>();
+    batch->phase_ = p;
+    batch->order_ = order;
+    auto &ref = *batch;
+    index_.emplace(std::move(name), batch.get());
+    batches_.push_back(std::move(batch));
+    return ref;
+  }
+
+  DB &conn_;
+  std::vector<std::unique_ptr<batch_base>> batches_;
+  std::map<std::string, batch_base *> index_;
+  // the order the types are first used
+  std::map<std::string, size_t> order_;
+};
+}  // namespace ormpp
+
+#endif  // ORMPP_UNIT_OF_WORK_HPP
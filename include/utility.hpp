@@ -3,6 +3,8 @@
 //
 #ifndef ORM_UTILITY_HPP
 #define ORM_UTILITY_HPP
+#include <algorithm>
+#include <new>
 #include <optional>
 
 #include "entity.hpp"
@@ -79,6 +81,114 @@ inline auto sort_tuple(const std::tuple<Args...> &tp) {
 
 enum class DBType { mysql, sqlite, postgresql, unknown };
 
+// the index-th(from 1) placeholder of a statement
+inline std::string get_placeholder(DBType type, size_t index) {
+  if (type == DBType::postgresql)
+    return "$" + std::to_string(index);
+  return "?";
+}
+
+// count placeholders from the index-th, such as: ?, ?, ? or $2, $3, $4
+inline std::string get_placeholders(DBType type, size_t index, size_t count) {
+  std::string placeholders;
+  for (size_t i = 0; i < count; ++i) {
+    if (i > 0)
+      placeholders += ", ";
+    placeholders += get_placeholder(type, index + i);
+  }
+  return placeholders;
+}
+
+// the identity of the database of the connect args, such as the key of the
+// queries and the table keys shared by the connections to the database; the
+// password isn't a part of it
+template <typename... Args>
+inline std::string get_database_id(DBType type, const Args &...args) {
+  std::string id;
+  size_t index = 0;
+  auto add = [type, &id, &index](const auto &arg) {
+    using U = std::decay_t<decltype(arg)>;
+    if (index++ == 2 && type != DBType::sqlite)
+      return;
+
+    if constexpr (std::is_arithmetic_v<U>)
+      id += std::to_string(arg);
+    else if constexpr (std::is_convertible_v<const U &, std::string_view>)
+      id += std::string_view(arg);
+    id += '\n';
+  };
+  (add(args), ...);
+  return id;
+}
+
+// a 32 bits hash of the text of the fields of a row, such as "id,name,age";
+// each field is hashed as its length, ':' and its text, or '-' if it is null,
+// so the values can't be mistaken for one another; the hashes of the backends
+// differ, sqlite uses the ormpp_crc32 function registered by the connection
+inline std::string get_row_hash_sql(DBType type, std::string_view fields) {
+  if (type == DBType::sqlite)
+    return "ormpp_crc32(" + std::string(fields) + ")";
+
+  std::string values;
+  while (!fields.empty()) {
+    auto pos = fields.find(',');
+    auto field = fields.substr(0, pos);
+    fields = pos == std::string_view::npos ? "" : fields.substr(pos + 1);
+    field.remove_prefix((std::min)(field.find_first_not_of(' '), field.size()));
+    field.remove_suffix(field.size() - field.find_last_not_of(' ') - 1);
+    if (!values.empty())
+      values.append(type == DBType::mysql ? ", " : " || ");
+    if (type == DBType::mysql)
+      values.append("coalesce(concat(length(")
+          .append(field)
+          .append("), ':', ")
+          .append(field)
+          .append("), '-')");
+    else
+      values.append("coalesce(length(")
+          .append(field)
+          .append("::text) || ':' || ")
+          .append(field)
+          .append("::text, '-')");
+  }
+
+  if (type == DBType::mysql)
+    return "crc32(concat(" + values + "))";
+  return "('x' || substr(md5(" + values + "), 1, 8))::bit(32)::bigint";
+}
+
+// the sum of the row hashes of a group as a 64 bits integer
+inline std::string get_rows_hash_sql(DBType type, std::string_view fields) {
+  auto sum = "coalesce(sum(" + get_row_hash_sql(type, fields) + "), 0)";
+  if (type == DBType::mysql)
+    return "cast(" + sum + " as signed)";
+  if (type == DBType::postgresql)
+    return sum + "::bigint";
+  return sum;
+}
+
+// a std::vector arg(except blob) is bound to as many placeholders as its size,
+// such as: execute("delete from person where id in (?, ?, ?)", ids)
+template <typename T>
+struct is_param_list : std::false_type {};
+
+template <typename T>
+struct is_param_list<std::vector<T>>
+    : std::bool_constant<!std::is_same_v<T, char>> {};
+
+template <typename... Args>
+inline size_t get_params_size(const Args &...args) {
+  size_t size = 0;
+  auto count = [&size](const auto &arg) {
+    if constexpr (is_param_list<std::decay_t<decltype(arg)>>::value)
+      size += arg.size();
+    else
+      ++size;
+  };
+  (count(args), ...);
+  return size;
+}
+
 template <typename T>
 inline constexpr auto get_type_names(DBType type) {
   constexpr auto SIZE = iguana::get_value<T>();
@@ -136,7 +246,7 @@ inline void for_each0(const std::tuple<Args...> &t, Func &&f,
 template <typename T, typename = std::enable_if_t<iguana::is_reflection_v<T>>>
 inline std::string get_name() {
 #ifdef ORMPP_ENABLE_PG
-  std::string quota_name = "'" + std::string(iguana::get_name<T>()) + "'";
+  std::string quota_name = "\"" + std::string(iguana::get_name<T>()) + "\"";
 #else
   std::string quota_name = "`" + std::string(iguana::get_name<T>()) + "`";
 #endif
@@ -144,6 +254,73 @@ inline std::string get_name() {
   return quota_name;
 }
 
+// the columns of T to fetch, such as: query<T>(select(&T::id, &T::name))
+template <typename T, typename... Members>
+struct selection {
+  std::tuple<Members T::*...> members;
+};
+
+template <typename T, typename... Members>
+inline auto select(Members T::*...members) {
+  static_assert(sizeof...(Members) > 0, "select at least one field");
+  return selection<T, Members...>{std::make_tuple(members...)};
+}
+
+template <typename T>
+struct is_selection : std::false_type {};
+
+template <typename T, typename... Members>
+struct is_selection<selection<T, Members...>> : std::true_type {};
+
+template <typename... Args>
+struct is_selection_args : std::false_type {};
+
+template <typename Arg, typename... Args>
+struct is_selection_args<Arg, Args...>
+    : is_selection<std::remove_const_t<std::remove_reference_t<Arg>>> {};
+
+template <typename T, typename U>
+inline std::string_view get_member_name(U T::*member) {
+  std::string_view name;
+  iguana::for_each(iguana::Reflect_members<T>::apply_impl(),
+                   [member, &name](auto item, auto i) {
+                     if constexpr (std::is_same_v<decltype(item), U T::*>) {
+                       if (item == member)
+                         name = iguana::get_name<T>(decltype(i)::value);
+                     }
+                   });
+  return name;
+}
+
+template <typename T, typename... Members>
+inline std::string get_fields(const selection<T, Members...> &sel) {
+  std::string fields;
+  std::apply(
+      [&fields](auto... members) {
+        ((fields.append(get_member_name(members)).append(", ")), ...);
+      },
+      sel.members);
+  fields.resize(fields.size() - 2);
+  return fields;
+}
+
+// the member pointers to decode a row of T: the selected ones if the first
+// arg is a selection, otherwise all the reflected fields
+template <typename T>
+inline auto get_members() {
+  return iguana::Reflect_members<T>::apply_impl();
+}
+
+template <typename T, typename Arg, typename... Args>
+inline auto get_members(const Arg &arg, const Args &.../*args*/) {
+  if constexpr (is_selection<Arg>::value) {
+    return arg.members;
+  }
+  else {
+    return iguana::Reflect_members<T>::apply_impl();
+  }
+}
+
 template <typename T>
 inline std::string generate_insert_sql(bool replace) {
   std::string sql = replace ? "replace into " : "insert into ";
@@ -164,8 +341,7 @@ inline std::string generate_insert_sql(bool replace) {
 }
 
 template <typename T>
-inline std::string generate_auto_insert_sql(
-    std::map<std::string, std::string> & /*auto_key_map_*/, bool replace) {
+inline std::string generate_auto_insert_sql(bool replace) {
   std::string sql = replace ? "replace into " : "insert into ";
   constexpr auto SIZE = iguana::get_value<T>();
   auto name = get_name<T>();
@@ -173,7 +349,6 @@ inline std::string generate_auto_insert_sql(
 
   std::string fields = "(";
   std::string values = " values(";
-  // auto it = auto_key_map_.find(name.data());
   for (size_t i = 0; i < SIZE; ++i) {
     std::string field_name = iguana::get_name<T>(i).data();
     /* if(it!=auto_key_map_.end()&&it->second==field_name)
@@ -201,11 +376,301 @@ template <class T>
 constexpr bool is_char_array_v = std::is_array_v<T>
     &&std::is_same_v<char, std::remove_pointer_t<std::decay_t<T>>>;
 
+// std::string or std::pmr::string
+template <typename T>
+struct is_string : std::is_same<T, std::string> {};
+
+#ifdef ORMPP_HAS_PMR
+template <>
+struct is_string<std::pmr::string> : std::true_type {};
+#endif
+
+template <typename T>
+inline constexpr bool is_string_v = is_string<T>::value;
+
+// a row to decode into, its std::pmr::string fields allocate from the
+// memory resource of a std::pmr::vector
+template <typename T, typename Alloc>
+inline T make_row(const std::vector<T, Alloc> & /*rows*/) {
+  return T{};
+}
+
+#ifdef ORMPP_HAS_PMR
+template <typename T>
+inline T make_row(const std::pmr::vector<T> &rows) {
+  T t{};
+  auto resource = rows.get_allocator().resource();
+  iguana::for_each(t, [&t, resource](auto item, auto /*i*/) {
+    using U = std::remove_reference_t<decltype(t.*item)>;
+    if constexpr (std::is_same_v<U, std::pmr::string>) {
+      // the allocator of a string is only set by its constructor
+      (t.*item).~U();
+      ::new ((void *)&(t.*item)) U(resource);
+    }
+  });
+  return t;
+}
+#endif
+
 template <size_t N>
 inline constexpr size_t char_array_size(char (&)[N]) {
   return N;
 }
 
+template <typename Members>
+inline std::vector<std::string_view> get_member_names(const Members &members) {
+  std::vector<std::string_view> names;
+  iguana::for_each(members, [&names](auto item, auto /*i*/) {
+    names.push_back(get_member_name(item));
+  });
+  return names;
+}
+
+// the fields to set, the condition fields are not updated
+inline std::vector<std::string_view> get_update_fields(
+    const std::vector<std::string_view> &names,
+    const std::vector<std::string> &conditions) {
+  std::vector<std::string_view> fields;
+  for (auto &name : names) {
+    if (std::find(conditions.begin(), conditions.end(), name) ==
+        conditions.end())
+      fields.push_back(name);
+  }
+  return fields;
+}
+
+// update name set a = ?, b = ? where key = ?
+template <typename T>
+inline std::string generate_update_sql(
+    DBType type, const std::vector<std::string_view> &fields,
+    const std::vector<std::string> &conditions) {
+  std::string sql = "update ";
+  append(sql, get_name<T>(), "set");
+  size_t index = 0;
+  for (auto &field : fields) {
+    if (index > 0)
+      sql += ", ";
+    append(sql, field, "=", get_placeholder(type, ++index));
+  }
+
+  sql += "where ";
+  for (size_t i = 0; i < conditions.size(); ++i) {
+    if (i > 0)
+      sql += "and ";
+    append(sql, conditions[i], "=", get_placeholder(type, ++index));
+  }
+
+  return sql;
+}
+
+// the placeholder position(from 1) of every field of T in the update sql, 0
+// means the field is not bound
+template <typename T>
+inline auto get_update_positions(const std::vector<std::string_view> &fields,
+                                 const std::vector<std::string> &conditions) {
+  std::array<size_t, iguana::get_value<T>()> positions = {};
+  auto arr = iguana::get_array<T>();
+  for (size_t i = 0; i < arr.size(); ++i) {
+    auto it = std::find(fields.begin(), fields.end(), arr[i]);
+    if (it != fields.end()) {
+      positions[i] = std::distance(fields.begin(), it) + 1;
+      continue;
+    }
+
+    auto it1 = std::find(conditions.begin(), conditions.end(), arr[i]);
+    if (it1 != conditions.end())
+      positions[i] = fields.size() + std::distance(conditions.begin(), it1) + 1;
+  }
+  return positions;
+}
+
+// the fields to set by the keys, all the fields except the keys by default
+template <typename T, typename... Members>
+inline std::vector<std::string_view> get_set_fields(
+    const std::vector<std::string> &keys, Members T::*...members) {
+  if constexpr (sizeof...(Members) == 0) {
+    return get_update_fields(get_member_names(get_members<T>()), keys);
+  }
+  else {
+    return get_update_fields(get_member_names(std::make_tuple(members...)),
+                             keys);
+  }
+}
+
+// the max number of bound parameters of one statement, sqlite before 3.32
+// only allows 999
+inline constexpr size_t max_batch_params = 999;
+
+// how many rows of T are sent in one multi-row statement
+template <typename T>
+inline constexpr size_t get_batch_rows() {
+  constexpr size_t SIZE = iguana::get_value<T>();
+  return max_batch_params / SIZE > 0 ? max_batch_params / SIZE : 1;
+}
+
+// insert into name(a, b) values(?, ?), (?, ?), the skip field is not inserted
+template <typename T>
+inline std::string generate_insert_rows_sql(DBType type, size_t rows,
+                                            std::string_view skip = "") {
+  auto arr = iguana::get_array<T>();
+  std::string fields;
+  size_t field_count = 0;
+  for (auto &field : arr) {
+    if (field == skip)
+      continue;
+    if (field_count++ > 0)
+      fields += ", ";
+    fields += field;
+  }
+
+  std::string sql = "insert into ";
+  sql.append(get_name<T>()).append("(").append(fields).append(") values");
+  size_t index = 0;
+  for (size_t row = 0; row < rows; ++row) {
+    sql += row == 0 ? "(" : ", (";
+    for (size_t i = 0; i < field_count; ++i) {
+      if (i > 0)
+        sql += ", ";
+      sql += get_placeholder(type, ++index);
+    }
+    sql += ")";
+  }
+
+  return sql;
+}
+
+// insert into name(a, b) values(?, ?), (?, ?) on conflict(a) do update set
+// b = excluded.b, mysql uses on duplicate key update b = values(b)
+template <typename T>
+inline std::string generate_upsert_sql(
+    DBType type, const std::vector<std::string> &keys,
+    const std::vector<std::string_view> &fields, size_t rows) {
+  std::string sql = generate_insert_rows_sql<T>(type, rows);
+
+  if (type == DBType::mysql) {
+    sql += " on duplicate key update ";
+    if (fields.empty())
+      return sql + keys.front() + " = " + keys.front();
+  }
+  else {
+    sql += " on conflict(";
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (i > 0)
+        sql += ", ";
+      sql += keys[i];
+    }
+    if (fields.empty())
+      return sql + ") do nothing";
+    sql += ") do update set ";
+  }
+
+  for (size_t i = 0; i < fields.size(); ++i) {
+    if (i > 0)
+      sql += ", ";
+    sql.append(fields[i]).append(" = ");
+    if (type == DBType::mysql)
+      sql.append("values(").append(fields[i]).append(")");
+    else
+      sql.append("excluded.").append(fields[i]);
+  }
+
+  return sql;
+}
+
+// update many rows by the keys in one statement, the rows are joined to the
+// table as the derived table v:
+// mysql: update t join (select ? as a, ? as b union all select ?, ?) as v
+//        on t.a = v.a set t.b = v.b
+// postgresql: update t set b = v.b from (values($1::integer, $2::text), ...)
+//             as v(a, b) where t.a = v.a
+// sqlite: with v(a, b) as (values(?, ?), ...) update t set b = v.b from v
+//         where t.a = v.a
+template <typename T>
+inline std::string generate_bulk_update_sql(
+    DBType type, const std::vector<std::string> &keys,
+    const std::vector<std::string_view> &fields, size_t rows) {
+  constexpr auto SIZE = iguana::get_value<T>();
+  auto name = get_name<T>();
+  auto arr = iguana::get_array<T>();
+  auto type_names = get_type_names<T>(type);
+
+  std::string values;
+  size_t index = 0;
+  for (size_t row = 0; row < rows; ++row) {
+    if (row > 0)
+      values += type == DBType::mysql ? " union all " : ", ";
+    values += type == DBType::mysql ? "select " : "(";
+    for (size_t i = 0; i < SIZE; ++i) {
+      if (i > 0)
+        values += ", ";
+      values += get_placeholder(type, ++index);
+      if (type == DBType::postgresql)
+        values.append("::").append(type_names[i]);
+      else if (type == DBType::mysql && row == 0)
+        values.append(" as ").append(arr[i]);
+    }
+    if (type != DBType::mysql)
+      values += ")";
+  }
+
+  std::string set;
+  for (size_t i = 0; i < fields.size(); ++i) {
+    if (i > 0)
+      set += ", ";
+    if (type == DBType::mysql)
+      set.append(name).append(".");
+    set.append(fields[i]).append(" = v.").append(fields[i]);
+  }
+
+  std::string on;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (i > 0)
+      on += " and ";
+    on.append(name).append(".").append(keys[i]);
+    on.append(" = v.").append(keys[i]);
+  }
+
+  std::string columns(iguana::get_fields<T>());
+  if (type == DBType::mysql) {
+    return "update " + name + " join (" + values + ") as v on " + on +
+           " set " + set;
+  }
+  else if (type == DBType::postgresql) {
+    return "update " + name + " set " + set + " from (values " + values +
+           ") as v(" + columns + ") where " + on;
+  }
+
+  return "with v(" + columns + ") as (values " + values + ") update " + name +
+         " set " + set + " from v where " + on;
+}
+
+// set the arithmetic field of t named name, such as the generated auto key
+template <typename T, typename V>
+inline void set_field_value(T &t, std::string_view name, V value) {
+  iguana::for_each(t, [&t, name, value](auto item, auto i) {
+    using U = std::remove_reference_t<decltype(t.*item)>;
+    if constexpr (std::is_arithmetic_v<U>) {
+      if (iguana::get_name<T>(decltype(i)::value) == name)
+        t.*item = (U)value;
+    }
+  });
+}
+
+// true if the arithmetic field of t named name isn't 0, such as an auto key
+// assigned by the caller
+template <typename T>
+inline bool is_field_set(const T &t, std::string_view name) {
+  bool set = false;
+  iguana::for_each(t, [&t, name, &set](auto item, auto i) {
+    using U = std::remove_const_t<std::remove_reference_t<decltype(t.*item)>>;
+    if constexpr (std::is_arithmetic_v<U>) {
+      if (iguana::get_name<T>(decltype(i)::value) == name)
+        set = t.*item != 0;
+    }
+  });
+  return set;
+}
+
 template <typename T, typename... Args>
 inline std::string generate_delete_sql(Args &&...where_conditon) {
   std::string sql = "delete from ";
@@ -248,13 +713,13 @@ inline void get_sql_conditions(std::string &sql, const std::string &arg,
 }
 
 template <typename T, typename... Args>
-inline std::string generate_query_sql(Args &&...args) {
+inline std::string generate_select_sql(const std::string &fields,
+                                       Args &&...args) {
   constexpr size_t param_size = sizeof...(Args);
   static_assert(param_size == 0 || param_size > 0);
   std::string sql = "select ";
   auto name = get_name<T>();
-  auto fields = iguana::get_fields<T>();
-  append(sql, fields.data(), "from", name.data());
+  append(sql, fields, "from", name.data());
 
   std::string where_sql = "";
   if constexpr (param_size > 0) {
@@ -265,6 +730,19 @@ inline std::string generate_query_sql(Args &&...args) {
   return sql;
 }
 
+template <typename T, typename... Args>
+inline std::enable_if_t<!is_selection_args<Args...>::value, std::string>
+generate_query_sql(Args &&...args) {
+  return generate_select_sql<T>(std::string(iguana::get_fields<T>()),
+                                std::forward<Args>(args)...);
+}
+
+template <typename T, typename... Members, typename... Args>
+inline std::string generate_query_sql(const selection<T, Members...> &sel,
+                                      Args &&...args) {
+  return generate_select_sql<T>(get_fields(sel), std::forward<Args>(args)...);
+}
+
 template <typename T>
 inline constexpr auto to_str(T &&t) {
   if constexpr (std::is_arithmetic_v<std::decay_t<T>>) {
@@ -275,21 +753,6 @@ inline constexpr auto to_str(T &&t) {
   }
 }
 
-inline void get_str(std::string &sql, const std::string &s) {
-  auto pos = sql.find_first_of('?');
-  sql.replace(pos, 1, " ");
-  sql.insert(pos, s);
-}
-
-template <typename... Args>
-inline std::string get_sql(const std::string &o, Args &&...args) {
-  auto sql = o;
-  std::string s = "";
-  (get_str(sql, to_str(args)), ...);
-
-  return sql;
-}
-
 template <typename T>
 struct field_attribute;
 
@@ -10,10 +10,18 @@
 #include "postgresql.hpp"
 #endif
 
+#include "batch_loader.hpp"
+#include "column_ops.hpp"
 #include "connection_pool.hpp"
+#include "copy_table.hpp"
 #include "dbng.hpp"
 #include "doctest.h"
+#include "key_allocator.hpp"
 #include "ormpp_cfg.hpp"
+#include "parallel_scan.hpp"
+#include "sharded_dbng.hpp"
+#include "thread_pool.hpp"
+#include "unit_of_work.hpp"
 
 using namespace std::string_literals;
 
@@ -46,6 +54,41 @@ struct simple {
 };
 REFLECTION(simple, id, code, age);
 
+struct cached_person {
+  int id;
+  std::string name;
+  int age;
+};
+REFLECTION(cached_person, id, name, age)
+ORMPP_ENTITY_CACHE(cached_person, id, 100, 60)
+
+#ifdef ORMPP_HAS_PMR
+struct pmr_person {
+  int id;
+  std::pmr::string name;
+  int age;
+};
+REFLECTION(pmr_person, id, name, age)
+
+// count the allocations and forward them to the new_delete_resource
+class counting_resource : public std::pmr::memory_resource {
+ public:
+  size_t count = 0;
+
+ private:
+  void *do_allocate(size_t bytes, size_t align) override {
+    ++count;
+    return std::pmr::new_delete_resource()->allocate(bytes, align);
+  }
+  void do_deallocate(void *p, size_t bytes, size_t align) override {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+  }
+  bool do_is_equal(const memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+};
+#endif
+
 // TEST_CASE(mysql_performance){
 //    dbng<mysql> mysql;
 //
@@ -514,148 +557,2273 @@ TEST_CASE("orm_multi_update") {
 #endif
 }
 
-TEST_CASE("orm_delete") {
+TEST_CASE("orm_update_fields") {
   ormpp_key key{"code"};
   ormpp_not_null not_null{{"code", "age"}};
-  ormpp_auto_key auto_key{"code"};
 
   student s = {1, "tom", 0, 19, 1.5, "room2"};
   student s1 = {2, "jack", 1, 20, 2.5, "room3"};
-  student s2 = {3, "mike", 2, 21, 3.5, "room4"};
-  std::vector<student> v{s, s1, s2};
+  std::vector<student> v{s, s1};
 
 #ifdef ORMPP_ENABLE_MYSQL
   dbng<mysql> mysql;
   REQUIRE(mysql.connect(ip, "root", password, db));
-  mysql.delete_records<student>();
   REQUIRE(mysql.create_datatable<student>(key, not_null));
-  CHECK(mysql.insert(v) == 3);
-  REQUIRE(mysql.delete_records<student>("code=1"));
-  CHECK(mysql.query<student>().size() == 2);
-  REQUIRE(mysql.delete_records<student>(""));
-  auto result = mysql.query<student>();
-  CHECK(result.size() == 0);
+  CHECK(mysql.delete_records<student>());
+  CHECK(mysql.insert(v) == 2);
+  student u = {1, "tony", 0, 30, 9.5, "room9"};
+  CHECK(mysql.update_fields(u, &student::name, &student::age) == 1);
+  auto result = mysql.query<student>("code > 0 order by code");
+  REQUIRE(result.size() == 2);
+  CHECK(result[0].name == "tony");
+  CHECK(result[0].age == 30);
+  CHECK(result[0].classroom == "room2");
+  CHECK(result[1].name == "jack");
 #endif
 
 #ifdef ORMPP_ENABLE_PG
   dbng<postgresql> postgres;
   REQUIRE(postgres.connect(ip, "root", password, db));
   REQUIRE(postgres.create_datatable<student>(key, not_null));
-  CHECK(postgres.insert(v) == 3);
-  REQUIRE(postgres.delete_records<student>("code=1"));
-  CHECK(postgres.query<student>().size() == 2);
-  REQUIRE(postgres.delete_records<student>(""));
-  auto result1 = postgres.query<student>();
-  CHECK(result1.size() == 0);
+  CHECK(postgres.delete_records<student>());
+  CHECK(postgres.insert(v) == 2);
+  student u1 = {1, "tony", 0, 30, 9.5, "room9"};
+  CHECK(postgres.update_fields(u1, &student::name, &student::age) == 1);
+  auto result1 = postgres.query<student>("code > 0 order by code");
+  REQUIRE(result1.size() == 2);
+  CHECK(result1[0].name == "tony");
+  CHECK(result1[0].age == 30);
+  CHECK(result1[0].classroom == "room2");
+  CHECK(result1[1].name == "jack");
 #endif
 
 #ifdef ORMPP_ENABLE_SQLITE3
   dbng<sqlite> sqlite;
   REQUIRE(sqlite.connect(db));
+  CHECK(sqlite.delete_records<student>());
   REQUIRE(sqlite.create_datatable<student>(key));
-  sqlite.delete_records<student>();
-  CHECK(sqlite.insert(v) == 3);
-  REQUIRE(sqlite.delete_records<student>("code=1"));
-  CHECK(sqlite.query<student>().size() == 2);
-  REQUIRE(sqlite.delete_records<student>(""));
-  auto result2 = sqlite.query<student>();
-  CHECK(result2.size() == 0);
+  CHECK(sqlite.insert(v) == 2);
+  student u2 = {1, "tony", 0, 30, 9.5, "room9"};
+  CHECK(sqlite.update_fields(u2, &student::name, &student::age) == 1);
+  auto result2 = sqlite.query<student>("code > 0 order by code");
+  REQUIRE(result2.size() == 2);
+  CHECK(result2[0].name == "tony");
+  CHECK(result2[0].age == 30);
+  CHECK(result2[0].classroom == "room2");
+  CHECK(result2[1].name == "jack");
+
+  u2.classroom = "room8";
+  CHECK(sqlite.update(u2) == 1);
+  result2 = sqlite.query<student>("code > 0 order by code");
+  REQUIRE(result2.size() == 2);
+  CHECK(result2[0].classroom == "room8");
+  CHECK(result2[0].dm == 9.5);
+  CHECK(result2[1].classroom == "room3");
+  CHECK(sqlite.update_fields(u2, &student::code) == INT_MIN);
+
+  // the keys are known by the connections which didn't create the table
+  dbng<ormpp::sqlite> other;
+  REQUIRE(other.connect(db));
+  u2.name = "mike";
+  CHECK(other.update_fields(u2, &student::name) == 1);
+  CHECK(other.query<student>("name = 'mike'").size() == 1);
+
+  // the keys of a table in another database don't leak, a table without key
+  // is updated by replace
+  dbng<ormpp::sqlite> keyless;
+  REQUIRE(keyless.connect("test_ormpp_keyless"));
+  CHECK(keyless.execute("drop table if exists person"));
+  REQUIRE(keyless.create_datatable<person>());
+  REQUIRE(sqlite.create_datatable<person>(ormpp_key{"id"}));
+  CHECK(keyless.insert(person{1, "tom", 20}) == 1);
+  CHECK(keyless.update(person{1, "jack", 20}) == 1);
+  CHECK(keyless.query<person>().size() == 2);
 #endif
 }
 
-TEST_CASE("orm_query") {
-  ormpp_key key{"id"};
-  simple s1 = {1, 2.5, 3};
-  simple s2 = {2, 3.5, 4};
-  simple s3 = {3, 4.5, 5};
-  std::vector<simple> v{s1, s2, s3};
+TEST_CASE("orm_upsert") {
+  ormpp_key key{"code"};
+  ormpp_not_null not_null{{"code", "age"}};
+
+  student s = {1, "tom", 0, 19, 1.5, "room2"};
+  std::vector<student> v;
+  for (int i = 0; i < 400; ++i) {
+    v.push_back(student{i + 1, "jack", 1, 20, 2.5, "room3"});
+  }
 
 #ifdef ORMPP_ENABLE_MYSQL
   dbng<mysql> mysql;
   REQUIRE(mysql.connect(ip, "root", password, db));
-  mysql.delete_records<simple>();
-  REQUIRE(mysql.create_datatable<simple>(key));
-  CHECK(mysql.insert(v) == 3);
-  auto result = mysql.query<simple>();
-  CHECK(result.size() == 3);
-  auto result3 = mysql.query<simple>("id=1");
-  CHECK(result3.size() == 1);
+  REQUIRE(mysql.create_datatable<student>(key, not_null));
+  CHECK(mysql.delete_records<student>());
+  CHECK(mysql.insert(s) == 1);
+  CHECK(mysql.upsert(v) == 400);
+  CHECK(mysql.count<student>() == 400);
+  CHECK(mysql.upsert(s, &student::name) == 1);
+  auto result = mysql.query<student>("code = 1");
+  REQUIRE(result.size() == 1);
+  CHECK(result[0].name == "tom");
+  CHECK(result[0].classroom == "room3");
+#endif
+
+#ifdef ORMPP_ENABLE_PG
+  dbng<postgresql> postgres;
+  REQUIRE(postgres.connect(ip, "root", password, db));
+  REQUIRE(postgres.create_datatable<student>(key, not_null));
+  CHECK(postgres.delete_records<student>());
+  CHECK(postgres.insert(s) == 1);
+  CHECK(postgres.upsert(v) == 400);
+  CHECK(postgres.count<student>() == 400);
+  CHECK(postgres.upsert(s, &student::name) == 1);
+  auto result1 = postgres.query<student>("code = 1");
+  REQUIRE(result1.size() == 1);
+  CHECK(result1[0].name == "tom");
+  CHECK(result1[0].classroom == "room3");
 #endif
 
 #ifdef ORMPP_ENABLE_SQLITE3
   dbng<sqlite> sqlite;
   REQUIRE(sqlite.connect(db));
-  REQUIRE(sqlite.create_datatable<simple>(key));
-  sqlite.delete_records<simple>();
-  CHECK(sqlite.insert(v) == 3);
-  auto result2 = sqlite.query<simple>();
-  CHECK(result2.size() == 3);
-  auto result5 = sqlite.query<simple>("id=3");
-  CHECK(result5.size() == 1);
+  CHECK(sqlite.delete_records<student>());
+  REQUIRE(sqlite.create_datatable<student>(key));
+  CHECK(sqlite.insert(s) == 1);
+  CHECK(sqlite.upsert(v) == 400);
+  CHECK(sqlite.count<student>() == 400);
+  CHECK(sqlite.upsert(s, &student::name) == 1);
+  auto result2 = sqlite.query<student>("code = 1");
+  REQUIRE(result2.size() == 1);
+  CHECK(result2[0].name == "tom");
+  CHECK(result2[0].classroom == "room3");
+
+  // there is no key to detect the conflict
+  REQUIRE(sqlite.create_datatable<person>());
+  CHECK(sqlite.upsert(person{1, "tom", 20}) == INT_MIN);
+#endif
+}
+
+TEST_CASE("orm_bulk_update") {
+  ormpp_key key{"code"};
+  ormpp_not_null not_null{{"code", "age"}};
+
+  std::vector<student> v;
+  for (int i = 0; i < 400; ++i) {
+    v.push_back(student{i + 1, "jack", 1, 20, 2.5, "room3"});
+  }
+
+  std::vector<student> v1 = v;
+  for (auto &s : v1) {
+    s.name = "tom" + std::to_string(s.code);
+    s.age = s.code;
+  }
+
+#ifdef ORMPP_ENABLE_MYSQL
+  dbng<mysql> mysql;
+  REQUIRE(mysql.connect(ip, "root", password, db));
+  REQUIRE(mysql.create_datatable<student>(key, not_null));
+  CHECK(mysql.delete_records<student>());
+  CHECK(mysql.insert(v) == 400);
+  CHECK(mysql.bulk_update(v1, &student::age) == 400);
+  CHECK(mysql.count<student>("name = 'jack' and age = code") == 400);
+  CHECK(mysql.bulk_update(v1) == 400);
+  auto result = mysql.query<student>("code = 400");
+  REQUIRE(result.size() == 1);
+  CHECK(result[0].name == "tom400");
 #endif
 
 #ifdef ORMPP_ENABLE_PG
   dbng<postgresql> postgres;
   REQUIRE(postgres.connect(ip, "root", password, db));
-  REQUIRE(postgres.create_datatable<simple>(key));
-  CHECK(postgres.insert(v) == 3);
-  auto result1 = postgres.query<simple>();
-  CHECK(result1.size() == 3);
-  auto result4 = postgres.query<simple>("where id=2");
-  CHECK(result4.size() == 1);
+  REQUIRE(postgres.create_datatable<student>(key, not_null));
+  CHECK(postgres.delete_records<student>());
+  CHECK(postgres.insert(v) == 400);
+  CHECK(postgres.bulk_update(v1, &student::age) == 400);
+  CHECK(postgres.count<student>("name = 'jack' and age = code") == 400);
+  CHECK(postgres.bulk_update(v1) == 400);
+  auto result1 = postgres.query<student>("code = 400");
+  REQUIRE(result1.size() == 1);
+  CHECK(result1[0].name == "tom400");
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+  dbng<sqlite> sqlite;
+  REQUIRE(sqlite.connect(db));
+  CHECK(sqlite.delete_records<student>());
+  REQUIRE(sqlite.create_datatable<student>(key));
+  CHECK(sqlite.insert(v) == 400);
+  CHECK(sqlite.bulk_update(v1, &student::age) == 400);
+  CHECK(sqlite.count<student>("name = 'jack' and age = code") == 400);
+  CHECK(sqlite.bulk_update(v1) == 400);
+  auto result2 = sqlite.query<student>("code = 400");
+  REQUIRE(result2.size() == 1);
+  CHECK(result2[0].name == "tom400");
 #endif
 }
 
-TEST_CASE("orm_query_some") {
+TEST_CASE("orm_by_keys") {
   ormpp_key key{"code"};
   ormpp_not_null not_null{{"code", "age"}};
-  ormpp_auto_key auto_key{"code"};
 
-  student s = {1, "tom", 0, 19, 1.5, "room2"};
-  student s1 = {2, "jack", 1, 20, 2.5, "room3"};
-  student s2 = {3, "mike", 2, 21, 3.5, "room4"};
-  std::vector<student> v{s, s1, s2};
+  std::vector<student> v;
+  for (int i = 0; i < 1200; ++i) {
+    v.push_back(student{i + 1, "jack" + std::to_string(i + 1), 1, 20, 2.5,
+                        "room3"});
+  }
+
+  std::vector<int> keys{3, 1200, 0, 3, 1};
+  std::vector<int> all_keys;
+  for (int i = 0; i < 1100; ++i) {
+    all_keys.push_back(i + 1);
+  }
 
 #ifdef ORMPP_ENABLE_MYSQL
   dbng<mysql> mysql;
   REQUIRE(mysql.connect(ip, "root", password, db));
-  mysql.delete_records<student>();
   REQUIRE(mysql.create_datatable<student>(key, not_null));
-  CHECK(mysql.insert(v) == 3);
-  auto result3 = mysql.query<std::tuple<int>>("select count(1) from student");
-  CHECK(result3.size() == 1);
-  CHECK(std::get<0>(result3[0]) == 3);
-
-  auto result4 = mysql.query<std::tuple<int>>("select count(1) from student");
-  CHECK(result4.size() == 1);
-  CHECK(std::get<0>(result4[0]) == 3);
-
-  auto result5 = mysql.query<std::tuple<int>>("select count(1) from student");
-  CHECK(result5.size() == 1);
-  CHECK(std::get<0>(result5[0]) == 3);
-  auto result = mysql.query<std::tuple<int, std::string, double>>(
-      "select code, name, dm from student");
-  CHECK(result.size() == 3);
+  CHECK(mysql.delete_records<student>());
+  CHECK(mysql.insert(v) == 1200);
+  auto result = mysql.get_by_keys(&student::code, keys);
+  REQUIRE(result.size() == 5);
+  CHECK(result[0]->name == "jack3");
+  CHECK(result[1]->name == "jack1200");
+  CHECK(!result[2]);
+  CHECK(result[3]->name == "jack3");
+  CHECK(result[4]->name == "jack1");
+  CHECK(mysql.delete_by_keys(&student::code, all_keys));
+  CHECK(mysql.count<student>() == 100);
 #endif
 
 #ifdef ORMPP_ENABLE_PG
   dbng<postgresql> postgres;
   REQUIRE(postgres.connect(ip, "root", password, db));
   REQUIRE(postgres.create_datatable<student>(key, not_null));
-  CHECK(postgres.insert(v) == 3);
-  auto result1 = postgres.query<std::tuple<int, std::string, double>>(
-      "select code, name, dm from student");
-  CHECK(result1.size() == 3);
+  CHECK(postgres.delete_records<student>());
+  CHECK(postgres.insert(v) == 1200);
+  auto result1 = postgres.get_by_keys(&student::code, keys);
+  REQUIRE(result1.size() == 5);
+  CHECK(result1[0]->name == "jack3");
+  CHECK(result1[1]->name == "jack1200");
+  CHECK(!result1[2]);
+  CHECK(result1[3]->name == "jack3");
+  CHECK(result1[4]->name == "jack1");
+  CHECK(postgres.delete_by_keys(&student::code, all_keys));
+  CHECK(postgres.count<student>() == 100);
 #endif
 
 #ifdef ORMPP_ENABLE_SQLITE3
   dbng<sqlite> sqlite;
   REQUIRE(sqlite.connect(db));
-  CHECK(sqlite.insert(v) == 3);
+  CHECK(sqlite.delete_records<student>());
   REQUIRE(sqlite.create_datatable<student>(key));
-  auto result2 = sqlite.query<std::tuple<int, std::string, double>>(
-      "select code, name, dm from student");
-  CHECK(result2.size() == 3);
+  CHECK(sqlite.insert(v) == 1200);
+  auto result2 = sqlite.get_by_keys(&student::code, keys);
+  REQUIRE(result2.size() == 5);
+  CHECK(result2[0]->name == "jack3");
+  CHECK(result2[1]->name == "jack1200");
+  CHECK(!result2[2]);
+  CHECK(result2[3]->name == "jack3");
+  CHECK(result2[4]->name == "jack1");
+  CHECK(sqlite.delete_by_keys(&student::code, all_keys));
+  CHECK(sqlite.count<student>() == 100);
+
+  auto rows = sqlite.query<std::tuple<int>>(
+      "select code from student where code in (?, ?, ?)",
+      std::vector<int>{1101, 1102, 1});
+  CHECK(rows.size() == 2);
+#endif
+}
+
+#ifdef ORMPP_ENABLE_SQLITE3
+TEST_CASE("orm_batch_loader") {
+  {
+    dbng<sqlite> sqlite;
+    REQUIRE(sqlite.connect(db));
+    REQUIRE(sqlite.create_datatable<person>(ormpp_key{"id"}));
+    sqlite.delete_records<person>();
+    for (int i = 1; i <= 20; ++i) {
+      CHECK(sqlite.insert(person{i, "tom" + std::to_string(i), i}) == 1);
+    }
+  }
+
+  auto &pool = connection_pool<dbng<sqlite>>::instance();
+  pool.init(2, db);
+
+  batch_loader<dbng<sqlite>, person, int> loader(
+      &person::id, std::chrono::milliseconds(20));
+  std::vector<std::vector<std::optional<person>>> results(8);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 8; ++i) {
+    threads.emplace_back([&loader, &result = results[i]] {
+      std::vector<std::future<std::optional<person>>> futures;
+      for (int key = 1; key <= 25; ++key) {
+        futures.push_back(loader.load(key));
+      }
+      for (auto &future : futures) {
+        result.push_back(future.get());
+      }
+    });
+  }
+
+  for (auto &thd : threads) {
+    thd.join();
+  }
+
+  for (auto &result : results) {
+    REQUIRE(result.size() == 25);
+    CHECK(result[0]->name == "tom1");
+    CHECK(result[19]->age == 20);
+    CHECK(!result[20]);
+  }
+  CHECK(loader.batch_count() < 8 * 25);
+
+  // there is no person table in the database of the pool
+  connection_pool<dbng<sqlite>> empty_pool;
+  empty_pool.init(1, "test_ormpp_empty");
+  batch_loader<dbng<sqlite>, person, int> failed_loader(
+      &person::id, std::chrono::milliseconds(1), max_batch_params, empty_pool);
+  auto failed = failed_loader.load(1);
+  CHECK_THROWS_AS(failed.get(), std::runtime_error);
+}
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+TEST_CASE("orm_parallel_scan") {
+  {
+    dbng<sqlite> sqlite;
+    REQUIRE(sqlite.connect(db));
+    REQUIRE(sqlite.create_datatable<person>(ormpp_key{"id"}));
+    sqlite.delete_records<person>();
+    std::vector<person> v;
+    for (int i = 1; i <= 100; ++i) {
+      v.push_back(person{i, "tom" + std::to_string(i), i % 20});
+    }
+    CHECK(sqlite.insert(v) == 100);
+  }
+
+  auto &pool = connection_pool<dbng<sqlite>>::instance();
+  pool.init(2, db);
+
+  // more partitions than connections
+  auto rows = parallel_scan<dbng<sqlite>>(&person::id, 4, "age >= 10");
+  REQUIRE(rows.size() == 50);
+  for (size_t i = 1; i < rows.size(); ++i) {
+    CHECK(rows[i - 1].id < rows[i].id);
+  }
+  CHECK(rows[0].id == 10);
+  CHECK(rows[0].name == "tom10");
+
+  std::mutex mutex;
+  std::map<size_t, size_t> partition_rows;
+  std::vector<scan_progress> done;
+  size_t total = 0;
+  CHECK(parallel_scan<dbng<sqlite>>(
+      &person::id, 3, "",
+      [&](size_t partition, std::vector<person> &&rows) {
+        std::unique_lock<std::mutex> lock(mutex);
+        partition_rows[partition] += rows.size();
+        total += rows.size();
+      },
+      [&](const scan_progress &progress) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (progress.done)
+          done.push_back(progress);
+      }));
+  CHECK(total == 100);
+  REQUIRE(done.size() == 3);
+  for (auto &progress : done) {
+    CHECK(progress.rows == partition_rows[progress.partition]);
+    // the first partition takes the remainder of the keys
+    int64_t keys = progress.partition == 0 ? 34 : 33;
+    CHECK(progress.end - progress.begin + 1 == keys);
+  }
+
+  CHECK(parallel_scan<dbng<sqlite>>(&person::id, 4, "age > 100").empty());
+
+  // the table is dropped after the first page, so the next page fails
+  dbng<ormpp::sqlite> writer;
+  REQUIRE(writer.connect("test_ormpp_scan"));
+  REQUIRE(writer.create_datatable<person>(ormpp_key{"id"}));
+  writer.delete_records<person>();
+  std::vector<person> v;
+  for (int i = 1; i <= (int)scan_page_size + 1; ++i) {
+    v.push_back(person{i, "tom", 20});
+  }
+  CHECK(writer.insert(v) == (int)v.size());
+  connection_pool<dbng<sqlite>> scan_pool;
+  scan_pool.init(1, "test_ormpp_scan");
+  size_t scanned = 0;
+  CHECK(!parallel_scan<dbng<sqlite>>(
+      &person::id, 1, "",
+      [&](size_t, std::vector<person> &&rows) {
+        scanned += rows.size();
+        writer.execute("drop table person");
+      },
+      nullptr, scan_pool));
+  CHECK(scanned == scan_page_size);
+}
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+TEST_CASE("orm_sharded_dbng") {
+  connection_pool<dbng<sqlite>> pool0;
+  connection_pool<dbng<sqlite>> pool1;
+  pool0.init(2, "test_ormpp_shard0");
+  pool1.init(2, "test_ormpp_shard1");
+
+  // the odd ids go to the second shard
+  sharded_dbng<dbng<sqlite>, person, int> shards({&pool0, &pool1},
+                                                 &person::id);
+  CHECK(shards.shard_count() == 2);
+  CHECK(shards.shard_of(3) == 1);
+  CHECK(shards.shard_of(4) == 0);
+  CHECK(get_shard_hash(-1) == UINT64_MAX);
+  CHECK(get_shard_hash(std::string("a")) == 0xaf63dc4c8601ec8cull);
+  sharded_dbng<dbng<sqlite>, person, int> reversed(
+      {&pool0, &pool1}, &person::id, [](const int &id, size_t shards) {
+        return (size_t)(id + 1) % shards;
+      });
+  CHECK(reversed.shard_of(3) == 0);
+
+  auto created = shards.for_each_shard([](dbng<sqlite> &conn, size_t) {
+    return conn.create_datatable<person>(ormpp_key{"id"}) &&
+           conn.delete_records<person>();
+  });
+  CHECK(created == std::vector<bool>{true, true});
+
+  std::vector<person> v;
+  for (int i = 1; i <= 10; ++i) {
+    v.push_back(person{i, "tom" + std::to_string(i), 20 + i % 4});
+  }
+  CHECK(shards.insert(v) == 10);
+  CHECK(shards.insert(person{11, "jack", 30}) == 1);
+
+  auto counts = shards.for_each_shard([](dbng<sqlite> &conn, size_t) {
+    return conn.query<person>().size();
+  });
+  CHECK(counts == std::vector<size_t>{5, 6});
+
+  auto row = shards.get(11);
+  REQUIRE(row);
+  CHECK(row->name == "jack");
+  auto rows = shards.get_by_keys({4, 12, 3});
+  REQUIRE(rows.size() == 3);
+  CHECK(rows[0]->name == "tom4");
+  CHECK(!rows[1]);
+  CHECK(rows[2]->name == "tom3");
+
+  row->age = 31;
+  CHECK(shards.update(*row) == 1);
+  CHECK(shards.get(11)->age == 31);
+
+  CHECK(shards.query("age > 21").size() == 6);
+  auto ordered = shards.query_ordered(&person::id, true, 4, "age > 21");
+  REQUIRE(ordered.size() == 4);
+  CHECK(ordered[0].id == 11);
+  CHECK(ordered[1].id == 10);
+  CHECK(ordered[2].id == 7);
+  CHECK(ordered[3].id == 6);
+  CHECK(shards.query_ordered(&person::id, false, 0).size() == 11);
+
+  CHECK(shards.delete_by_keys({1, 2, 11}));
+  CHECK(shards.query().size() == 8);
+}
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+TEST_CASE("orm_table_checksum") {
+  dbng<sqlite> source;
+  dbng<sqlite> replica;
+  REQUIRE(source.connect(db));
+  REQUIRE(replica.connect("test_ormpp_replica"));
+  std::vector<person> v;
+  for (int i = 1; i <= 1000; ++i) {
+    v.push_back(person{i, "tom" + std::to_string(i), i % 50});
+  }
+  for (auto conn : {&source, &replica}) {
+    REQUIRE(conn->create_datatable<person>(ormpp_key{"id"}));
+    CHECK(conn->delete_records<person>());
+    CHECK(conn->insert(v) == 1000);
+  }
+
+  auto chunks = source.table_checksum(&person::id, 100);
+  REQUIRE(chunks.size() == 11);
+  CHECK(chunks[0].begin == -99);
+  CHECK(chunks[0].end == 99);
+  CHECK(chunks[0].rows == 99);
+  CHECK(chunks[1].begin == 100);
+  CHECK(chunks[1].rows == 100);
+  CHECK(chunks[10].rows == 1);
+  auto replica_chunks = replica.table_checksum(&person::id, 100);
+  REQUIRE(replica_chunks.size() == chunks.size());
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    CHECK(replica_chunks[i].hash == chunks[i].hash);
+  }
+  CHECK(source.table_diff(&person::id, replica, 100)->empty());
+
+  // a changed, a missing and an extra row
+  CHECK(replica.update(person{321, "jack", 20}) == 1);
+  CHECK(replica.delete_by_keys(&person::id, {777}));
+  CHECK(replica.insert(person{1500, "rose", 20}) == 1);
+  CHECK(replica.table_checksum(&person::id, 100)[3].hash != chunks[3].hash);
+  CHECK(source.table_diff(&person::id, replica, 100, 4, 8) ==
+        std::vector<int>{321, 777, 1500});
+  CHECK(replica.table_diff(&person::id, source, 1000) ==
+        std::vector<int>{321, 777, 1500});
+  // the leaf chunks have a key at least
+  CHECK(source.table_diff(&person::id, replica, 100, 16, 0) ==
+        std::vector<int>{321, 777, 1500});
+
+  // the values are hashed with their lengths, a null isn't an empty text
+  auto a = source.query<std::tuple<int64_t>>("select ormpp_crc32('a|', 'b')");
+  auto b = source.query<std::tuple<int64_t>>("select ormpp_crc32('a', '|b')");
+  REQUIRE(a.size() == 1);
+  REQUIRE(b.size() == 1);
+  CHECK(std::get<0>(a[0]) != std::get<0>(b[0]));
+  CHECK(source.update(person{5, "", 5}) == 1);
+  CHECK(replica.update(person{5, "", 5}) == 1);
+  CHECK(replica.execute("update person set name = NULL where id = 5"));
+  CHECK(source.table_diff(&person::id, replica, 100) ==
+        std::vector<int>{5, 321, 777, 1500});
+
+  // a failed query isn't an empty table
+  dbng<ormpp::sqlite> missing;
+  REQUIRE(missing.connect("test_ormpp_missing"));
+  CHECK(missing.execute("drop table if exists person"));
+  CHECK(!source.table_diff(&person::id, missing, 100));
+  CHECK(missing.has_error());
+  CHECK(!missing.table_diff(&person::id, source, 100));
+  CHECK(missing.table_checksum(&person::id, 100).empty());
+  CHECK(missing.has_error());
+}
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+TEST_CASE("orm_copy_table") {
+  dbng<sqlite> src;
+  dbng<sqlite> dst;
+  REQUIRE(src.connect(db));
+  REQUIRE(dst.connect("test_ormpp_copy"));
+  std::vector<person> v;
+  for (int i = 1; i <= 1000; ++i) {
+    v.push_back(person{i, "tom" + std::to_string(i), i % 50});
+  }
+  for (auto conn : {&src, &dst}) {
+    REQUIRE(conn->create_datatable<person>(ormpp_key{"id"}));
+    CHECK(conn->delete_records<person>());
+  }
+  CHECK(src.insert(v) == 1000);
+
+  // fail in the middle of the copy
+  copy_options<person, int> options;
+  options.batch_size = 100;
+  options.max_batches = 2;
+  options.transform = [](std::vector<person> &batch) {
+    for (auto &p : batch) {
+      p.name = "copy_" + p.name;
+    }
+  };
+  size_t progress = 0;
+  options.on_progress = [&progress](const copy_stats<int> &stats) {
+    ++progress;
+    if (stats.rows == 300)
+      throw std::runtime_error("stop");
+  };
+  CHECK_THROWS(copy_table(src, dst, &person::id, options));
+  CHECK(progress == 3);
+  CHECK(dst.query<person>().size() == 300);
+
+  // resume after the rows written
+  options.on_progress = nullptr;
+  options.resume_after = dst.max(&person::id);
+  auto stats = copy_table(src, dst, &person::id, options);
+  CHECK(stats.ok);
+  CHECK(stats.rows == 700);
+  CHECK(stats.batches == 7);
+  CHECK(*stats.last_key == 1000);
+  CHECK(stats.seconds > 0);
+
+  auto rows = dst.query<person>("id > 0 order by id");
+  REQUIRE(rows.size() == 1000);
+  CHECK(rows[0].name == "copy_tom1");
+  CHECK(rows[999].name == "copy_tom1000");
+  CHECK(rows[999].age == 0);
+  CHECK(dst.table_diff(&person::id, src, 100)->size() == 1000);
+}
+#endif
+
+TEST_CASE("orm_insert_id") {
+  ormpp_not_null not_null{{"code", "age"}};
+  ormpp_auto_key auto_key{"code"};
+
+  student s = {0, "tom", 0, 19, 1.5, "room2"};
+  std::vector<student> v{{0, "jack", 1, 20, 2.5, "room3"},
+                         {0, "mke", 2, 21, 3.5, "room4"},
+                         {0, "rose", 1, 22, 4.5, "room5"}};
+
+#ifdef ORMPP_ENABLE_MYSQL
+  {
+    dbng<mysql> mysql;
+    REQUIRE(mysql.connect(ip, "root", password, db));
+    REQUIRE(mysql.create_datatable<student>(auto_key, not_null));
+    CHECK(mysql.delete_records<student>());
+    auto id = mysql.get_insert_id_after_insert(s);
+    CHECK(id > 0);
+    auto ids = mysql.get_insert_id_after_insert(v);
+    REQUIRE(ids.size() == 3);
+    CHECK(ids[0] > id);
+    CHECK(ids[1] == ids[0] + 1);
+    CHECK(ids[2] == ids[1] + 1);
+
+    auto v1 = v;
+    REQUIRE(mysql.insert_and_set_keys(v1));
+    CHECK(v1[0].code == (int)ids[2] + 1);
+    CHECK(v1[2].code == v1[0].code + 2);
+    auto s1 = s;
+    REQUIRE(mysql.insert_and_set_key(s1));
+    CHECK(s1.code == v1[2].code + 1);
+    auto result = mysql.query<student>("code = " + std::to_string(v1[1].code));
+    REQUIRE(result.size() == 1);
+    CHECK(result[0].name == "mke");
+
+    // the ids of the rows with their own keys can't be known
+    auto v2 = v;
+    v2[1].code = 1000;
+    CHECK(mysql.get_insert_id_after_insert(v2).empty());
+  }
+#endif
+
+#ifdef ORMPP_ENABLE_PG
+  {
+    dbng<postgresql> postgres;
+    REQUIRE(postgres.connect(ip, "root", password, db));
+    REQUIRE(postgres.create_datatable<student>(auto_key, not_null));
+    CHECK(postgres.delete_records<student>());
+    auto id = postgres.get_insert_id_after_insert(s);
+    CHECK(id > 0);
+    auto ids = postgres.get_insert_id_after_insert(v);
+    REQUIRE(ids.size() == 3);
+    CHECK(ids[0] > id);
+    CHECK(ids[1] == ids[0] + 1);
+    CHECK(ids[2] == ids[1] + 1);
+
+    auto v1 = v;
+    REQUIRE(postgres.insert_and_set_keys(v1));
+    CHECK(v1[0].code == (int)ids[2] + 1);
+    CHECK(v1[2].code == v1[0].code + 2);
+    auto s1 = s;
+    REQUIRE(postgres.insert_and_set_key(s1));
+    CHECK(s1.code == v1[2].code + 1);
+    auto result =
+        postgres.query<student>("code = " + std::to_string(v1[1].code));
+    REQUIRE(result.size() == 1);
+    CHECK(result[0].name == "mke");
+  }
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+  {
+    dbng<sqlite> sqlite;
+    REQUIRE(sqlite.connect(db));
+    REQUIRE(sqlite.create_datatable<student>(auto_key, not_null));
+    CHECK(sqlite.delete_records<student>());
+    auto id = sqlite.get_insert_id_after_insert(s);
+    CHECK(id > 0);
+    auto ids = sqlite.get_insert_id_after_insert(v);
+    REQUIRE(ids.size() == 3);
+    CHECK(ids[0] > id);
+    CHECK(ids[1] == ids[0] + 1);
+    CHECK(ids[2] == ids[1] + 1);
+
+    auto v1 = v;
+    REQUIRE(sqlite.insert_and_set_keys(v1));
+    CHECK(v1[0].code == (int)ids[2] + 1);
+    CHECK(v1[2].code == v1[0].code + 2);
+    auto s1 = s;
+    REQUIRE(sqlite.insert_and_set_key(s1));
+    CHECK(s1.code == v1[2].code + 1);
+    auto result = sqlite.query<student>("code = " + std::to_string(v1[1].code));
+    REQUIRE(result.size() == 1);
+    CHECK(result[0].name == "mke");
+
+    // there is no key to set without an auto key
+    REQUIRE(sqlite.create_datatable<student>(ormpp_key{"code"}));
+    auto rows = sqlite.count<student>();
+    auto s2 = s;
+    CHECK(!sqlite.insert_and_set_key(s2));
+    CHECK(!sqlite.insert_and_set_keys(v1));
+    CHECK(sqlite.count<student>() == rows);
+  }
+#endif
+}
+
+TEST_CASE("orm_key_allocator") {
+  ormpp_not_null not_null{{"code", "age"}};
+  ormpp_auto_key auto_key{"code"};
+
+  std::vector<student> v;
+  for (int i = 0; i < 300; ++i) {
+    v.push_back(student{0, "jack", 1, 20, 2.5, "room3"});
+  }
+
+#ifdef ORMPP_ENABLE_MYSQL
+  {
+    dbng<mysql> mysql;
+    REQUIRE(mysql.connect(ip, "root", password, db));
+    REQUIRE(mysql.create_datatable<student>(auto_key, not_null));
+    CHECK(mysql.delete_records<student>());
+    key_allocator<decltype(mysql), student, int> allocator(&student::code,
+                                                           mysql, 100);
+    auto first = allocator.next();
+    REQUIRE(first > 0);
+    auto v1 = v;
+    CHECK(mysql.insert_with_keys(v1, allocator) == 300);
+    CHECK(v1[0].code == (int)first + 1);
+    CHECK(v1[299].code == (int)first + 300);
+    CHECK(mysql.count<student>() == 300);
+    auto result = mysql.query<student>("code = " + std::to_string(first + 1));
+    REQUIRE(result.size() == 1);
+    CHECK(result[0].name == "jack");
+  }
+#endif
+
+#ifdef ORMPP_ENABLE_PG
+  {
+    dbng<postgresql> postgres;
+    REQUIRE(postgres.connect(ip, "root", password, db));
+    REQUIRE(postgres.create_datatable<student>(auto_key, not_null));
+    CHECK(postgres.delete_records<student>());
+    key_allocator<decltype(postgres), student, int> allocator(&student::code,
+                                                              postgres, 100);
+    auto first = allocator.next();
+    REQUIRE(first > 0);
+    auto v1 = v;
+    CHECK(postgres.insert_with_keys(v1, allocator) == 300);
+    CHECK(v1[0].code == (int)first + 1);
+    CHECK(v1[299].code == (int)first + 300);
+    CHECK(postgres.count<student>() == 300);
+    auto result =
+        postgres.query<student>("code = " + std::to_string(first + 1));
+    REQUIRE(result.size() == 1);
+    CHECK(result[0].name == "jack");
+  }
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+  {
+    dbng<sqlite> sqlite;
+    REQUIRE(sqlite.connect(db));
+    REQUIRE(sqlite.create_datatable<student>(auto_key, not_null));
+    CHECK(sqlite.delete_records<student>());
+    key_allocator<decltype(sqlite), student, int> allocator(&student::code,
+                                                            sqlite, 100);
+    auto first = allocator.next();
+    REQUIRE(first > 0);
+    auto v1 = v;
+    CHECK(sqlite.insert_with_keys(v1, allocator) == 300);
+    CHECK(v1[0].code == (int)first + 1);
+    CHECK(v1[299].code == (int)first + 300);
+    CHECK(sqlite.count<student>() == 300);
+    auto result = sqlite.query<student>("code = " + std::to_string(first + 1));
+    REQUIRE(result.size() == 1);
+    CHECK(result[0].name == "jack");
+  }
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+  {
+    dbng<sqlite> sqlite;
+    REQUIRE(sqlite.connect(db));
+    key_allocator<decltype(sqlite), student, int> allocator(&student::code,
+                                                            sqlite, 100);
+    std::vector<std::vector<uint64_t>> keys(4);
+    std::vector<std::thread> threads;
+    for (auto &thd_keys : keys) {
+      threads.emplace_back([&allocator, &thd_keys] {
+        for (int i = 0; i < 1000; ++i) {
+          thd_keys.push_back(allocator.next());
+        }
+      });
+    }
+    for (auto &thd : threads) {
+      thd.join();
+    }
+
+    std::vector<uint64_t> all;
+    for (auto &thd_keys : keys) {
+      all.insert(all.end(), thd_keys.begin(), thd_keys.end());
+    }
+    std::sort(all.begin(), all.end());
+    CHECK(all.front() > 0);
+    CHECK(std::unique(all.begin(), all.end()) == all.end());
+  }
+#endif
+}
+
+TEST_CASE("orm_unit_of_work") {
+  ormpp_not_null not_null{{"code", "age"}};
+
+#ifdef ORMPP_ENABLE_MYSQL
+  {
+    dbng<mysql> mysql;
+    REQUIRE(mysql.connect(ip, "root", password, db));
+    REQUIRE(mysql.create_datatable<person>(ormpp_key{"id"}));
+    REQUIRE(mysql.create_datatable<student>(ormpp_key{"code"}, not_null));
+    CHECK(mysql.delete_records<person>());
+    CHECK(mysql.delete_records<student>());
+    CHECK(mysql.insert(student{9, "old", 0, 30, 1.5, "room1"}) == 1);
+
+    unit_of_work<decltype(mysql)> uow(mysql);
+    uow.insert(person{1, "tom", 20});
+    uow.insert(student{1, "jack", 1, 20, 2.5, "room3"});
+    uow.insert(person{2, "mke", 21});
+    uow.update(person{1, "tom", 30});
+    uow.remove(&student::code, 9);
+    CHECK(uow.size() == 5);
+    REQUIRE(uow.flush());
+    CHECK(uow.size() == 0);
+    CHECK(mysql.count<person>() == 2);
+    CHECK(mysql.count<student>() == 1);
+    auto result = mysql.query<person>("id = 1");
+    REQUIRE(result.size() == 1);
+    CHECK(result[0].age == 30);
+
+    // the duplicate key rolls back the whole unit of work
+    uow.insert(person{3, "rose", 22});
+    uow.insert(student{1, "jack", 1, 20, 2.5, "room3"});
+    CHECK(!uow.flush());
+    CHECK(uow.size() == 2);
+    CHECK(mysql.count<person>() == 2);
+  }
+#endif
+
+#ifdef ORMPP_ENABLE_PG
+  {
+    dbng<postgresql> postgres;
+    REQUIRE(postgres.connect(ip, "root", password, db));
+    REQUIRE(postgres.create_datatable<person>(ormpp_key{"id"}));
+    REQUIRE(postgres.create_datatable<student>(ormpp_key{"code"}, not_null));
+    CHECK(postgres.delete_records<person>());
+    CHECK(postgres.delete_records<student>());
+    CHECK(postgres.insert(student{9, "old", 0, 30, 1.5, "room1"}) == 1);
+
+    unit_of_work<decltype(postgres)> uow(postgres);
+    uow.insert(person{1, "tom", 20});
+    uow.insert(student{1, "jack", 1, 20, 2.5, "room3"});
+    uow.insert(person{2, "mke", 21});
+    uow.update(person{1, "tom", 30});
+    uow.remove(&student::code, 9);
+    CHECK(uow.size() == 5);
+    REQUIRE(uow.flush());
+    CHECK(uow.size() == 0);
+    CHECK(postgres.count<person>() == 2);
+    CHECK(postgres.count<student>() == 1);
+    auto result = postgres.query<person>("id = 1");
+    REQUIRE(result.size() == 1);
+    CHECK(result[0].age == 30);
+
+    // the duplicate key rolls back the whole unit of work
+    uow.insert(person{3, "rose", 22});
+    uow.insert(student{1, "jack", 1, 20, 2.5, "room3"});
+    CHECK(!uow.flush());
+    CHECK(uow.size() == 2);
+    CHECK(postgres.count<person>() == 2);
+  }
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+  {
+    dbng<sqlite> sqlite;
+    REQUIRE(sqlite.connect(db));
+    REQUIRE(sqlite.create_datatable<person>(ormpp_key{"id"}));
+    REQUIRE(sqlite.create_datatable<student>(ormpp_key{"code"}, not_null));
+    CHECK(sqlite.delete_records<person>());
+    CHECK(sqlite.delete_records<student>());
+    CHECK(sqlite.insert(student{9, "old", 0, 30, 1.5, "room1"}) == 1);
+
+    unit_of_work<decltype(sqlite)> uow(sqlite);
+    uow.insert(person{1, "tom", 20});
+    uow.insert(student{1, "jack", 1, 20, 2.5, "room3"});
+    uow.insert(person{2, "mke", 21});
+    uow.update(person{1, "tom", 30});
+    uow.remove(&student::code, 9);
+    CHECK(uow.size() == 5);
+    REQUIRE(uow.flush());
+    CHECK(uow.size() == 0);
+    CHECK(sqlite.count<person>() == 2);
+    CHECK(sqlite.count<student>() == 1);
+    auto result = sqlite.query<person>("id = 1");
+    REQUIRE(result.size() == 1);
+    CHECK(result[0].age == 30);
+
+    // the duplicate key rolls back the whole unit of work
+    uow.insert(person{3, "rose", 22});
+    uow.insert(student{1, "jack", 1, 20, 2.5, "room3"});
+    CHECK(!uow.flush());
+    CHECK(uow.size() == 2);
+    CHECK(sqlite.count<person>() == 2);
+  }
+#endif
+}
+
+TEST_CASE("orm_entity_cache") {
+#ifdef ORMPP_ENABLE_MYSQL
+  {
+    dbng<mysql> mysql;
+    REQUIRE(mysql.connect(ip, "root", password, db));
+    REQUIRE(mysql.create_datatable<cached_person>(ormpp_key{"id"}));
+    CHECK(mysql.delete_records<cached_person>());
+    CHECK(mysql.insert(cached_person{1, "tom", 20}) == 1);
+    CHECK(mysql.insert(cached_person{2, "jack", 21}) == 1);
+
+    auto stats = mysql.get_cache_stats<cached_person>();
+    CHECK(mysql.get<cached_person>(1)->name == "tom");
+    CHECK(mysql.get<cached_person>(1)->name == "tom");
+    CHECK(!mysql.get<cached_person>(99));
+    auto stats1 = mysql.get_cache_stats<cached_person>();
+    CHECK(stats1.hits == stats.hits + 1);
+    CHECK(stats1.misses == stats.misses + 2);
+    CHECK(stats1.size == 1);
+
+    // the writes bypassing dbng are not seen until the entry is invalidated
+    CHECK(mysql.execute("update cached_person set name = 'x' where id = 1"));
+    CHECK(mysql.get<cached_person>(1)->name == "tom");
+    CHECK(mysql.update(cached_person{1, "tom2", 30}) == 1);
+    CHECK(mysql.get<cached_person>(1)->age == 30);
+    CHECK(mysql.delete_by_keys(&cached_person::id, {1}));
+    CHECK(!mysql.get<cached_person>(1));
+
+    // the rows read in a transaction are not cached
+    REQUIRE(mysql.begin());
+    CHECK(mysql.get<cached_person>(2)->name == "jack");
+    CHECK(mysql.commit());
+    CHECK(mysql.get_cache_stats<cached_person>().size == 0);
+    CHECK(mysql.get<cached_person>(2)->name == "jack");
+    CHECK(mysql.delete_records<cached_person>());
+    CHECK(!mysql.get<cached_person>(2));
+  }
+#endif
+
+#ifdef ORMPP_ENABLE_PG
+  {
+    dbng<postgresql> postgres;
+    REQUIRE(postgres.connect(ip, "root", password, db));
+    REQUIRE(postgres.create_datatable<cached_person>(ormpp_key{"id"}));
+    CHECK(postgres.delete_records<cached_person>());
+    CHECK(postgres.insert(cached_person{1, "tom", 20}) == 1);
+    CHECK(postgres.insert(cached_person{2, "jack", 21}) == 1);
+
+    auto stats = postgres.get_cache_stats<cached_person>();
+    CHECK(postgres.get<cached_person>(1)->name == "tom");
+    CHECK(postgres.get<cached_person>(1)->name == "tom");
+    CHECK(!postgres.get<cached_person>(99));
+    auto stats1 = postgres.get_cache_stats<cached_person>();
+    CHECK(stats1.hits == stats.hits + 1);
+    CHECK(stats1.misses == stats.misses + 2);
+    CHECK(stats1.size == 1);
+
+    // the writes bypassing dbng are not seen until the entry is invalidated
+    CHECK(postgres.execute("update cached_person set name = 'x' where id = 1"));
+    CHECK(postgres.get<cached_person>(1)->name == "tom");
+    CHECK(postgres.update(cached_person{1, "tom2", 30}) == 1);
+    CHECK(postgres.get<cached_person>(1)->age == 30);
+    CHECK(postgres.delete_by_keys(&cached_person::id, {1}));
+    CHECK(!postgres.get<cached_person>(1));
+
+    // the rows read in a transaction are not cached
+    REQUIRE(postgres.begin());
+    CHECK(postgres.get<cached_person>(2)->name == "jack");
+    CHECK(postgres.commit());
+    CHECK(postgres.get_cache_stats<cached_person>().size == 0);
+    CHECK(postgres.get<cached_person>(2)->name == "jack");
+    CHECK(postgres.delete_records<cached_person>());
+    CHECK(!postgres.get<cached_person>(2));
+  }
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+  {
+    dbng<sqlite> sqlite;
+    REQUIRE(sqlite.connect(db));
+    REQUIRE(sqlite.create_datatable<cached_person>(ormpp_key{"id"}));
+    CHECK(sqlite.delete_records<cached_person>());
+    CHECK(sqlite.insert(cached_person{1, "tom", 20}) == 1);
+    CHECK(sqlite.insert(cached_person{2, "jack", 21}) == 1);
+
+    auto stats = sqlite.get_cache_stats<cached_person>();
+    CHECK(sqlite.get<cached_person>(1)->name == "tom");
+    CHECK(sqlite.get<cached_person>(1)->name == "tom");
+    CHECK(!sqlite.get<cached_person>(99));
+    auto stats1 = sqlite.get_cache_stats<cached_person>();
+    CHECK(stats1.hits == stats.hits + 1);
+    CHECK(stats1.misses == stats.misses + 2);
+    CHECK(stats1.size == 1);
+
+    // the writes bypassing dbng are not seen until the entry is invalidated
+    CHECK(sqlite.execute("update cached_person set name = 'x' where id = 1"));
+    CHECK(sqlite.get<cached_person>(1)->name == "tom");
+    CHECK(sqlite.update(cached_person{1, "tom2", 30}) == 1);
+    CHECK(sqlite.get<cached_person>(1)->age == 30);
+    CHECK(sqlite.delete_by_keys(&cached_person::id, {1}));
+    CHECK(!sqlite.get<cached_person>(1));
+
+    // the rows read in a transaction are not cached
+    REQUIRE(sqlite.begin());
+    CHECK(sqlite.get<cached_person>(2)->name == "jack");
+    CHECK(sqlite.commit());
+    CHECK(sqlite.get_cache_stats<cached_person>().size == 0);
+    CHECK(sqlite.get<cached_person>(2)->name == "jack");
+
+    // the rows of another database are cached apart
+    dbng<ormpp::sqlite> other;
+    REQUIRE(other.connect("test_ormpp_other"));
+    REQUIRE(other.create_datatable<cached_person>(ormpp_key{"id"}));
+    CHECK(other.delete_records<cached_person>());
+    CHECK(other.insert(cached_person{2, "rose", 22}) == 1);
+    CHECK(other.get<cached_person>(2)->name == "rose");
+    CHECK(sqlite.get<cached_person>(2)->name == "jack");
+    CHECK(other.delete_records<cached_person>());
+    CHECK(sqlite.get<cached_person>(2)->name == "jack");
+    CHECK(!other.get<cached_person>(2));
+
+    CHECK(sqlite.delete_records<cached_person>());
+    CHECK(!sqlite.get<cached_person>(2));
+  }
+#endif
+}
+
+TEST_CASE("orm_query_cache") {
+  using tables = std::vector<std::string>;
+  CHECK(get_sql_tables("select * from a, `B` x join c on x.id = c.id") ==
+        tables{"a", "b", "c"});
+  CHECK(get_sql_tables("select 'from d' from e where id in (select id "
+                       "from f)") == tables{"e", "f"});
+  CHECK(get_sql_tables("insert into \"g\"(id) values(1)") == tables{"g"});
+  CHECK(get_sql_tables("update h set age = 1") == tables{"h"});
+  std::string key1, key2, key3;
+  append_query_sql(key1, "select  'a  b' from t");
+  append_query_sql(key2, "select 'a b'\nfrom t");
+  append_query_sql(key3, " select 'a b' from  t ");
+  CHECK(key1 != key2);
+  CHECK(key2 == key3);
+
+#ifdef ORMPP_ENABLE_MYSQL
+  {
+    dbng<mysql> mysql;
+    REQUIRE(mysql.connect(ip, "root", password, db));
+    REQUIRE(mysql.create_datatable<person>(ormpp_key{"id"}));
+    CHECK(mysql.delete_records<person>());
+    CHECK(mysql.insert(person{1, "tom", 20}) == 1);
+    CHECK(mysql.insert(person{2, "jack", 21}) == 1);
+
+    auto stats = mysql.get_query_cache_stats();
+    auto rows = mysql.query_cached<person>("age > 10");
+    REQUIRE(rows->size() == 2);
+    // the same statement is a hit and shares the rows
+    CHECK(mysql.query_cached<person>("age  >\n10") == rows);
+    std::string sql = "select count(1) from person where age > ?";
+    auto count = mysql.query_cached<std::tuple<int64_t>>(sql, 20);
+    CHECK(std::get<0>(count->at(0)) == 1);
+    CHECK(mysql.query_cached<std::tuple<int64_t>>(sql, 20) == count);
+    CHECK(mysql.query_cached<std::tuple<int64_t>>(sql, 10) != count);
+    auto stats1 = mysql.get_query_cache_stats();
+    CHECK(stats1.hits == stats.hits + 2);
+    CHECK(stats1.misses == stats.misses + 3);
+
+    // the writes through ormpp evict the entries of the table
+    CHECK(mysql.insert(person{3, "rose", 30}) == 1);
+    CHECK(mysql.query_cached<person>("age > 10")->size() == 3);
+    count = mysql.query_cached<std::tuple<int64_t>>(sql, 20);
+    CHECK(std::get<0>(count->at(0)) == 2);
+    CHECK(mysql.execute("update person set age = 5 where id = 3"));
+    count = mysql.query_cached<std::tuple<int64_t>>(sql, 20);
+    CHECK(std::get<0>(count->at(0)) == 1);
+  }
+#endif
+
+#ifdef ORMPP_ENABLE_PG
+  {
+    dbng<postgresql> postgres;
+    REQUIRE(postgres.connect(ip, "root", password, db));
+    REQUIRE(postgres.create_datatable<person>(ormpp_key{"id"}));
+    CHECK(postgres.delete_records<person>());
+    CHECK(postgres.insert(person{1, "tom", 20}) == 1);
+    CHECK(postgres.insert(person{2, "jack", 21}) == 1);
+
+    auto stats = postgres.get_query_cache_stats();
+    auto rows = postgres.query_cached<person>("age > 10");
+    REQUIRE(rows->size() == 2);
+    // the same statement is a hit and shares the rows
+    CHECK(postgres.query_cached<person>("age  >\n10") == rows);
+    std::string sql = "select count(1) from person where age > $1";
+    auto count = postgres.query_cached<std::tuple<int64_t>>(sql, 20);
+    CHECK(std::get<0>(count->at(0)) == 1);
+    CHECK(postgres.query_cached<std::tuple<int64_t>>(sql, 20) == count);
+    CHECK(postgres.query_cached<std::tuple<int64_t>>(sql, 10) != count);
+    auto stats1 = postgres.get_query_cache_stats();
+    CHECK(stats1.hits == stats.hits + 2);
+    CHECK(stats1.misses == stats.misses + 3);
+
+    // the writes through ormpp evict the entries of the table
+    CHECK(postgres.insert(person{3, "rose", 30}) == 1);
+    CHECK(postgres.query_cached<person>("age > 10")->size() == 3);
+    count = postgres.query_cached<std::tuple<int64_t>>(sql, 20);
+    CHECK(std::get<0>(count->at(0)) == 2);
+    CHECK(postgres.execute("update person set age = 5 where id = 3"));
+    count = postgres.query_cached<std::tuple<int64_t>>(sql, 20);
+    CHECK(std::get<0>(count->at(0)) == 1);
+  }
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+  {
+    dbng<sqlite> sqlite;
+    REQUIRE(sqlite.connect(db));
+    REQUIRE(sqlite.create_datatable<person>(ormpp_key{"id"}));
+    CHECK(sqlite.delete_records<person>());
+    CHECK(sqlite.insert(person{1, "tom", 20}) == 1);
+    CHECK(sqlite.insert(person{2, "jack", 21}) == 1);
+
+    auto stats = sqlite.get_query_cache_stats();
+    auto rows = sqlite.query_cached<person>("age > 10");
+    REQUIRE(rows->size() == 2);
+    // the same statement is a hit and shares the rows
+    CHECK(sqlite.query_cached<person>("age  >\n10") == rows);
+    std::string sql = "select count(1) from person where age > ?";
+    auto count = sqlite.query_cached<std::tuple<int64_t>>(sql, 20);
+    CHECK(std::get<0>(count->at(0)) == 1);
+    CHECK(sqlite.query_cached<std::tuple<int64_t>>(sql, 20) == count);
+    CHECK(sqlite.query_cached<std::tuple<int64_t>>(sql, 10) != count);
+    auto stats1 = sqlite.get_query_cache_stats();
+    CHECK(stats1.hits == stats.hits + 2);
+    CHECK(stats1.misses == stats.misses + 3);
+
+    // the writes through ormpp evict the entries of the table
+    CHECK(sqlite.insert(person{3, "rose", 30}) == 1);
+    CHECK(sqlite.query_cached<person>("age > 10")->size() == 3);
+    count = sqlite.query_cached<std::tuple<int64_t>>(sql, 20);
+    CHECK(std::get<0>(count->at(0)) == 2);
+    CHECK(sqlite.execute("update person set age = 5 where id = 3"));
+    count = sqlite.query_cached<std::tuple<int64_t>>(sql, 20);
+    CHECK(std::get<0>(count->at(0)) == 1);
+
+    // the literals which only differ in the spaces are different queries
+    CHECK(sqlite.insert(person{4, "a  b", 40}) == 1);
+    CHECK(sqlite.query_cached<person>("name = 'a b'")->empty());
+    CHECK(sqlite.query_cached<person>("name = 'a  b'")->size() == 1);
+
+    // the failed queries aren't cached
+    stats = sqlite.get_query_cache_stats();
+    CHECK(sqlite.query_cached<person>("nothing > 1")->empty());
+    CHECK(sqlite.has_error());
+    CHECK(sqlite.query_cached<person>("nothing > 1")->empty());
+    CHECK(sqlite.get_query_cache_stats().hits == stats.hits);
+
+    // the same query of another database isn't shared
+    dbng<ormpp::sqlite> other;
+    REQUIRE(other.connect("test_ormpp_other"));
+    REQUIRE(other.create_datatable<person>(ormpp_key{"id"}));
+    CHECK(other.delete_records<person>());
+    CHECK(sqlite.query_cached<person>("age > 10")->size() == 3);
+    CHECK(other.query_cached<person>("age > 10")->empty());
+    CHECK(other.insert(person{1, "tom", 20}) == 1);
+    CHECK(other.query_cached<person>("age > 10")->size() == 1);
+    CHECK(sqlite.query_cached<person>("age > 10")->size() == 3);
+  }
+#endif
+}
+
+#ifdef ORMPP_ENABLE_SQLITE3
+TEST_CASE("orm_query_shared") {
+  // slow enough for the threads to run it at the same time
+  std::string sql =
+      "with recursive c(x) as (select 1 union all select x + 1 from c where x "
+      "< 300000) select count(1) from c";
+  auto stats = get_singleflight<sqlite>().stats();
+  std::vector<std::shared_ptr<const std::vector<std::tuple<int64_t>>>> results(
+      8);
+  std::vector<std::thread> threads;
+  for (auto &result : results) {
+    threads.emplace_back([&sql, &result] {
+      dbng<sqlite> sqlite;
+      if (sqlite.connect(db))
+        result = sqlite.query_shared<std::tuple<int64_t>>(sql);
+    });
+  }
+
+  for (auto &thd : threads) {
+    thd.join();
+  }
+
+  for (auto &result : results) {
+    REQUIRE(result != nullptr);
+    CHECK(std::get<0>(result->at(0)) == 300000);
+  }
+  auto stats1 = get_singleflight<sqlite>().stats();
+  CHECK(stats1.executions + stats1.coalesced ==
+        stats.executions + stats.coalesced + 8);
+  CHECK(stats1.coalesced > stats.coalesced);
+}
+
+TEST_CASE("orm_thread_pool") {
+  thread_pool pool(2);
+  CHECK(pool.size() == 2);
+
+  // the callers share the threads, each index is taken once
+  std::vector<std::future<std::vector<int>>> callers;
+  for (int n = 0; n < 4; ++n) {
+    callers.push_back(std::async(std::launch::async, [&pool] {
+      std::vector<int> hits(1000);
+      pool.parallel_for(hits.size(), 8, [&hits](size_t i) {
+        ++hits[i];
+      });
+      return hits;
+    }));
+  }
+  for (auto &caller : callers) {
+    auto hits = caller.get();
+    CHECK(std::count(hits.begin(), hits.end(), 1) == 1000);
+  }
+
+  std::atomic<size_t> done = 0;
+  CHECK_THROWS_AS(pool.parallel_for(10, 2,
+                                    [&done](size_t i) {
+                                      if (i == 3)
+                                        throw std::runtime_error("decode");
+                                      ++done;
+                                    }),
+                  std::runtime_error);
+  CHECK(done == 9);
+  pool.parallel_for(0, 2, [](size_t) {
+    FAIL("no index");
+  });
+}
+
+#ifdef ORMPP_ENABLE_PG
+TEST_CASE("orm_pg_parallel_decode") {
+  dbng<postgresql> postgres;
+  REQUIRE(postgres.connect(ip, "root", password, db));
+  REQUIRE(postgres.create_datatable<person>(ormpp_key{"id"}));
+  CHECK(postgres.delete_records<person>());
+  std::vector<person> rows;
+  for (int i = 0; i < 1001; ++i) {
+    rows.push_back(person{i, "name" + std::to_string(i), i % 100});
+  }
+  CHECK(postgres.insert(rows) == 1001);
+
+  auto expected = postgres.query<person>("id >= 0 order by id");
+  REQUIRE(expected.size() == 1001);
+
+  postgres.set_parallel_decode(100, 4);
+  auto v = postgres.query<person>("id >= 0 order by id");
+  REQUIRE(v.size() == 1001);
+  for (size_t i = 0; i < v.size(); ++i) {
+    CHECK(v[i].id == expected[i].id);
+    CHECK(v[i].name == expected[i].name);
+    CHECK(v[i].age == expected[i].age);
+  }
+  auto tuples = postgres.query<std::tuple<int, std::string>>(
+      "select id, name from person order by id");
+  REQUIRE(tuples.size() == 1001);
+  CHECK(std::get<0>(tuples[1000]) == 1000);
+  CHECK(std::get<1>(tuples[1000]) == "name1000");
+
+  // below the threshold
+  postgres.set_parallel_decode(10000);
+  CHECK(postgres.query<person>("id >= 0 order by id").size() == 1001);
+}
+#endif
+
+TEST_CASE("orm_query_columns") {
+#ifdef ORMPP_ENABLE_MYSQL
+  {
+    dbng<mysql> mysql;
+    REQUIRE(mysql.connect(ip, "root", password, db));
+    REQUIRE(mysql.create_datatable<person>(ormpp_key{"id"}));
+    CHECK(mysql.delete_records<person>());
+    CHECK(mysql.insert(person{1, "tom", 20}) == 1);
+    CHECK(mysql.insert(person{2, "", 21}) == 1);
+    CHECK(mysql.insert(person{3, "jack", 30}) == 1);
+
+    auto cols = mysql.query_columns<person>("age > 20 order by id");
+    REQUIRE(cols.size() == 2);
+    CHECK(cols.column(&person::id) == std::vector<int>{2, 3});
+    CHECK(cols.get<2>() == std::vector<int>{21, 30});
+    auto &names = cols.column(&person::name);
+    REQUIRE(names.size() == 2);
+    CHECK(names[0] == "");
+    CHECK(names[1] == "jack");
+    CHECK(names.offsets() == std::vector<uint64_t>{0, 0, 4});
+    CHECK(mysql.query_columns<person>("age > 100").empty());
+  }
+#endif
+
+#ifdef ORMPP_ENABLE_PG
+  {
+    dbng<postgresql> postgres;
+    REQUIRE(postgres.connect(ip, "root", password, db));
+    REQUIRE(postgres.create_datatable<person>(ormpp_key{"id"}));
+    CHECK(postgres.delete_records<person>());
+    CHECK(postgres.insert(person{1, "tom", 20}) == 1);
+    CHECK(postgres.insert(person{2, "", 21}) == 1);
+    CHECK(postgres.insert(person{3, "jack", 30}) == 1);
+
+    auto cols = postgres.query_columns<person>("age > 20 order by id");
+    REQUIRE(cols.size() == 2);
+    CHECK(cols.column(&person::id) == std::vector<int>{2, 3});
+    CHECK(cols.get<2>() == std::vector<int>{21, 30});
+    auto &names = cols.column(&person::name);
+    REQUIRE(names.size() == 2);
+    CHECK(names[0] == "");
+    CHECK(names[1] == "jack");
+    CHECK(names.offsets() == std::vector<uint64_t>{0, 0, 4});
+    CHECK(postgres.query_columns<person>("age > 100").empty());
+  }
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+  {
+    dbng<sqlite> sqlite;
+    REQUIRE(sqlite.connect(db));
+    REQUIRE(sqlite.create_datatable<person>(ormpp_key{"id"}));
+    CHECK(sqlite.delete_records<person>());
+    CHECK(sqlite.insert(person{1, "tom", 20}) == 1);
+    CHECK(sqlite.insert(person{2, "", 21}) == 1);
+    CHECK(sqlite.insert(person{3, "jack", 30}) == 1);
+
+    auto cols = sqlite.query_columns<person>("age > 20 order by id");
+    REQUIRE(cols.size() == 2);
+    CHECK(cols.column(&person::id) == std::vector<int>{2, 3});
+    CHECK(cols.get<2>() == std::vector<int>{21, 30});
+    auto &names = cols.column(&person::name);
+    REQUIRE(names.size() == 2);
+    CHECK(names[0] == "");
+    CHECK(names[1] == "jack");
+    CHECK(names.offsets() == std::vector<uint64_t>{0, 0, 4});
+    CHECK(sqlite.query_columns<person>("age > 100").empty());
+  }
+#endif
+}
+
+TEST_CASE("orm_for_each_row") {
+#ifdef ORMPP_ENABLE_MYSQL
+  {
+    dbng<mysql> mysql;
+    REQUIRE(mysql.connect(ip, "root", password, db));
+    REQUIRE(mysql.create_datatable<person>(ormpp_key{"id"}));
+    CHECK(mysql.delete_records<person>());
+    CHECK(mysql.insert(person{1, "tom", 20}) == 1);
+    CHECK(mysql.insert(person{2, "", 21}) == 1);
+    CHECK(mysql.insert(person{3, "jack", 30}) == 1);
+
+    std::vector<std::string> names;
+    std::vector<person> rows;
+    CHECK(mysql.for_each_row<person>(
+        [&names, &rows](const row_view<person> &row) {
+          std::string_view name = row.get(&person::name);
+          names.emplace_back(name);
+          rows.push_back(row.to_row());
+        },
+        "id > 0 order by id"));
+    CHECK(names == std::vector<std::string>{"tom", "", "jack"});
+    REQUIRE(rows.size() == 3);
+    CHECK(rows[2].id == 3);
+    CHECK(rows[2].name == "jack");
+    CHECK(rows[2].age == 30);
+
+    // stop after the first row
+    int count = 0;
+    CHECK(mysql.for_each_row<person>(
+        [&count](const row_view<person> &row) {
+          CHECK(row.get<0>() == 1);
+          ++count;
+          return false;
+        },
+        "id > 0 order by id"));
+    CHECK(count == 1);
+  }
+#endif
+
+#ifdef ORMPP_ENABLE_PG
+  {
+    dbng<postgresql> postgres;
+    REQUIRE(postgres.connect(ip, "root", password, db));
+    REQUIRE(postgres.create_datatable<person>(ormpp_key{"id"}));
+    CHECK(postgres.delete_records<person>());
+    CHECK(postgres.insert(person{1, "tom", 20}) == 1);
+    CHECK(postgres.insert(person{2, "", 21}) == 1);
+    CHECK(postgres.insert(person{3, "jack", 30}) == 1);
+
+    std::vector<std::string> names;
+    std::vector<person> rows;
+    CHECK(postgres.for_each_row<person>(
+        [&names, &rows](const row_view<person> &row) {
+          std::string_view name = row.get(&person::name);
+          names.emplace_back(name);
+          rows.push_back(row.to_row());
+        },
+        "id > 0 order by id"));
+    CHECK(names == std::vector<std::string>{"tom", "", "jack"});
+    REQUIRE(rows.size() == 3);
+    CHECK(rows[2].id == 3);
+    CHECK(rows[2].name == "jack");
+    CHECK(rows[2].age == 30);
+
+    // stop after the first row
+    int count = 0;
+    CHECK(postgres.for_each_row<person>(
+        [&count](const row_view<person> &row) {
+          CHECK(row.get<0>() == 1);
+          ++count;
+          return false;
+        },
+        "id > 0 order by id"));
+    CHECK(count == 1);
+  }
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+  {
+    dbng<sqlite> sqlite;
+    REQUIRE(sqlite.connect(db));
+    REQUIRE(sqlite.create_datatable<person>(ormpp_key{"id"}));
+    CHECK(sqlite.delete_records<person>());
+    CHECK(sqlite.insert(person{1, "tom", 20}) == 1);
+    CHECK(sqlite.insert(person{2, "", 21}) == 1);
+    CHECK(sqlite.insert(person{3, "jack", 30}) == 1);
+
+    std::vector<std::string> names;
+    std::vector<person> rows;
+    CHECK(sqlite.for_each_row<person>(
+        [&names, &rows](const row_view<person> &row) {
+          std::string_view name = row.get(&person::name);
+          names.emplace_back(name);
+          rows.push_back(row.to_row());
+        },
+        "id > 0 order by id"));
+    CHECK(names == std::vector<std::string>{"tom", "", "jack"});
+    REQUIRE(rows.size() == 3);
+    CHECK(rows[2].id == 3);
+    CHECK(rows[2].name == "jack");
+    CHECK(rows[2].age == 30);
+
+    // stop after the first row
+    int count = 0;
+    CHECK(sqlite.for_each_row<person>(
+        [&count](const row_view<person> &row) {
+          CHECK(row.get<0>() == 1);
+          ++count;
+          return false;
+        },
+        "id > 0 order by id"));
+    CHECK(count == 1);
+  }
+#endif
+}
+
+TEST_CASE("orm_for_each_batch") {
+#ifdef ORMPP_ENABLE_MYSQL
+  {
+    dbng<mysql> mysql;
+    REQUIRE(mysql.connect(ip, "root", password, db));
+    REQUIRE(mysql.create_datatable<person>(ormpp_key{"id"}));
+    CHECK(mysql.delete_records<person>());
+    std::vector<person> v;
+    for (int i = 1; i <= 10; ++i) {
+      v.push_back(person{i, "tom" + std::to_string(i), i});
+    }
+    CHECK(mysql.insert(v) == 10);
+
+    std::vector<size_t> sizes;
+    std::vector<person> rows;
+    CHECK(mysql.for_each_batch<person>(
+        4,
+        [&sizes, &rows](std::vector<person> &&batch) {
+          sizes.push_back(batch.size());
+          rows.insert(rows.end(), batch.begin(), batch.end());
+        },
+        "id > 0 order by id"));
+    CHECK(sizes == std::vector<size_t>{4, 4, 2});
+    REQUIRE(rows.size() == 10);
+    CHECK(rows[9].name == "tom10");
+
+    // stop after the first batch
+    int count = 0;
+    CHECK(mysql.for_each_batch<person>(
+        4,
+        [&count](std::vector<person> &&batch) {
+          CHECK(batch[0].id == 1);
+          ++count;
+          return false;
+        },
+        "id > 0 order by id"));
+    CHECK(count == 1);
+
+    rows.clear();
+    {
+      auto stream = mysql.query_stream<person>(3, 1, "id > 0 order by id");
+      std::vector<person> batch;
+      while (stream.next(batch)) {
+        rows.insert(rows.end(), batch.begin(), batch.end());
+      }
+      CHECK(stream.ok());
+    }
+    REQUIRE(rows.size() == 10);
+    CHECK(rows[0].id == 1);
+    CHECK(rows[9].age == 10);
+
+    // the fetch stops when the stream is destroyed
+    {
+      auto stream = mysql.query_stream<person>(1, 1, "id > 0 order by id");
+      std::vector<person> batch;
+      REQUIRE(stream.next(batch));
+      CHECK(batch.size() == 1);
+    }
+    CHECK(mysql.query<person>().size() == 10);
+  }
+#endif
+
+#ifdef ORMPP_ENABLE_PG
+  {
+    dbng<postgresql> postgres;
+    REQUIRE(postgres.connect(ip, "root", password, db));
+    REQUIRE(postgres.create_datatable<person>(ormpp_key{"id"}));
+    CHECK(postgres.delete_records<person>());
+    std::vector<person> v;
+    for (int i = 1; i <= 10; ++i) {
+      v.push_back(person{i, "tom" + std::to_string(i), i});
+    }
+    CHECK(postgres.insert(v) == 10);
+
+    std::vector<size_t> sizes;
+    std::vector<person> rows;
+    CHECK(postgres.for_each_batch<person>(
+        4,
+        [&sizes, &rows](std::vector<person> &&batch) {
+          sizes.push_back(batch.size());
+          rows.insert(rows.end(), batch.begin(), batch.end());
+        },
+        "id > 0 order by id"));
+    CHECK(sizes == std::vector<size_t>{4, 4, 2});
+    REQUIRE(rows.size() == 10);
+    CHECK(rows[9].name == "tom10");
+
+    // stop after the first batch
+    int count = 0;
+    CHECK(postgres.for_each_batch<person>(
+        4,
+        [&count](std::vector<person> &&batch) {
+          CHECK(batch[0].id == 1);
+          ++count;
+          return false;
+        },
+        "id > 0 order by id"));
+    CHECK(count == 1);
+
+    // the cursor and the transaction are closed if func throws
+    CHECK_THROWS_AS(postgres.for_each_batch<person>(
+                        4,
+                        [](std::vector<person> &&) {
+                          throw std::runtime_error("stop");
+                        },
+                        "id > 0 order by id"),
+                    std::runtime_error);
+    count = 0;
+    CHECK(postgres.for_each_batch<person>(
+        4,
+        [&count](std::vector<person> &&batch) {
+          count += (int)batch.size();
+        },
+        "id > 0 order by id"));
+    CHECK(count == 10);
+
+    rows.clear();
+    {
+      auto stream = postgres.query_stream<person>(3, 1, "id > 0 order by id");
+      std::vector<person> batch;
+      while (stream.next(batch)) {
+        rows.insert(rows.end(), batch.begin(), batch.end());
+      }
+      CHECK(stream.ok());
+    }
+    REQUIRE(rows.size() == 10);
+    CHECK(rows[0].id == 1);
+    CHECK(rows[9].age == 10);
+
+    // the fetch stops when the stream is destroyed
+    {
+      auto stream = postgres.query_stream<person>(1, 1, "id > 0 order by id");
+      std::vector<person> batch;
+      REQUIRE(stream.next(batch));
+      CHECK(batch.size() == 1);
+    }
+    CHECK(postgres.query<person>().size() == 10);
+  }
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+  {
+    dbng<sqlite> sqlite;
+    REQUIRE(sqlite.connect(db));
+    REQUIRE(sqlite.create_datatable<person>(ormpp_key{"id"}));
+    CHECK(sqlite.delete_records<person>());
+    std::vector<person> v;
+    for (int i = 1; i <= 10; ++i) {
+      v.push_back(person{i, "tom" + std::to_string(i), i});
+    }
+    CHECK(sqlite.insert(v) == 10);
+
+    std::vector<size_t> sizes;
+    std::vector<person> rows;
+    CHECK(sqlite.for_each_batch<person>(
+        4,
+        [&sizes, &rows](std::vector<person> &&batch) {
+          sizes.push_back(batch.size());
+          rows.insert(rows.end(), batch.begin(), batch.end());
+        },
+        "id > 0 order by id"));
+    CHECK(sizes == std::vector<size_t>{4, 4, 2});
+    REQUIRE(rows.size() == 10);
+    CHECK(rows[9].name == "tom10");
+
+    // stop after the first batch
+    int count = 0;
+    CHECK(sqlite.for_each_batch<person>(
+        4,
+        [&count](std::vector<person> &&batch) {
+          CHECK(batch[0].id == 1);
+          ++count;
+          return false;
+        },
+        "id > 0 order by id"));
+    CHECK(count == 1);
+
+    rows.clear();
+    {
+      auto stream = sqlite.query_stream<person>(3, 1, "id > 0 order by id");
+      std::vector<person> batch;
+      while (stream.next(batch)) {
+        rows.insert(rows.end(), batch.begin(), batch.end());
+      }
+      CHECK(stream.ok());
+    }
+    REQUIRE(rows.size() == 10);
+    CHECK(rows[0].id == 1);
+    CHECK(rows[9].age == 10);
+
+    // the fetch stops when the stream is destroyed
+    {
+      auto stream = sqlite.query_stream<person>(1, 1, "id > 0 order by id");
+      std::vector<person> batch;
+      REQUIRE(stream.next(batch));
+      CHECK(batch.size() == 1);
+    }
+    CHECK(sqlite.query<person>().size() == 10);
+  }
+#endif
+}
+
+TEST_CASE("orm_column_ops") {
+  // 1003 rows to cover the tails after the simd blocks
+  std::vector<person> rows;
+  for (int i = 0; i < 1003; ++i) {
+    rows.push_back(
+        person{i, "name" + std::to_string(i % 10), (i * 37) % 101 - 50});
+  }
+
+  int64_t total = 0;
+  int lowest = rows[0].age;
+  int highest = rows[0].age;
+  std::vector<size_t> expected;
+  for (size_t i = 0; i < rows.size(); ++i) {
+    int age = rows[i].age;
+    total += age;
+    lowest = (std::min)(lowest, age);
+    highest = (std::max)(highest, age);
+    if (age > 20)
+      expected.push_back(i);
+  }
+  CHECK(sum(rows, &person::age) == total);
+  CHECK(min(rows, &person::age) == lowest);
+  CHECK(max(rows, &person::age) == highest);
+  CHECK(filter(rows, &person::age, ">", 20) == expected);
+  CHECK(count(rows, &person::age, ">", 20) == expected.size());
+
+  auto ages = get_column(rows, &person::age);
+  for (auto oper : {"=", "==", "!=", "<>", "<", "<=", ">", ">="}) {
+    auto op = to_compare_op(oper);
+    size_t matches = 0;
+    for (auto age : ages) {
+      if (compare_value(op, age, 7))
+        ++matches;
+    }
+    CHECK(count(ages, oper, 7) == matches);
+  }
+  CHECK(filter(ages, "like", 7).empty());
+
+  // the conditions are combined by the selections
+  auto selection = filter(ages, "<", 40, expected);
+  int64_t selected = 0;
+  for (auto i : selection) {
+    CHECK(ages[i] > 20);
+    CHECK(ages[i] < 40);
+    selected += ages[i];
+  }
+  CHECK(sum(ages, selection) == selected);
+  CHECK(min(ages, selection) > 20);
+  CHECK(max(ages, selection) < 40);
+
+  // the strings are compared by the scalar loop
+  CHECK(count(rows, &person::name, "=", "name3"s) == 100);
+
+  std::vector<int64_t> ids;
+  std::vector<float> floats;
+  std::vector<double> doubles;
+  for (int i = 0; i < 1003; ++i) {
+    ids.push_back((int64_t)(i - 500) * 10000000000);
+    floats.push_back((float)(i % 17) - 8.5f);
+    doubles.push_back((i % 29) * 0.25 - 3);
+  }
+  CHECK(sum(ids) == (int64_t)(1003 * 1002 / 2 - 500 * 1003) * 10000000000);
+  CHECK(min(ids) == -5000000000000);
+  CHECK(max(ids) == 5020000000000);
+  CHECK(count(ids, ">=", 0) == 503);
+  CHECK(min(floats) == -8.5f);
+  CHECK(max(floats) == 7.5f);
+  CHECK(count(floats, "<", 0) == 531);
+  double float_total = 0;
+  for (auto value : floats) {
+    float_total += value;
+  }
+  CHECK(sum(floats) == doctest::Approx(float_total));
+  CHECK(min(doubles) == -3);
+  CHECK(max(doubles) == 4);
+  CHECK(count(doubles, "=", 0.5) == 35);
+
+  CHECK(sum(std::vector<int>{}) == 0);
+  CHECK(min(std::vector<double>{}) == 0);
+
+  // the values of other types aren't converted to the type of the column
+  std::vector<int> scores{20, 20, 21, 19};
+  std::vector<unsigned> counts{0, 1, 2};
+  CHECK(filter(scores, ">=", 20.5) == std::vector<size_t>{2});
+  CHECK(count(scores, "=", 20.0) == 2);
+  CHECK(count(counts, ">", -1) == 3);
+  CHECK(count(counts, "<", -1) == 0);
+  CHECK(count(counts, ">", 5000000000LL) == 0);
+  CHECK(filter(counts, ">", -1, {0, 2}) == std::vector<size_t>{0, 2});
+  CHECK(filter(scores, ">=", 20.5, {0, 2}) == std::vector<size_t>{2});
+}
+
+#ifdef ORMPP_HAS_PMR
+TEST_CASE("orm_query_pmr") {
+  // longer than the small string buffer
+  std::pmr::string name = "a name longer than the small string buffer ";
+
+#ifdef ORMPP_ENABLE_MYSQL
+  {
+    dbng<mysql> mysql;
+    REQUIRE(mysql.connect(ip, "root", password, db));
+    REQUIRE(mysql.create_datatable<pmr_person>(ormpp_key{"id"}));
+    CHECK(mysql.delete_records<pmr_person>());
+    std::vector<pmr_person> rows;
+    for (int i = 0; i < 100; ++i) {
+      rows.push_back(pmr_person{i, name + std::to_string(i).c_str(), i});
+    }
+    CHECK(mysql.insert(rows) == 100);
+
+    counting_resource upstream;
+    std::pmr::monotonic_buffer_resource arena(&upstream);
+    // the strings can't be allocated from the default resource
+    auto old = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+    auto v = mysql.query<pmr_person>(&arena, "id >= 0 order by id");
+    std::pmr::set_default_resource(old);
+    REQUIRE(v.size() == 100);
+    CHECK(v[7].name == name + "7");
+    CHECK(v[7].age == 7);
+    CHECK(v[7].name.get_allocator().resource() == &arena);
+    CHECK(v.get_allocator().resource() == &arena);
+    // the arena allocates a few blocks rather than one per string
+    CHECK(upstream.count < 10);
+  }
+#endif
+
+#ifdef ORMPP_ENABLE_PG
+  {
+    dbng<postgresql> postgres;
+    REQUIRE(postgres.connect(ip, "root", password, db));
+    REQUIRE(postgres.create_datatable<pmr_person>(ormpp_key{"id"}));
+    CHECK(postgres.delete_records<pmr_person>());
+    std::vector<pmr_person> rows;
+    for (int i = 0; i < 100; ++i) {
+      rows.push_back(pmr_person{i, name + std::to_string(i).c_str(), i});
+    }
+    CHECK(postgres.insert(rows) == 100);
+
+    counting_resource upstream;
+    std::pmr::monotonic_buffer_resource arena(&upstream);
+    // the strings can't be allocated from the default resource
+    auto old = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+    auto v = postgres.query<pmr_person>(&arena, "id >= 0 order by id");
+    std::pmr::set_default_resource(old);
+    REQUIRE(v.size() == 100);
+    CHECK(v[7].name == name + "7");
+    CHECK(v[7].age == 7);
+    CHECK(v[7].name.get_allocator().resource() == &arena);
+    CHECK(v.get_allocator().resource() == &arena);
+    // the arena allocates a few blocks rather than one per string
+    CHECK(upstream.count < 10);
+  }
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+  {
+    dbng<sqlite> sqlite;
+    REQUIRE(sqlite.connect(db));
+    REQUIRE(sqlite.create_datatable<pmr_person>(ormpp_key{"id"}));
+    CHECK(sqlite.delete_records<pmr_person>());
+    std::vector<pmr_person> rows;
+    for (int i = 0; i < 100; ++i) {
+      rows.push_back(pmr_person{i, name + std::to_string(i).c_str(), i});
+    }
+    CHECK(sqlite.insert(rows) == 100);
+
+    counting_resource upstream;
+    std::pmr::monotonic_buffer_resource arena(&upstream);
+    // the strings can't be allocated from the default resource
+    auto old = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+    auto v = sqlite.query<pmr_person>(&arena, "id >= 0 order by id");
+    std::pmr::set_default_resource(old);
+    REQUIRE(v.size() == 100);
+    CHECK(v[7].name == name + "7");
+    CHECK(v[7].age == 7);
+    CHECK(v[7].name.get_allocator().resource() == &arena);
+    CHECK(v.get_allocator().resource() == &arena);
+    // the arena allocates a few blocks rather than one per string
+    CHECK(upstream.count < 10);
+  }
+#endif
+}
+#endif
+#endif
+
+TEST_CASE("orm_delete") {
+  ormpp_key key{"code"};
+  ormpp_not_null not_null{{"code", "age"}};
+  ormpp_auto_key auto_key{"code"};
+
+  student s = {1, "tom", 0, 19, 1.5, "room2"};
+  student s1 = {2, "jack", 1, 20, 2.5, "room3"};
+  student s2 = {3, "mike", 2, 21, 3.5, "room4"};
+  std::vector<student> v{s, s1, s2};
+
+#ifdef ORMPP_ENABLE_MYSQL
+  dbng<mysql> mysql;
+  REQUIRE(mysql.connect(ip, "root", password, db));
+  mysql.delete_records<student>();
+  REQUIRE(mysql.create_datatable<student>(key, not_null));
+  CHECK(mysql.insert(v) == 3);
+  REQUIRE(mysql.delete_records<student>("code=1"));
+  CHECK(mysql.query<student>().size() == 2);
+  REQUIRE(mysql.delete_records<student>(""));
+  auto result = mysql.query<student>();
+  CHECK(result.size() == 0);
+#endif
+
+#ifdef ORMPP_ENABLE_PG
+  dbng<postgresql> postgres;
+  REQUIRE(postgres.connect(ip, "root", password, db));
+  REQUIRE(postgres.create_datatable<student>(key, not_null));
+  CHECK(postgres.insert(v) == 3);
+  REQUIRE(postgres.delete_records<student>("code=1"));
+  CHECK(postgres.query<student>().size() == 2);
+  REQUIRE(postgres.delete_records<student>(""));
+  auto result1 = postgres.query<student>();
+  CHECK(result1.size() == 0);
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+  dbng<sqlite> sqlite;
+  REQUIRE(sqlite.connect(db));
+  REQUIRE(sqlite.create_datatable<student>(key));
+  sqlite.delete_records<student>();
+  CHECK(sqlite.insert(v) == 3);
+  REQUIRE(sqlite.delete_records<student>("code=1"));
+  CHECK(sqlite.query<student>().size() == 2);
+  REQUIRE(sqlite.delete_records<student>(""));
+  auto result2 = sqlite.query<student>();
+  CHECK(result2.size() == 0);
+#endif
+}
+
+TEST_CASE("orm_query") {
+  ormpp_key key{"id"};
+  simple s1 = {1, 2.5, 3};
+  simple s2 = {2, 3.5, 4};
+  simple s3 = {3, 4.5, 5};
+  std::vector<simple> v{s1, s2, s3};
+
+#ifdef ORMPP_ENABLE_MYSQL
+  dbng<mysql> mysql;
+  REQUIRE(mysql.connect(ip, "root", password, db));
+  mysql.delete_records<simple>();
+  REQUIRE(mysql.create_datatable<simple>(key));
+  CHECK(mysql.insert(v) == 3);
+  auto result = mysql.query<simple>();
+  CHECK(result.size() == 3);
+  auto result3 = mysql.query<simple>("id=1");
+  CHECK(result3.size() == 1);
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+  dbng<sqlite> sqlite;
+  REQUIRE(sqlite.connect(db));
+  REQUIRE(sqlite.create_datatable<simple>(key));
+  sqlite.delete_records<simple>();
+  CHECK(sqlite.insert(v) == 3);
+  auto result2 = sqlite.query<simple>();
+  CHECK(result2.size() == 3);
+  auto result5 = sqlite.query<simple>("id=3");
+  CHECK(result5.size() == 1);
+#endif
+
+#ifdef ORMPP_ENABLE_PG
+  dbng<postgresql> postgres;
+  REQUIRE(postgres.connect(ip, "root", password, db));
+  REQUIRE(postgres.create_datatable<simple>(key));
+  CHECK(postgres.insert(v) == 3);
+  auto result1 = postgres.query<simple>();
+  CHECK(result1.size() == 3);
+  auto result4 = postgres.query<simple>("where id=2");
+  CHECK(result4.size() == 1);
+#endif
+}
+
+TEST_CASE("orm_query_some") {
+  ormpp_key key{"code"};
+  ormpp_not_null not_null{{"code", "age"}};
+  ormpp_auto_key auto_key{"code"};
+
+  student s = {1, "tom", 0, 19, 1.5, "room2"};
+  student s1 = {2, "jack", 1, 20, 2.5, "room3"};
+  student s2 = {3, "mike", 2, 21, 3.5, "room4"};
+  std::vector<student> v{s, s1, s2};
+
+#ifdef ORMPP_ENABLE_MYSQL
+  dbng<mysql> mysql;
+  REQUIRE(mysql.connect(ip, "root", password, db));
+  mysql.delete_records<student>();
+  REQUIRE(mysql.create_datatable<student>(key, not_null));
+  CHECK(mysql.insert(v) == 3);
+  auto result3 = mysql.query<std::tuple<int>>("select count(1) from student");
+  CHECK(result3.size() == 1);
+  CHECK(std::get<0>(result3[0]) == 3);
+
+  auto result4 = mysql.query<std::tuple<int>>("select count(1) from student");
+  CHECK(result4.size() == 1);
+  CHECK(std::get<0>(result4[0]) == 3);
+
+  auto result5 = mysql.query<std::tuple<int>>("select count(1) from student");
+  CHECK(result5.size() == 1);
+  CHECK(std::get<0>(result5[0]) == 3);
+  auto result = mysql.query<std::tuple<int, std::string, double>>(
+      "select code, name, dm from student");
+  CHECK(result.size() == 3);
+#endif
+
+#ifdef ORMPP_ENABLE_PG
+  dbng<postgresql> postgres;
+  REQUIRE(postgres.connect(ip, "root", password, db));
+  REQUIRE(postgres.create_datatable<student>(key, not_null));
+  CHECK(postgres.insert(v) == 3);
+  auto result1 = postgres.query<std::tuple<int, std::string, double>>(
+      "select code, name, dm from student");
+  CHECK(result1.size() == 3);
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+  dbng<sqlite> sqlite;
+  REQUIRE(sqlite.connect(db));
+  CHECK(sqlite.insert(v) == 3);
+  REQUIRE(sqlite.create_datatable<student>(key));
+  auto result2 = sqlite.query<std::tuple<int, std::string, double>>(
+      "select code, name, dm from student");
+  CHECK(result2.size() == 3);
+#endif
+}
+
+TEST_CASE("orm_query_select_fields") {
+  ormpp_key key{"code"};
+  ormpp_not_null not_null{{"code", "age"}};
+
+  student s = {1, "tom", 0, 19, 1.5, "room2"};
+  student s1 = {2, "jack", 1, 20, 2.5, "room3"};
+  student s2 = {3, "mike", 2, 21, 3.5, "room4"};
+  std::vector<student> v{s, s1, s2};
+
+#ifdef ORMPP_ENABLE_MYSQL
+  dbng<mysql> mysql;
+  REQUIRE(mysql.connect(ip, "root", password, db));
+  REQUIRE(mysql.create_datatable<student>(key, not_null));
+  mysql.delete_records<student>();
+  CHECK(mysql.insert(v) == 3);
+  auto result = mysql.query<student>(
+      select(&student::code, &student::name, &student::dm), "code > 1");
+  REQUIRE(result.size() == 2);
+  CHECK(result[0].name == "jack");
+  CHECK(result[0].dm == 2.5);
+  CHECK(result[0].age == 0);
+  CHECK(result[0].classroom.empty());
+#endif
+
+#ifdef ORMPP_ENABLE_PG
+  dbng<postgresql> postgres;
+  REQUIRE(postgres.connect(ip, "root", password, db));
+  REQUIRE(postgres.create_datatable<student>(key, not_null));
+  postgres.delete_records<student>();
+  CHECK(postgres.insert(v) == 3);
+  auto result1 = postgres.query<student>(
+      select(&student::code, &student::name, &student::dm), "code > 1");
+  REQUIRE(result1.size() == 2);
+  CHECK(result1[0].age == 0);
+  CHECK(result1[0].classroom.empty());
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+  dbng<sqlite> sqlite;
+  REQUIRE(sqlite.connect(db));
+  REQUIRE(sqlite.create_datatable<student>(key));
+  sqlite.delete_records<student>();
+  CHECK(sqlite.insert(v) == 3);
+  auto result2 = sqlite.query<student>(
+      select(&student::code, &student::name, &student::dm), "code > 1");
+  REQUIRE(result2.size() == 2);
+  CHECK(result2[0].code == 2);
+  CHECK(result2[0].name == "jack");
+  CHECK(result2[0].dm == 2.5);
+  CHECK(result2[0].age == 0);
+  CHECK(result2[0].classroom.empty());
+  auto result3 = sqlite.query<student>(select(&student::classroom));
+  REQUIRE(result3.size() == 3);
+  CHECK(result3[2].classroom == "room4");
+  CHECK(result3[2].name.empty());
+#endif
+}
+
+struct age_count {
+  int age;
+  int64_t total;
+};
+REFLECTION(age_count, age, total)
+
+TEST_CASE("orm_aggregate") {
+  ormpp_key key{"code"};
+  ormpp_not_null not_null{{"code", "age"}};
+
+  student s = {1, "tom", 0, 19, 1.5, "room2"};
+  student s1 = {2, "jack", 1, 20, 2.5, "room3"};
+  student s2 = {3, "mike", 2, 20, 3.5, "room4"};
+  std::vector<student> v{s, s1, s2};
+
+#ifdef ORMPP_ENABLE_MYSQL
+  dbng<mysql> mysql;
+  REQUIRE(mysql.connect(ip, "root", password, db));
+  REQUIRE(mysql.create_datatable<student>(key, not_null));
+  mysql.delete_records<student>();
+  CHECK(mysql.insert(v) == 3);
+  CHECK(mysql.count<student>() == 3);
+  CHECK(mysql.count<student>("age = 20") == 2);
+  CHECK(mysql.exists<student>("name = 'tom'"));
+  CHECK(!mysql.exists<student>("name = 'nobody'"));
+  CHECK(mysql.sum(&student::age) == 59);
+  CHECK(mysql.max(&student::dm, "age = 20") == 3.5);
+#endif
+
+#ifdef ORMPP_ENABLE_PG
+  dbng<postgresql> postgres;
+  REQUIRE(postgres.connect(ip, "root", password, db));
+  REQUIRE(postgres.create_datatable<student>(key, not_null));
+  postgres.delete_records<student>();
+  CHECK(postgres.insert(v) == 3);
+  CHECK(postgres.count<student>() == 3);
+  CHECK(postgres.sum(&student::age) == 59);
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+  dbng<sqlite> sqlite;
+  REQUIRE(sqlite.connect(db));
+  REQUIRE(sqlite.create_datatable<student>(key));
+  sqlite.delete_records<student>();
+  CHECK(sqlite.count<student>() == 0);
+  CHECK(!sqlite.exists<student>());
+  CHECK(sqlite.sum(&student::age) == 0);
+  CHECK(sqlite.insert(v) == 3);
+  CHECK(sqlite.count<student>() == 3);
+  CHECK(sqlite.count<student>("age = 20") == 2);
+  CHECK(sqlite.exists<student>());
+  CHECK(sqlite.exists<student>("name = 'tom'"));
+  CHECK(!sqlite.exists<student>("name = 'nobody'"));
+  CHECK(sqlite.sum(&student::age) == 59);
+  CHECK(sqlite.sum(&student::dm, "age = 20") == 6.0);
+  CHECK(sqlite.min(&student::age) == 19);
+  CHECK(sqlite.max(&student::dm, "age = 20") == 3.5);
+  CHECK(sqlite.max(&student::name) == "tom");
+  CHECK(sqlite.avg(&student::dm) == 2.5);
+  auto groups =
+      sqlite.group_by<age_count>(select(&student::age), "count(1)");
+  REQUIRE(groups.size() == 2);
+  CHECK(groups[0].age == 19);
+  CHECK(groups[0].total == 1);
+  CHECK(groups[1].age == 20);
+  CHECK(groups[1].total == 2);
+  auto groups1 = sqlite.group_by<age_count>(select(&student::age),
+                                            "count(1)", "code > 2");
+  REQUIRE(groups1.size() == 1);
+  CHECK(groups1[0].total == 1);
+  auto groups2 = sqlite.group_by<age_count>(
+      select(&student::age), "count(1)", "1=1 order by age desc", "limit 1");
+  REQUIRE(groups2.size() == 1);
+  CHECK(groups2[0].age == 20);
+  CHECK(groups2[0].total == 2);
+#endif
+}
+
+TEST_CASE("orm_query_page") {
+  ormpp_key key{"id"};
+  std::vector<person> v;
+  for (int i = 1; i <= 10; ++i) {
+    v.push_back(person{i, "name" + std::to_string(i % 3), 20 + i % 2});
+  }
+
+#ifdef ORMPP_ENABLE_MYSQL
+  dbng<mysql> mysql;
+  REQUIRE(mysql.connect(ip, "root", password, db));
+  REQUIRE(mysql.create_datatable<person>(key));
+  mysql.delete_records<person>();
+  CHECK(mysql.insert(v) == 10);
+  auto page = mysql.query_page(&person::id, std::nullopt, 4);
+  REQUIRE(page.rows.size() == 4);
+  REQUIRE(page.next_key.has_value());
+  auto page1 = mysql.query_page(&person::id, page.next_key, 4);
+  REQUIRE(page1.rows.size() == 4);
+  CHECK(page1.rows[0].id == 5);
+#endif
+
+#ifdef ORMPP_ENABLE_PG
+  dbng<postgresql> postgres;
+  REQUIRE(postgres.connect(ip, "root", password, db));
+  REQUIRE(postgres.create_datatable<person>(key));
+  postgres.delete_records<person>();
+  CHECK(postgres.insert(v) == 10);
+  auto page2 = postgres.query_page(&person::id, 4, 4);
+  REQUIRE(page2.rows.size() == 4);
+  CHECK(page2.rows[0].id == 5);
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+  dbng<sqlite> sqlite;
+  REQUIRE(sqlite.connect(db));
+  REQUIRE(sqlite.create_datatable<person>(key));
+  sqlite.delete_records<person>();
+  CHECK(sqlite.insert(v) == 10);
+
+  std::vector<int> ids;
+  std::optional<int> after;
+  do {
+    auto page = sqlite.query_page(&person::id, after, 4);
+    CHECK(page.rows.size() <= 4);
+    for (auto &p : page.rows) {
+      ids.push_back(p.id);
+    }
+    after = page.next_key;
+  } while (after);
+  REQUIRE(ids.size() == 10);
+  CHECK(ids.front() == 1);
+  CHECK(ids.back() == 10);
+
+  auto age_page = sqlite.query_page(&person::id, 4, 2, "age = 21");
+  REQUIRE(age_page.rows.size() == 2);
+  CHECK(age_page.rows[0].id == 5);
+  CHECK(age_page.rows[1].id == 7);
+  CHECK(age_page.next_key == 7);
+
+  auto composite_page = sqlite.query_page(
+      select(&person::age, &person::id), std::nullopt, 3);
+  REQUIRE(composite_page.rows.size() == 3);
+  CHECK(composite_page.rows[0].id == 2);
+  REQUIRE(composite_page.next_key.has_value());
+  CHECK(*composite_page.next_key == std::make_tuple(20, 6));
+  auto composite_next = sqlite.query_page(
+      select(&person::age, &person::id), composite_page.next_key, 3);
+  REQUIRE(composite_next.rows.size() == 3);
+  CHECK(composite_next.rows[0].id == 8);
+  CHECK(composite_next.rows[1].id == 10);
+  CHECK(composite_next.rows[2].id == 1);
+#endif
+}
+
+TEST_CASE("orm_query_with_params") {
+  ormpp_key key{"code"};
+  ormpp_not_null not_null{{"code", "age"}};
+
+  student s = {1, "tom", 0, 19, 1.5, "room2"};
+  student s1 = {2, "jack", 1, 20, 2.5, "room3"};
+  student s2 = {3, "mike", 2, 21, 3.5, "room4"};
+  std::vector<student> v{s, s1, s2};
+
+#ifdef ORMPP_ENABLE_MYSQL
+  dbng<mysql> mysql;
+  REQUIRE(mysql.connect(ip, "root", password, db));
+  REQUIRE(mysql.create_datatable<student>(key, not_null));
+  mysql.delete_records<student>();
+  CHECK(mysql.insert(v) == 3);
+  auto result = mysql.query<std::tuple<int, std::string>>(
+      "select code, name from student where code > ? and name <> ?", 1,
+      "mike");
+  REQUIRE(result.size() == 1);
+  CHECK(std::get<1>(result[0]) == "jack");
+  REQUIRE(mysql.execute("update student set name = ? where code = ?",
+                        "it's ok"s, 3));
+  auto result1 = mysql.query<std::tuple<std::string>>(
+      "select name from student where code = ?", 3);
+  REQUIRE(result1.size() == 1);
+  CHECK(std::get<0>(result1[0]) == "it's ok");
+#endif
+
+#ifdef ORMPP_ENABLE_PG
+  dbng<postgresql> postgres;
+  REQUIRE(postgres.connect(ip, "root", password, db));
+  REQUIRE(postgres.create_datatable<student>(key, not_null));
+  postgres.delete_records<student>();
+  CHECK(postgres.insert(v) == 3);
+  auto result2 = postgres.query<std::tuple<int, std::string>>(
+      "select code, name from student where code > $1 and name <> $2", 1,
+      "mike");
+  REQUIRE(result2.size() == 1);
+  CHECK(std::get<1>(result2[0]) == "jack");
+  REQUIRE(postgres.execute("update student set name = $1 where code = $2",
+                           "it's ok"s, 3));
+#endif
+
+#ifdef ORMPP_ENABLE_SQLITE3
+  dbng<sqlite> sqlite;
+  REQUIRE(sqlite.connect(db));
+  REQUIRE(sqlite.create_datatable<student>(key));
+  sqlite.delete_records<student>();
+  CHECK(sqlite.insert(v) == 3);
+  auto result3 = sqlite.query<std::tuple<int, std::string>>(
+      "select code, name from student where code > ? and name <> ?", 1,
+      "mike");
+  REQUIRE(result3.size() == 1);
+  CHECK(std::get<0>(result3[0]) == 2);
+  CHECK(std::get<1>(result3[0]) == "jack");
+  REQUIRE(sqlite.execute("update student set name = ? where code = ?",
+                         "it's ok"s, 3));
+  auto result4 = sqlite.query<std::tuple<std::string>>(
+      "select name from student where code = ?", 3);
+  REQUIRE(result4.size() == 1);
+  CHECK(std::get<0>(result4[0]) == "it's ok");
+  auto result5 = sqlite.query<std::tuple<int>>(
+      "select code from student where code = ?", 1, 2);
+  CHECK(result5.empty());
 #endif
 }
 